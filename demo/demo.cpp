@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include "../include/imglib.h"
@@ -109,6 +111,26 @@ void image_test()
         std::cerr << e.what() << '\n';
     }
 
+    // 大 sigma 的递归高斯 (ksize 为 0) 与同 sigma 的有限长核 (BORDER_REPLICATE) 在水平、垂直渐变上比较,
+    // 右边界和下边界处也应只差 1 左右
+    img::Image ramp(600, 600, IMG_32FC1);
+    for (int y = 0; y < 600; ++y)
+    {
+        for (int x = 0; x < 600; ++x)
+            *ramp.at<float>(y, x) = (x + y) * 255.0f / 1198;
+    }
+    img::Image iir;
+    img::Image fir;
+    img::gaussian_blur(ramp, iir, 0, 20.0, img::BORDER_REPLICATE);
+    img::gaussian_blur(ramp, fir, 161, 20.0, img::BORDER_REPLICATE);
+    float max_diff = 0;
+    for (int y = 0; y < 600; ++y)
+    {
+        for (int x = 0; x < 600; ++x)
+            max_diff = std::max(max_diff, std::abs(*iir.at<float>(y, x) - *fir.at<float>(y, x)));
+    }
+    std::cout << "递归高斯与有限长核在渐变上的最大差 (sigma = 20): " << max_diff << (max_diff < 1.0f ? " 通过" : " 失败") << std::endl;
+
     std::cout << "内部处理测试完成。" << std::endl;
 }
 
@@ -8,6 +8,14 @@
 #include <memory>
 #include <unordered_map>
 #include <iostream>
+#include <utility>
+#include <iterator>
+#include <limits>
+#include <cstdint>
+#include <type_traits>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
 namespace img
 {
@@ -19,6 +27,9 @@ namespace img
 #define IMG_32S 2
 #define IMG_32F 3
 #define IMG_64F 4
+#define IMG_16F 5 // 半精度浮点数 (img::float16), 用于减少浮点图像的内存带宽
+#define IMG_8S 6  // 有符号 8 位整数, 与 IMG_16S 一起用于梯度、差分等需要负数的紧凑中间结果
+#define IMG_16S 7
 
 // 注意保证宏里头不要传入非法类型
 #define IMG_MAKETYPE(depth, cn) ((depth) + (((cn) - 1) << 3)) // IMG_MAKETYPE只会在开头使用,就不修改成函数了
@@ -52,6 +63,134 @@ namespace img
 #define IMG_64FC3 IMG_MAKETYPE(IMG_64F, 3)
 #define IMG_64FC4 IMG_MAKETYPE(IMG_64F, 4)
 
+#define IMG_16FC1 IMG_MAKETYPE(IMG_16F, 1)
+#define IMG_16FC3 IMG_MAKETYPE(IMG_16F, 3)
+#define IMG_16FC4 IMG_MAKETYPE(IMG_16F, 4)
+
+#define IMG_8SC1 IMG_MAKETYPE(IMG_8S, 1)
+#define IMG_8SC3 IMG_MAKETYPE(IMG_8S, 3)
+#define IMG_8SC4 IMG_MAKETYPE(IMG_8S, 4)
+
+#define IMG_16SC1 IMG_MAKETYPE(IMG_16S, 1)
+#define IMG_16SC3 IMG_MAKETYPE(IMG_16S, 3)
+#define IMG_16SC4 IMG_MAKETYPE(IMG_16S, 4)
+
+    /**
+     * @brief IEEE 754 半精度浮点数 (1 位符号, 5 位指数, 10 位尾数) 与 float 之间的转换, 舍入方式为就近取偶。
+     * 编译器启用 F16C 指令集时 (例如 IMGLIB_NATIVE) 使用 vcvtph2ps / vcvtps2ph, 否则用整数位运算实现。
+     */
+    inline float half_to_float(std::uint16_t h)
+    {
+#if defined(__F16C__)
+        return _cvtsh_ss(h);
+#else
+        const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000u) << 16;
+        std::uint32_t exp = (h >> 10) & 0x1fu;
+        std::uint32_t mant = h & 0x3ffu;
+        std::uint32_t bits;
+        if (exp == 0x1f)
+        {
+            bits = sign | 0x7f800000u | (mant << 13); // inf / NaN
+        }
+        else if (exp != 0)
+        {
+            bits = sign | ((exp + 112) << 23) | (mant << 13); // 指数偏移量 15 -> 127
+        }
+        else if (mant == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // 非规格化数: 移位直到出现隐含的最高位, 变成 float 的规格化数
+            exp = 113;
+            while (!(mant & 0x400u))
+            {
+                mant <<= 1;
+                --exp;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ffu) << 13);
+        }
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+#endif
+    }
+
+    inline std::uint16_t float_to_half(float f)
+    {
+#if defined(__F16C__)
+        return static_cast<std::uint16_t>(_cvtss_sh(f, 0));
+#else
+        std::uint32_t x;
+        std::memcpy(&x, &f, sizeof(x));
+        const std::uint32_t sign = (x >> 16) & 0x8000u;
+        x &= 0x7fffffffu;
+        if (x >= 0x7f800000u)
+        {
+            return static_cast<std::uint16_t>(sign | 0x7c00u | (x > 0x7f800000u ? 0x200u : 0u)); // inf / NaN
+        }
+        if (x >= 0x477ff000u)
+        {
+            return static_cast<std::uint16_t>(sign | 0x7c00u); // >= 65520 时舍入为 inf
+        }
+        if (x < 0x38800000u)
+        {
+            // 小于 2^-14: 结果是非规格化数或 0, 尾数 (含隐含位) 右移后按就近取偶舍入
+            if (x < 0x33000000u)
+                return static_cast<std::uint16_t>(sign);
+            const std::uint32_t shift = 126 - (x >> 23);
+            const std::uint32_t mant = (x & 0x7fffffu) | 0x800000u;
+            std::uint32_t r = mant >> shift;
+            const std::uint32_t rem = mant & ((1u << shift) - 1);
+            const std::uint32_t half = 1u << (shift - 1);
+            if (rem > half || (rem == half && (r & 1u)))
+                ++r;
+            return static_cast<std::uint16_t>(sign | r);
+        }
+        // 规格化数: 指数偏移量 127 -> 15, 低 13 位就近取偶舍入 (进位可以直接进到指数中)
+        x -= 0x38000000u;
+        x += 0xfffu + ((x >> 13) & 1u);
+        return static_cast<std::uint16_t>(sign | (x >> 13));
+#endif
+    }
+
+    /**
+     * @brief IMG_16F 的通道类型, 只负责存储, 运算时隐式转换为 float。
+     * 库的内核都以 float/double 进行计算, 读写时才在寄存器中转换。
+     */
+    struct float16
+    {
+        std::uint16_t bits;
+
+        float16() = default;
+        float16(float v) : bits(float_to_half(v)) {}
+        operator float() const { return half_to_float(bits); }
+
+        /** @brief 直接由位模式构造。 */
+        static constexpr float16 from_bits(std::uint16_t b)
+        {
+            float16 h{};
+            h.bits = b;
+            return h;
+        }
+    };
+
+    /**
+     * @brief 最多 4 个通道的标量值, 第 k 个元素作用于图像的第 k 个通道。
+     * 只传一个值时所有通道取相同的值, 例如 Scalar(0) 表示全部清零。
+     */
+    struct Scalar
+    {
+        double val[4];
+
+        Scalar(double v = 0.0) : val{v, v, v, v} {}
+        Scalar(double v0, double v1, double v2, double v3 = 0.0) : val{v0, v1, v2, v3} {}
+
+        double &operator[](int i) { return val[i]; }
+        const double &operator[](int i) const { return val[i]; }
+    };
+
     //////////////////////////////////////////数据存储类//////////////////////////////////////////
     /**
      * @brief 表示图像的核心类
@@ -76,7 +215,11 @@ namespace img
         ////////////辅助函数/////////
         void create(size_t rows, size_t cols, int type); // 用于重置内存空间
         void release();                                  // 把图像置空,在必要时释放内存
-        Image clone() const;                             // 深拷贝
+        Image clone() const;                             // 深拷贝 (结果总是连续存储的)
+        void copy_to(Image &dst) const;                  // 把像素数据复制到 dst 中
+        void copy_to(Image &dst, const Image &mask) const; // 只复制 mask 非零的像素 (mask 为 IMG_8UC1)
+        Image &set_to(const Scalar &value);                     // 把所有像素设为 value
+        Image &set_to(const Scalar &value, const Image &mask); // 只设置 mask 非零的像素 (mask 为 IMG_8UC1)
 
         void show_info(std::ostream &os = std::cout) const; // 默认输出到 std::cout
         friend std::ostream &operator<<(std::ostream &os, const Image &img);
@@ -90,8 +233,10 @@ namespace img
         size_t get_cols() const { return m_cols; }
         /** @brief 返回图像类型 (深度和通道的组合)。 */
         int get_type() const { return m_type; }
-        /** @brief 返回图像每一行数据所占用的总字节数。*/
-        size_t get_step() const { return m_step; }
+        /** @brief 返回相邻两行起始位置之间的字节数。行翻转视图的 step 为负数。*/
+        std::ptrdiff_t get_step() const { return m_step; }
+        /** @brief 返回同一行中相邻两个像素之间的字节数。通常等于 get_pixel_size(), 列下采样和单通道视图中会更大。*/
+        size_t get_pixel_step() const { return m_pixel_step; }
         /** @brief 返回单个通道元素占用的字节数 (例如 IMG_8U 为 1, IMG_32F 为 4)。 */
         size_t get_channel_size() const { return m_channel_size; };
         /** @brief 返回图像的通道数 (例如，灰度图为1，BGR图为3)。 */
@@ -102,6 +247,13 @@ namespace img
 
         /** @brief 返回单个像素占用的字节数 (等于 get_channels() * get_channel_size())。 */
         size_t get_pixel_size() const { return m_channel_size * get_channels(); };
+        /** @brief 同一行中的像素是否紧密排列 (相邻像素之间没有间隔)。 */
+        bool is_pixel_contiguous() const { return m_pixel_step == get_pixel_size(); }
+        /** @brief 图像的全部像素在内存中是否紧密排列、各行首尾相接 (ROI 视图通常不是)。 */
+        bool is_continuous() const
+        {
+            return is_pixel_contiguous() && m_step == static_cast<std::ptrdiff_t>(m_cols * get_pixel_size());
+        }
         /** @brief 返回图像的总像素数 (rows * cols)。 */
         size_t get_total() const { return m_rows * m_cols; }
         /** @brief 返回当前数据的引用计数（主要用于调试）。 */
@@ -141,7 +293,7 @@ namespace img
                 throw std::out_of_range("Image::at - 访问索引超出图像边界。");
             }
 
-            return reinterpret_cast<T *>(m_data_start + row * m_step + col * get_pixel_size());
+            return reinterpret_cast<T *>(m_data_start + static_cast<std::ptrdiff_t>(row) * m_step + col * m_pixel_step);
         };
         template <typename T>
         const T *at(size_t row, size_t col) const
@@ -155,7 +307,7 @@ namespace img
                 throw std::out_of_range("Image::at (const) - 访问索引超出图像边界。");
             }
 
-            return reinterpret_cast<const T *>(m_data_start + row * m_step + col * get_pixel_size());
+            return reinterpret_cast<const T *>(m_data_start + static_cast<std::ptrdiff_t>(row) * m_step + col * m_pixel_step);
         };
         
         ///////////运算符重载///////////
@@ -171,32 +323,493 @@ namespace img
         Image operator/(double scalar) const;
         // 这里要求operation_name是为了打印报错信息
         static void check_compatibility(const Image &img1, const Image &img2, const std::string &operation_name);
+        // 检查 mask 是否为与 img 同尺寸的 IMG_8UC1 图像
+        static void check_mask(const Image &img, const Image &mask, const std::string &operation_name);
         Image &operator+=(const Image &other);
         Image &operator-=(const Image &other);
 
         Image operator+(const Image &other) const;
         Image operator-(const Image &other) const;
+
+        // 带掩码的运算: 只修改 mask (IMG_8UC1, 与图像同尺寸) 非零位置的像素, 其余像素保持不变
+        Image &add(double scalar, const Image &mask);
+        Image &subtract(double scalar, const Image &mask);
+        Image &multiply(double scalar, const Image &mask);
+        Image &divide(double scalar, const Image &mask);
+        Image &add(const Image &other, const Image &mask);
+        Image &subtract(const Image &other, const Image &mask);
         ////////////选择兴趣区域/////////
         Image roi(size_t start_x, size_t start_y, size_t width, size_t height) const;
 
+        ////////////零拷贝视图/////////
+        // 以下函数都返回与原图像共享数据的视图, 不复制像素
+        Image subsample(size_t row_factor, size_t col_factor) const; // 每隔 row_factor 行、col_factor 列取一个像素
+        Image flip_rows() const;                                      // 上下翻转 (行步长为负)
+        Image channel(int index) const;                               // 只包含第 index 个通道的单通道视图
+
         ////////////转换图像类型/////////
         // 注意只支持相同通道数的转换
         // 例如 IMG_8UC3 转换为 IMG_32FC3 是可以的,但是 IMG_8UC1 转换为 IMG_32FC3 是不可以的
         Image convert_to(int new_type) const;
 
     private:
-        void allocate(size_t rows, size_t cols, int type);
+        void allocate(size_t rows, size_t cols, int type, bool zero_init = true);
         size_t m_rows;         // 像素行数
         size_t m_cols;         // 像素列数
         int m_type;            // 图像类型 (深度和通道的组合)
         size_t m_channel_size; // 单个通道元素占用的字节数 (例如 IMG_8U 为 1, IMG_32F 为 4)
-        size_t m_step;         // 每一行数据所占用的总字节数
+        std::ptrdiff_t m_step; // 相邻两行起始位置之间的字节数 (行翻转视图中为负数)
+        size_t m_pixel_step;   // 同一行中相邻两个像素之间的字节数
 
         unsigned char *m_data_start;  // 指向图像在堆上有效像素数据的起始位置
         unsigned char *m_datastorage; // 指向实际在堆上分配的内存块的起始位置 (包含引用计数)
         int *m_refcount;              // 指向存储引用计数的位置
     };
 
+    //////////////////////////////////////////类型化视图//////////////////////////////////////////
+    // 通道类型 -> 深度代码 的编译期映射, 只有库支持的通道类型才有定义
+    template <typename T>
+    struct DepthOf;
+    template <>
+    struct DepthOf<unsigned char> { static constexpr int value = IMG_8U; };
+    template <>
+    struct DepthOf<unsigned short> { static constexpr int value = IMG_16U; };
+    template <>
+    struct DepthOf<int> { static constexpr int value = IMG_32S; };
+    template <>
+    struct DepthOf<float> { static constexpr int value = IMG_32F; };
+    template <>
+    struct DepthOf<double> { static constexpr int value = IMG_64F; };
+    template <>
+    struct DepthOf<float16> { static constexpr int value = IMG_16F; };
+    template <>
+    struct DepthOf<signed char> { static constexpr int value = IMG_8S; };
+    template <>
+    struct DepthOf<short> { static constexpr int value = IMG_16S; };
+
+    // 深度代码 -> 通道类型 的编译期映射, 是 DepthOf 的逆映射
+    template <int DEPTH>
+    struct DepthType;
+    template <>
+    struct DepthType<IMG_8U> { using type = unsigned char; };
+    template <>
+    struct DepthType<IMG_16U> { using type = unsigned short; };
+    template <>
+    struct DepthType<IMG_32S> { using type = int; };
+    template <>
+    struct DepthType<IMG_32F> { using type = float; };
+    template <>
+    struct DepthType<IMG_64F> { using type = double; };
+    template <>
+    struct DepthType<IMG_16F> { using type = float16; };
+    template <>
+    struct DepthType<IMG_8S> { using type = signed char; };
+    template <>
+    struct DepthType<IMG_16S> { using type = short; };
+
+    /** @brief 将图像深度转换为可读的字符串表示 (实现在 image.cpp 中)。 */
+    std::string depth_to_string(int depth);
+
+    /**
+     * @brief 传给分发函数中仿函数的类型标签, 携带编译期的通道类型和通道数。
+     * C++17 的泛型 lambda 不能显式写模板参数, 所以通过标签的类型来取出 T 和 CN:
+     *   [&](auto tag) { using T = typename decltype(tag)::type; constexpr int CN = decltype(tag)::channels; }
+     */
+    template <typename T, int CN>
+    struct TypeTag
+    {
+        using type = T;
+        static constexpr int channels = CN;
+        static constexpr int depth = DepthOf<T>::value;
+    };
+
+    /**
+     * @brief 按通道数分发, 以 TypeTag<T, CN> 调用仿函数 f。
+     * @throw std::invalid_argument 如果通道数不是 1/3/4。
+     */
+    template <typename T, typename F>
+    decltype(auto) dispatch_channels(int cn, F &&f)
+    {
+        switch (cn)
+        {
+        case 1:
+            return f(TypeTag<T, 1>{});
+        case 3:
+            return f(TypeTag<T, 3>{});
+        case 4:
+            return f(TypeTag<T, 4>{});
+        default:
+            throw std::invalid_argument("dispatch - 不支持的图像通道数: " + std::to_string(cn));
+        }
+    }
+
+    /**
+     * @brief 只按深度分发, 以 TypeTag<T, 1> 调用仿函数 f。
+     * 用于只关心通道类型的场合 (例如 convert_to 的目标类型), 避免不必要的实例化。
+     * @throw std::invalid_argument 如果深度不受支持。
+     */
+    template <typename F>
+    decltype(auto) dispatch_depth(int depth, F &&f)
+    {
+        switch (depth)
+        {
+        case IMG_8U:
+            return f(TypeTag<unsigned char, 1>{});
+        case IMG_16U:
+            return f(TypeTag<unsigned short, 1>{});
+        case IMG_32S:
+            return f(TypeTag<int, 1>{});
+        case IMG_32F:
+            return f(TypeTag<float, 1>{});
+        case IMG_64F:
+            return f(TypeTag<double, 1>{});
+        case IMG_16F:
+            return f(TypeTag<float16, 1>{});
+        case IMG_8S:
+            return f(TypeTag<signed char, 1>{});
+        case IMG_16S:
+            return f(TypeTag<short, 1>{});
+        default:
+            throw std::invalid_argument("dispatch - 不支持的图像深度类型: " + depth_to_string(depth));
+        }
+    }
+
+    /**
+     * @brief 把运行期的图像类型 (m_type) 映射为编译期的 <T, CN>, 以 TypeTag<T, CN> 调用仿函数 f。
+     * 库内所有按类型区分的内核都通过它来分发, 用户自己的内核也可以使用:
+     *   img::dispatch_type(image.get_type(), [&](auto tag) {
+     *       using T = typename decltype(tag)::type;
+     *       constexpr int CN = decltype(tag)::channels;
+     *       img::Image_<T, CN> view(image);
+     *       ...
+     *   });
+     * 所有分支的返回类型必须一致。
+     * @throw std::invalid_argument 如果类型中的深度或通道数不受支持。
+     */
+    template <typename F>
+    decltype(auto) dispatch_type(int type, F &&f)
+    {
+        const int cn = IMG_CN(type);
+        switch (IMG_DEPTH(type))
+        {
+        case IMG_8U:
+            return dispatch_channels<unsigned char>(cn, std::forward<F>(f));
+        case IMG_16U:
+            return dispatch_channels<unsigned short>(cn, std::forward<F>(f));
+        case IMG_32S:
+            return dispatch_channels<int>(cn, std::forward<F>(f));
+        case IMG_32F:
+            return dispatch_channels<float>(cn, std::forward<F>(f));
+        case IMG_64F:
+            return dispatch_channels<double>(cn, std::forward<F>(f));
+        case IMG_16F:
+            return dispatch_channels<float16>(cn, std::forward<F>(f));
+        case IMG_8S:
+            return dispatch_channels<signed char>(cn, std::forward<F>(f));
+        case IMG_16S:
+            return dispatch_channels<short>(cn, std::forward<F>(f));
+        default:
+            throw std::invalid_argument("dispatch - 不支持的图像深度类型: " + depth_to_string(IMG_DEPTH(type)));
+        }
+    }
+
+    /**
+     * @brief 一段连续内存的轻量视图 (C++17 没有 std::span, 这里只实现需要的部分)。
+     * 不拥有数据, 也不做任何检查。
+     */
+    template <typename T>
+    struct Span
+    {
+        T *ptr;
+        size_t count;
+
+        T *data() const { return ptr; }
+        size_t size() const { return count; }
+        T *begin() const { return ptr; }
+        T *end() const { return ptr + count; }
+        T &operator[](size_t i) const { return ptr[i]; }
+    };
+
+    /**
+     * @brief 单个像素的值类型, 内存布局与图像中交错存储的一个像素完全相同 (CN 个连续的 T)。
+     * 因此可以把一行像素数据直接当作 Vec<T, CN> 数组来访问。
+     */
+    template <typename T, int CN>
+    struct Vec
+    {
+        T val[CN];
+
+        T &operator[](int i) { return val[i]; }
+        const T &operator[](int i) const { return val[i]; }
+    };
+
+    /**
+     * @brief 视图元素类型 T 对应的像素类型和数据指针类型。T 为 const U 时 (只读视图) 分别是 const Vec<U, CN>
+     * 和 const unsigned char *, 因此通过只读视图及其迭代器都无法写像素。
+     */
+    template <typename T, int CN>
+    using PixelOf = std::conditional_t<std::is_const<T>::value, const Vec<std::remove_const_t<T>, CN>, Vec<T, CN>>;
+    template <typename T>
+    using DataPtrOf = std::conditional_t<std::is_const<T>::value, const unsigned char *, unsigned char *>;
+
+    /**
+     * @brief 按行遍历图像的迭代器, 解引用得到该行像素的 Span<PixelOf<T, CN>>。
+     * 步进时使用图像的 step, 所以对 ROI 视图同样适用。
+     * 解引用返回的是值 (代理对象) 而不是引用, 按 C++17 的要求只是输入迭代器: 可以用于 for 循环和
+     * 不带执行策略的 std::for_each 等单遍算法; 支持 +=、[] 等运算只是为了方便跳行。
+     * 需要前向/随机访问迭代器的算法 (包括带 std::execution 执行策略的算法) 请使用 Image_::row_spans()。
+     */
+    template <typename T, int CN>
+    class RowIterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Span<PixelOf<T, CN>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Span<PixelOf<T, CN>>;
+
+        RowIterator() = default;
+        RowIterator(DataPtrOf<T> data, std::ptrdiff_t step, size_t cols, difference_type row)
+            : m_data(data), m_step(step), m_cols(cols), m_row(row) {}
+
+        reference operator*() const { return (*this)[0]; }
+        reference operator[](difference_type n) const
+        {
+            return reference{reinterpret_cast<PixelOf<T, CN> *>(m_data + (m_row + n) * m_step), m_cols};
+        }
+
+        RowIterator &operator++() { ++m_row; return *this; }
+        RowIterator operator++(int) { RowIterator tmp = *this; ++m_row; return tmp; }
+        RowIterator &operator--() { --m_row; return *this; }
+        RowIterator operator--(int) { RowIterator tmp = *this; --m_row; return tmp; }
+        RowIterator &operator+=(difference_type n) { m_row += n; return *this; }
+        RowIterator &operator-=(difference_type n) { m_row -= n; return *this; }
+        friend RowIterator operator+(RowIterator it, difference_type n) { return it += n; }
+        friend RowIterator operator+(difference_type n, RowIterator it) { return it += n; }
+        friend RowIterator operator-(RowIterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const RowIterator &a, const RowIterator &b) { return a.m_row - b.m_row; }
+
+        friend bool operator==(const RowIterator &a, const RowIterator &b) { return a.m_row == b.m_row; }
+        friend bool operator!=(const RowIterator &a, const RowIterator &b) { return a.m_row != b.m_row; }
+        friend bool operator<(const RowIterator &a, const RowIterator &b) { return a.m_row < b.m_row; }
+        friend bool operator>(const RowIterator &a, const RowIterator &b) { return a.m_row > b.m_row; }
+        friend bool operator<=(const RowIterator &a, const RowIterator &b) { return a.m_row <= b.m_row; }
+        friend bool operator>=(const RowIterator &a, const RowIterator &b) { return a.m_row >= b.m_row; }
+
+    private:
+        DataPtrOf<T> m_data = nullptr;
+        std::ptrdiff_t m_step = 0;
+        size_t m_cols = 0;
+        difference_type m_row = 0;
+    };
+
+    /**
+     * @brief 图像各行的 Span<PixelOf<T, CN>> 数组, 由 Image_::row_spans() 生成。
+     * 每行的 Span 在构造时算好并保存在数组中, begin()/end() 就是数组的指针, 解引用得到真正的引用,
+     * 因此是随机访问迭代器, 可以用于带 std::execution 执行策略的算法。
+     * 持有图像的一份软拷贝, 存在期间数据不会被释放; 对象本身只读, 修改的是各行的像素。
+     */
+    template <typename T, int CN>
+    class RowSpans
+    {
+    public:
+        using value_type = Span<PixelOf<T, CN>>;
+        using iterator = const value_type *;
+
+        RowSpans(const Image &img, DataPtrOf<T> data, std::ptrdiff_t step, size_t rows, size_t cols)
+            : m_image(img)
+        {
+            m_rows.reserve(rows);
+            for (size_t r = 0; r < rows; ++r)
+                m_rows.push_back(value_type{reinterpret_cast<PixelOf<T, CN> *>(data + static_cast<std::ptrdiff_t>(r) * step), cols});
+        }
+
+        size_t size() const { return m_rows.size(); }
+        iterator begin() const { return m_rows.data(); }
+        iterator end() const { return m_rows.data() + m_rows.size(); }
+        const value_type &operator[](size_t r) const { return m_rows[r]; }
+
+    private:
+        Image m_image;
+        std::vector<value_type> m_rows;
+    };
+
+    /**
+     * @brief 按行优先顺序遍历图像所有像素的随机访问迭代器, 解引用得到 PixelOf<T, CN>& (只读视图为 const Vec&)。
+     * 每一行内部像素是连续的, 行与行之间按 step 跳转 (跳过 ROI 之外的数据)。
+     * 对连续存储的整幅图像, 直接使用 Vec<T, CN>* 指针会更快。
+     */
+    template <typename T, int CN>
+    class PixelIterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::remove_const_t<PixelOf<T, CN>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = PixelOf<T, CN> *;
+        using reference = PixelOf<T, CN> &;
+
+        PixelIterator() = default;
+        PixelIterator(DataPtrOf<T> data, std::ptrdiff_t step, size_t cols, difference_type index)
+            : m_data(data), m_step(step), m_cols(static_cast<difference_type>(cols)),
+              m_row(cols ? index / static_cast<difference_type>(cols) : 0),
+              m_col(cols ? index % static_cast<difference_type>(cols) : 0) {}
+
+        reference operator*() const
+        {
+            return reinterpret_cast<pointer>(m_data + m_row * m_step)[m_col];
+        }
+        pointer operator->() const { return &**this; }
+        reference operator[](difference_type n) const { return *(*this + n); }
+
+        PixelIterator &operator++()
+        {
+            if (++m_col == m_cols)
+            {
+                m_col = 0;
+                ++m_row;
+            }
+            return *this;
+        }
+        PixelIterator operator++(int) { PixelIterator tmp = *this; ++*this; return tmp; }
+        PixelIterator &operator--()
+        {
+            if (m_col-- == 0)
+            {
+                m_col = m_cols - 1;
+                --m_row;
+            }
+            return *this;
+        }
+        PixelIterator operator--(int) { PixelIterator tmp = *this; --*this; return tmp; }
+        PixelIterator &operator+=(difference_type n)
+        {
+            const difference_type index = index_of() + n;
+            m_row = index / m_cols;
+            m_col = index % m_cols;
+            return *this;
+        }
+        PixelIterator &operator-=(difference_type n) { return *this += -n; }
+        friend PixelIterator operator+(PixelIterator it, difference_type n) { return it += n; }
+        friend PixelIterator operator+(difference_type n, PixelIterator it) { return it += n; }
+        friend PixelIterator operator-(PixelIterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const PixelIterator &a, const PixelIterator &b) { return a.index_of() - b.index_of(); }
+
+        friend bool operator==(const PixelIterator &a, const PixelIterator &b) { return a.index_of() == b.index_of(); }
+        friend bool operator!=(const PixelIterator &a, const PixelIterator &b) { return a.index_of() != b.index_of(); }
+        friend bool operator<(const PixelIterator &a, const PixelIterator &b) { return a.index_of() < b.index_of(); }
+        friend bool operator>(const PixelIterator &a, const PixelIterator &b) { return a.index_of() > b.index_of(); }
+        friend bool operator<=(const PixelIterator &a, const PixelIterator &b) { return a.index_of() <= b.index_of(); }
+        friend bool operator>=(const PixelIterator &a, const PixelIterator &b) { return a.index_of() >= b.index_of(); }
+
+    private:
+        difference_type index_of() const { return m_row * m_cols + m_col; }
+
+        DataPtrOf<T> m_data = nullptr;
+        std::ptrdiff_t m_step = 0;
+        difference_type m_cols = 0;
+        difference_type m_row = 0;
+        difference_type m_col = 0;
+    };
+
+    /**
+     * @brief 编译期确定通道类型和通道数的图像视图。
+     * 构造时一次性检查图像非空、类型匹配以及行内像素紧密排列, 之后的所有访问都不做检查,
+     * 像素大小是编译期常量, 便于编译器对用户自己写的逐像素循环做向量化。
+     * 视图与原图像共享数据 (软拷贝, 引用计数加一), 对视图的修改会反映在原图像上。
+     * T 为 const 类型时是只读视图: 从 const Image & 构造, ptr() / pixels() / 迭代器都只给出 const 的访问;
+     * 可写视图只能从非 const 的 Image 构造, 可写视图可以隐式转换为只读视图。
+     * 用法:
+     *   img::Image_<unsigned char, 3> view(img);
+     *   for (size_t r = 0; r < view.rows(); ++r) { auto row = view.row(r); ... }
+     *   img::Image_<const float, 1> src_view(src); // src 为 const Image &
+     */
+    template <typename T, int CN>
+    class Image_
+    {
+        static_assert(CN == 1 || CN == 3 || CN == 4, "Image_ 只支持 1/3/4 通道");
+
+    public:
+        using value_type = std::remove_const_t<T>;
+        using image_reference = std::conditional_t<std::is_const<T>::value, const Image &, Image &>;
+        static constexpr int channels = CN;
+        static constexpr int depth = DepthOf<value_type>::value;
+        static constexpr int type = IMG_MAKETYPE(depth, CN);
+        static constexpr size_t pixel_size = sizeof(T) * CN;
+
+        /**
+         * @brief 从 Image 创建类型化视图。
+         * @throw std::logic_error 如果图像为空。
+         * @throw std::invalid_argument 如果图像类型与 <T, CN> 不匹配, 或者行内像素不是紧密排列的
+         *        (列下采样/单通道视图, 需要先 clone())。
+         */
+        explicit Image_(image_reference img)
+        {
+            const std::string F_NAME = "Image_";
+            if (img.empty())
+            {
+                throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法为空图像创建类型化视图。");
+            }
+            if (img.get_type() != type)
+            {
+                throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "图像类型不匹配。图像 type: " +
+                                            std::to_string(img.get_type()) + ", 视图 type: " + std::to_string(type));
+            }
+            if (!img.is_pixel_contiguous())
+            {
+                throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "行内像素不是紧密排列的, 请先 clone()。");
+            }
+            m_image = img;
+            m_data = img.data();
+            m_step = img.get_step();
+            m_rows = img.get_rows();
+            m_cols = img.get_cols();
+        }
+
+        /** @brief 可写视图到只读视图的转换。 */
+        template <typename U, typename = std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value>>
+        Image_(const Image_<U, CN> &other)
+            : m_image(other.image()), m_data(reinterpret_cast<DataPtrOf<T>>(other.ptr(0))), m_step(other.step()),
+              m_rows(other.rows()), m_cols(other.cols()) {}
+
+        size_t rows() const { return m_rows; }
+        size_t cols() const { return m_cols; }
+        std::ptrdiff_t step() const { return m_step; }
+        /** @brief 返回视图所引用的 Image (共享数据)。 */
+        const Image &image() const { return m_image; }
+
+        /** @brief 不检查边界, 返回第 r 行第一个通道元素的指针。 */
+        T *ptr(size_t r) const { return reinterpret_cast<T *>(m_data + static_cast<std::ptrdiff_t>(r) * m_step); }
+        /** @brief 不检查边界, 返回 (r, c) 像素第一个通道的指针, 与 Image::at<T> 的返回值含义相同。 */
+        T *operator()(size_t r, size_t c) const { return ptr(r) + c * CN; }
+        /** @brief 第 r 行的有效数据 (cols * CN 个元素, 不包含 ROI 之外的部分)。 */
+        Span<T> row(size_t r) const { return Span<T>{ptr(r), m_cols * CN}; }
+        /** @brief 第 r 行的像素 (cols 个 Vec<T, CN>)。 */
+        Span<PixelOf<T, CN>> pixels(size_t r) const { return Span<PixelOf<T, CN>>{reinterpret_cast<PixelOf<T, CN> *>(ptr(r)), m_cols}; }
+
+        /////////迭代器/////////
+        // 例如: for (auto it = view.row_begin(); it != view.row_end(); ++it) { for (auto &p : *it) { ... } }
+        //       std::transform(view.begin(), view.end(), view.begin(), [](img::Vec<T, CN> p) { ... });
+        //       const auto rows = view.row_spans();
+        //       std::for_each(std::execution::par_unseq, rows.begin(), rows.end(), [](const auto &row) { for (auto &p : row) { ... } });
+        using row_iterator = RowIterator<T, CN>;
+        using iterator = PixelIterator<T, CN>;
+        row_iterator row_begin() const { return row_iterator(m_data, m_step, m_cols, 0); }
+        row_iterator row_end() const { return row_iterator(m_data, m_step, m_cols, static_cast<std::ptrdiff_t>(m_rows)); }
+        iterator begin() const { return iterator(m_data, m_step, m_cols, 0); }
+        iterator end() const { return iterator(m_data, m_step, m_cols, static_cast<std::ptrdiff_t>(m_rows * m_cols)); }
+        /** @brief 各行像素的 Span 数组, 用于需要随机访问迭代器的算法 (如带执行策略的 std::for_each)。 */
+        RowSpans<T, CN> row_spans() const { return RowSpans<T, CN>(m_image, m_data, m_step, m_rows, m_cols); }
+
+    private:
+        Image m_image;               // 持有一份软拷贝, 保证视图存在期间数据不会被释放
+        DataPtrOf<T> m_data = nullptr;
+        std::ptrdiff_t m_step = 0;
+        size_t m_rows = 0;
+        size_t m_cols = 0;
+    };
+
     //////////////////////////////////////////IO处理器//////////////////////////////////////////
     //抽象类,所有图像类型的处理继承于此,抽象类的实现放在image_io.cpp中
     class ImageIOHandler
@@ -280,4 +893,290 @@ namespace img
     void adjust_brightness(Image &img, double value);
     void blend_images(const Image &img1, const Image &img2, Image &output, double alpha);
 
-}
\ No newline at end of file
+    //////////////几何变换 (实现在 geometry.cpp 中)//////////////
+    // 翻转方式, 取值与 OpenCV 的 flipCode 相同
+    enum FlipCode
+    {
+        FLIP_BOTH = -1,      // 上下左右都翻转 (等价于旋转 180 度)
+        FLIP_VERTICAL = 0,   // 上下翻转
+        FLIP_HORIZONTAL = 1  // 左右翻转
+    };
+    // 旋转角度 (顺时针)
+    enum RotateCode
+    {
+        ROTATE_90 = 0,
+        ROTATE_180 = 1,
+        ROTATE_270 = 2
+    };
+
+    // 以下函数的 dst 可以与 src 是同一个对象, 结果总是写入新分配的内存
+    void transpose(const Image &src, Image &dst);
+    void flip(const Image &src, Image &dst, FlipCode flip_code);
+    void rotate(const Image &src, Image &dst, RotateCode rotate_code);
+
+    //////////////颜色空间转换 (实现在 color.cpp 中)//////////////
+    enum ColorConversionCode
+    {
+        COLOR_BGR2GRAY = 0,
+        COLOR_BGRA2GRAY,
+        COLOR_GRAY2BGR,
+        COLOR_GRAY2BGRA,
+        COLOR_BGR2BGRA,
+        COLOR_BGRA2BGR
+    };
+
+    // dst_depth 为负数时输出深度与输入相同, 否则在同一遍中转换为该深度 (例如 IMG_32F)
+    void cvt_color(const Image &src, Image &dst, ColorConversionCode code, int dst_depth = -1);
+
+    //////////////YUV 视频帧 (实现在 color.cpp 中)//////////////
+    enum YUVFormat
+    {
+        YUV_NV12 = 0, // 4:2:0 半平面: Y 平面 + 交错的 UV 平面
+        YUV_I420,     // 4:2:0 平面: Y 平面 + U 平面 + V 平面
+        YUV_YUYV      // 4:2:2 打包: 每两个像素存为 Y0 U Y1 V
+    };
+    // 颜色矩阵, 都按视频范围 (Y: 16-235, UV: 16-240) 处理, 这是解码器输出的常见格式
+    enum YUVMatrix
+    {
+        YUV_BT601 = 0, // 标清
+        YUV_BT709      // 高清
+    };
+
+    /**
+     * @brief 指向外部 YUV 帧数据 (例如解码器的输出缓冲区) 的只读视图, 不拥有也不复制数据。
+     * 各平面可以有各自的行步长; 对于紧密排列的帧, 可以使用 nv12()/i420()/yuyv() 直接从一块连续内存创建。
+     * NV12 中 u 指向交错的 UV 平面, v 不使用; YUYV 中只使用 y (指向打包数据)。
+     */
+    struct YUVView
+    {
+        YUVFormat format = YUV_NV12;
+        size_t width = 0;
+        size_t height = 0;
+        const unsigned char *y = nullptr;
+        std::ptrdiff_t y_step = 0;
+        const unsigned char *u = nullptr;
+        std::ptrdiff_t u_step = 0;
+        const unsigned char *v = nullptr;
+        std::ptrdiff_t v_step = 0;
+
+        static YUVView nv12(const unsigned char *data, size_t width, size_t height);
+        static YUVView i420(const unsigned char *data, size_t width, size_t height);
+        static YUVView yuyv(const unsigned char *data, size_t width, size_t height);
+        /** @brief 紧密排列时该格式一帧的总字节数。 */
+        static size_t frame_size(YUVFormat format, size_t width, size_t height);
+    };
+
+    // YUV -> IMG_8UC3 (BGR) / IMG_8UC4 (BGRA) / IMG_8UC1 (直接取 Y 平面)
+    void yuv_to_bgr(const YUVView &src, Image &dst, int dst_type = IMG_8UC3, YUVMatrix matrix = YUV_BT601);
+    // IMG_8UC3 / IMG_8UC4 -> 紧密排列的 YUV 帧, 布局与 YUVView::nv12()/i420()/yuyv() 相同
+    void bgr_to_yuv(const Image &src, std::vector<unsigned char> &dst, YUVFormat format, YUVMatrix matrix = YUV_BT601);
+
+    //////////////通道拆分与合并 (实现在 channels.cpp 中)//////////////
+    // 交错存储 (BGRBGR...) <-> 每个通道一个单通道图像 (平面存储), 便于逐通道处理
+    void split(const Image &src, std::vector<Image> &dst);
+    void merge(const std::vector<Image> &src, Image &dst);
+
+    //////////////统计 (实现在 stats.cpp 中)//////////////
+    // mask 为空图像时统计所有像素, 否则只统计 mask (与 src 同尺寸的 IMG_8UC1) 非零位置的像素
+    // 结果按块累加后按固定顺序合并, 与线程数无关
+
+    // 像素位置, x 为列号, y 为行号; 不存在 (例如 mask 全为零) 时为 -1
+    struct Point
+    {
+        int x = -1;
+        int y = -1;
+    };
+
+    enum NormType
+    {
+        NORM_INF = 1, // 最大绝对值
+        NORM_L1 = 2,  // 绝对值之和
+        NORM_L2 = 4   // 平方和的平方根
+    };
+
+    // 每个通道的最小值/最大值及其第一次出现的位置 (按行优先顺序)
+    struct MinMaxLoc
+    {
+        Scalar min_val;
+        Scalar max_val;
+        Point min_loc[4];
+        Point max_loc[4];
+    };
+
+    Scalar sum(const Image &src, const Image &mask = Image());   // 每个通道的和
+    Scalar mean(const Image &src, const Image &mask = Image());  // 每个通道的均值
+    void mean_std_dev(const Image &src, Scalar &mean, Scalar &stddev, const Image &mask = Image());
+    MinMaxLoc min_max_loc(const Image &src, const Image &mask = Image());
+    double norm(const Image &src, NormType norm_type = NORM_L2, const Image &mask = Image()); // 所有通道合在一起计算
+    size_t count_non_zero(const Image &src, const Image &mask = Image());                     // 只支持单通道图像
+
+    //////////////直方图 (实现在 histogram.cpp 中)//////////////
+    // 每个通道一个直方图: hist[k][b] 为第 k 个通道落入第 b 个区间的元素个数
+    // [range_min, range_max) 被均分为 bins 个区间, 范围之外的值和 mask 为零的像素不计入; 只支持 IMG_8U / IMG_16U
+    void calc_hist(const Image &src, std::vector<std::vector<size_t>> &hist, int bins = 256,
+                   double range_min = 0.0, double range_max = 256.0, const Image &mask = Image());
+
+    // 查找表变换: dst = table[src], 对 IMG_8U 图像的所有通道使用同一个 256 项的表
+    void lut(const Image &src, const std::vector<unsigned char> &table, Image &dst);
+
+    // 多通道 (BGR/BGRA) 图像的均衡化方式, 单通道图像忽略此参数
+    enum EqualizeMode
+    {
+        EQUALIZE_LUMA = 0,    // 只均衡化亮度 (BT.601), B/G/R 同时加上亮度的变化量, 色调不变; alpha 不变
+        EQUALIZE_PER_CHANNEL  // 每个通道独立均衡化
+    };
+    // 全局直方图均衡化, 只支持 IMG_8U 图像
+    void equalize_hist(const Image &src, Image &dst, EqualizeMode mode = EQUALIZE_LUMA);
+    // 限制对比度的自适应直方图均衡化 (CLAHE): 图像分为 tiles_x x tiles_y 个块, 每块的直方图在
+    // clip_limit 倍平均高度处截断 (<= 0 时不截断), 像素值在相邻四个块的查找表之间双线性插值; 只支持 IMG_8U 图像
+    void clahe(const Image &src, Image &dst, double clip_limit = 40.0, int tiles_x = 8, int tiles_y = 8,
+               EqualizeMode mode = EQUALIZE_LUMA);
+
+    //////////////积分图 (实现在 integral.cpp 中)//////////////
+    // 输出为 (rows + 1) x (cols + 1), 通道数与 src 相同: sum(y, x) 为 src 中 [0, y) x [0, x) 矩形内的和, 第 0 行和第 0 列为 0。
+    // src 支持 IMG_8U / IMG_32F; sdepth 为 sum 的深度, IMG_8U 输入可选 IMG_32S / IMG_64F, IMG_32F 输入只能为 IMG_64F。
+    // 默认 (-1) 时 IMG_8U 输入为 IMG_32S, 但像素数 * 255 超出 int 时 (约 840 万像素以上) 自动改为 IMG_64F;
+    // 显式要求 IMG_32S 而和可能溢出时抛出 std::invalid_argument
+    void integral(const Image &src, Image &sum, int sdepth = -1);
+    // 同时计算平方和的积分图 sqsum (IMG_64F)
+    void integral(const Image &src, Image &sum, Image &sqsum, int sdepth = -1);
+
+    //////////////滤波 (实现在 filter.cpp 中)//////////////
+    // 图像之外像素的取法, 取值与 OpenCV 相同 (abcdefgh 为一行像素, | 为图像边界)
+    enum BorderType
+    {
+        BORDER_CONSTANT = 0,    // 000000|abcdefgh|0000000
+        BORDER_REPLICATE = 1,   // aaaaaa|abcdefgh|hhhhhhh
+        BORDER_REFLECT = 2,     // fedcba|abcdefgh|hgfedcb
+        BORDER_WRAP = 3,        // cdefgh|abcdefgh|abcdefg
+        BORDER_REFLECT_101 = 4, // gfedcb|abcdefgh|gfedcba
+        BORDER_DEFAULT = BORDER_REFLECT_101
+    };
+
+    // 二维相关 (与 OpenCV 相同, 核不翻转): dst(y, x) = sum kernel(i, j) * src(y + i - anchor.y, x + j - anchor.x)
+    // kernel 为 IMG_32FC1 / IMG_64FC1, anchor 为 (-1, -1) 时取核的中心; 支持所有深度, 输出类型与 src 相同 (整数饱和)
+    // 秩为 1 的核会被自动分解, 按水平和垂直两个一维滤波执行
+    void filter2D(const Image &src, Image &dst, const Image &kernel, Point anchor = Point(), BorderType border = BORDER_DEFAULT);
+
+    // 高斯模糊: ksize 为正奇数, 或为 0 时由 sigma 确定; sigma <= 0 时由 ksize 确定。支持所有深度
+    // 8U 的小核使用定点实现; ksize 为 0、sigma >= 8 且 border 为 BORDER_REPLICATE 时使用递归近似
+    void gaussian_blur(const Image &src, Image &dst, int ksize, double sigma = 0.0, BorderType border = BORDER_DEFAULT);
+
+    // 尺寸, width 为列数, height 为行数
+    struct Size
+    {
+        int width = 0;
+        int height = 0;
+    };
+
+    // 盒式滤波: dst 为 ksize 窗口内的和 (normalize 时为均值), 计算量与窗口大小无关
+    // ddepth 为 -1 (与 src 相同)、IMG_32S (整数输入)、IMG_32F 或 IMG_64F; anchor 为 (-1, -1) 时取窗口中心
+    void box_filter(const Image &src, Image &dst, int ddepth, Size ksize, Point anchor = Point(), bool normalize = true,
+                    BorderType border = BORDER_DEFAULT);
+    // 均值滤波, 等价于 box_filter(src, dst, -1, ksize, anchor, true, border)
+    void blur(const Image &src, Image &dst, Size ksize, Point anchor = Point(), BorderType border = BORDER_DEFAULT);
+
+    // 中值滤波 (实现在 median.cpp 中): 只支持 IMG_8U, ksize 为奇数, 图像之外的像素按 BORDER_REPLICATE 取值
+    void median_blur(const Image &src, Image &dst, int ksize);
+
+    //////////////图像缩放 (实现在 resize.cpp 中)//////////////
+    // 插值方式, 取值与 OpenCV 相同
+    enum InterpolationType
+    {
+        INTER_NEAREST = 0, // 最近邻, 取输出像素中心对应的源像素
+        INTER_LINEAR = 1,  // 双线性
+        INTER_CUBIC = 2,   // 双三次 (4x4 邻域, a = -0.75)
+        INTER_AREA = 3     // 缩小时按像素面积加权平均 (无混叠), 放大时与双线性相近
+    };
+
+    // 缩放到 dsize, 像素中心对齐 (源坐标 = (dst + 0.5) * scale - 0.5), 图像之外的像素按 BORDER_REPLICATE 取值
+    // 支持所有深度, 输出类型与 src 相同; 8U 的双线性/双三次插值使用定点系数
+    void resize(const Image &src, Image &dst, Size dsize, InterpolationType interp = INTER_LINEAR);
+
+    //////////////图像金字塔 (实现在 pyramid.cpp 中)//////////////
+    // 高斯平滑 (5x5, 1 4 6 4 1) 后隔行隔列抽取; dsize 为空时为 ((cols + 1) / 2, (rows + 1) / 2),
+    // 否则要求 |dsize.width * 2 - cols| <= 2 且 |dsize.height * 2 - rows| <= 2。支持所有深度
+    void pyr_down(const Image &src, Image &dst, Size dsize = Size(), BorderType border = BORDER_DEFAULT);
+    // 插入零行零列放大两倍后用同一个核 (乘 4) 平滑; dsize 为空时为 (cols * 2, rows * 2),
+    // 否则宽高可以比两倍少 1 (用于恢复奇数尺寸的上一层)
+    void pyr_up(const Image &src, Image &dst, Size dsize = Size(), BorderType border = BORDER_DEFAULT);
+
+    // 高斯金字塔: 第 0 层是输入图像 (软拷贝), 第 1 层及以上分配在同一块内存中 (第 1 层在左侧,
+    // 其余各层在右侧一列中依次向下排列), 每层是这块内存上的 Image 视图, 共享引用计数。
+    // 各层在第一次访问时才由上一层计算; reset 换入同尺寸同类型的新帧时, 若没有其它 Image (调用者保存的某一层、
+    // 金字塔的副本) 引用这块内存就复用它, 否则分配新的一块, 已经取得的各层不会被新帧覆盖。不是线程安全的
+    class Pyramid
+    {
+    public:
+        Pyramid() = default;
+        // levels 为最多的层数 (包括第 0 层), 最小的一层缩小到 1x1 后不再增加
+        Pyramid(const Image &base, int levels, BorderType border = BORDER_DEFAULT);
+        void reset(const Image &base);
+
+        int levels() const { return static_cast<int>(m_levels.size()); }
+        const Image &level(int i);
+        // 拉普拉斯金字塔的第 i 层: level(i) - pyr_up(level(i + 1)), 最后一层为 level(i) 本身;
+        // 输出深度为 IMG_32F (输入为 IMG_64F 时为 IMG_64F)
+        void laplacian(int i, Image &dst);
+
+    private:
+        Image m_storage;             // 第 1 层及以上共用的内存块
+        std::vector<Image> m_levels; // 各层的视图
+        int m_built = 0;             // 已经计算好的层数
+        int m_max_levels = 0;
+        BorderType m_border = BORDER_DEFAULT;
+    };
+
+    //////////////仿射、透视变换与重映射 (实现在 warp.cpp 中)//////////////
+    // M 把源坐标映射到输出坐标 (与 OpenCV 相同, 内部求逆后对每个输出像素反向采样): 仿射为 2x3, 透视为 3x3,
+    // 类型为 IMG_32FC1 / IMG_64FC1。interp 只支持 INTER_NEAREST / INTER_LINEAR, 采样坐标量化到 1/32 像素;
+    // 落在图像之外的采样点按 border 取值 (BORDER_CONSTANT 时为 border_value)。支持所有深度, 源图像的宽高不超过 32767
+    void warp_affine(const Image &src, Image &dst, const Image &M, Size dsize, InterpolationType interp = INTER_LINEAR,
+                     BorderType border = BORDER_CONSTANT, const Scalar &border_value = Scalar());
+    void warp_perspective(const Image &src, Image &dst, const Image &M, Size dsize, InterpolationType interp = INTER_LINEAR,
+                          BorderType border = BORDER_CONSTANT, const Scalar &border_value = Scalar());
+
+    // 重映射: dst(y, x) = src(map_y(y, x), map_x(y, x)), map_x / map_y 为与 dst 同尺寸的 IMG_32FC1;
+    // 插值、边界和源图像尺寸的限制同 warp_affine
+    void remap(const Image &src, Image &dst, const Image &map_x, const Image &map_y, InterpolationType interp = INTER_LINEAR,
+               BorderType border = BORDER_CONSTANT, const Scalar &border_value = Scalar());
+
+    // convert_maps 生成的定点坐标表 (与 OpenCV 的 16SC2 + 16UC1 相同的布局): 同一个映射用于很多帧时 (例如镜头畸变校正)
+    // 只转换一次, 之后每帧的 remap 只是按表取像素, 没有浮点运算
+    struct FixedPointMap
+    {
+        size_t rows = 0;
+        size_t cols = 0;
+        std::vector<short> xy;           // 每个像素两个: 源坐标的整数部分 (x, y)
+        std::vector<unsigned short> fxy; // 每个像素一个: 小数部分 (1/32 像素) 的插值表索引 fy * 32 + fx, 最近邻时为空
+    };
+    // interp 为 INTER_NEAREST 时坐标舍入到整数像素, INTER_LINEAR 时保留 1/32 像素的小数部分
+    void convert_maps(const Image &map_x, const Image &map_y, FixedPointMap &dst, InterpolationType interp = INTER_LINEAR);
+    // 用定点坐标表重映射, 插值方式由生成 map 时的 interp 决定; 尺寸不符时抛出 invalid_argument (fxy 只使用低 10 位)
+    void remap(const Image &src, Image &dst, const FixedPointMap &map, BorderType border = BORDER_CONSTANT,
+               const Scalar &border_value = Scalar());
+
+}
+// 让通用代码可以像内置浮点类型一样查询 img::float16 的取值范围
+namespace std
+{
+    template <>
+    class numeric_limits<img::float16>
+    {
+    public:
+        static constexpr bool is_specialized = true;
+        static constexpr bool is_signed = true;
+        static constexpr bool is_integer = false;
+        static constexpr bool is_exact = false;
+        static constexpr bool has_infinity = true;
+        static constexpr bool has_quiet_NaN = true;
+        static constexpr int digits = 11;
+        static constexpr int radix = 2;
+        static constexpr img::float16 min() noexcept { return img::float16::from_bits(0x0400); }     // 2^-14
+        static constexpr img::float16 max() noexcept { return img::float16::from_bits(0x7bff); }     // 65504
+        static constexpr img::float16 lowest() noexcept { return img::float16::from_bits(0xfbff); }  // -65504
+        static constexpr img::float16 epsilon() noexcept { return img::float16::from_bits(0x1400); } // 2^-10
+        static constexpr img::float16 infinity() noexcept { return img::float16::from_bits(0x7c00); }
+        static constexpr img::float16 quiet_NaN() noexcept { return img::float16::from_bits(0x7e00); }
+    };
+}
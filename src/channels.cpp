@@ -0,0 +1,275 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace img
+{
+#if defined(__SSE2__)
+    // 以下 SIMD 内核都只用 SSE2 的 unpack 指令完成交错/解交错, 每次处理一组完整的寄存器,
+    // 只搬运字节, 与通道类型无关 (例如 32S 和 32F 共用 4 字节版本); 1 字节的 split3_u8 / merge3_u8 / split4_u8 / merge4_u8 在 image_internal.h 中
+
+    /** @brief 8 个 4 通道 2 字节像素 (64 字节) 解交错: 三轮 16 位 unpack。 */
+    static inline void split4_u16(const unsigned char *src, unsigned char *const *dst)
+    {
+        const __m128i u0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));      // 像素 0-1
+        const __m128i u1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)); // 像素 2-3
+        const __m128i u2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)); // 像素 4-5
+        const __m128i u3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48)); // 像素 6-7
+        const __m128i v0 = _mm_unpacklo_epi16(u0, u2);
+        const __m128i v1 = _mm_unpackhi_epi16(u0, u2);
+        const __m128i v2 = _mm_unpacklo_epi16(u1, u3);
+        const __m128i v3 = _mm_unpackhi_epi16(u1, u3);
+        const __m128i w0 = _mm_unpacklo_epi16(v0, v2); // 通道 0/1, 像素 0, 2, 4, 6
+        const __m128i w1 = _mm_unpackhi_epi16(v0, v2); // 通道 2/3
+        const __m128i w2 = _mm_unpacklo_epi16(v1, v3); // 通道 0/1, 像素 1, 3, 5, 7
+        const __m128i w3 = _mm_unpackhi_epi16(v1, v3); // 通道 2/3
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[0]), _mm_unpacklo_epi16(w0, w2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[1]), _mm_unpackhi_epi16(w0, w2));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[2]), _mm_unpacklo_epi16(w1, w3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[3]), _mm_unpackhi_epi16(w1, w3));
+    }
+
+    /** @brief 4 个 4 通道 4 字节像素是一个 4x4 方块, 解交错和交错都是寄存器内转置。 */
+    static inline void transpose4_u32(const unsigned char *const *src, unsigned char *const *dst)
+    {
+        __m128 r0 = _mm_loadu_ps(reinterpret_cast<const float *>(src[0]));
+        __m128 r1 = _mm_loadu_ps(reinterpret_cast<const float *>(src[1]));
+        __m128 r2 = _mm_loadu_ps(reinterpret_cast<const float *>(src[2]));
+        __m128 r3 = _mm_loadu_ps(reinterpret_cast<const float *>(src[3]));
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(reinterpret_cast<float *>(dst[0]), r0);
+        _mm_storeu_ps(reinterpret_cast<float *>(dst[1]), r1);
+        _mm_storeu_ps(reinterpret_cast<float *>(dst[2]), r2);
+        _mm_storeu_ps(reinterpret_cast<float *>(dst[3]), r3);
+    }
+
+    /** @brief 4 个通道各 8 个 2 字节元素交错为 8 个像素: 一轮 16 位 unpack 加一轮 32 位 unpack。 */
+    static inline void merge4_u16(const unsigned char *const *src, unsigned char *dst)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[0]));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[1]));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[2]));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src[3]));
+        const __m128i ab0 = _mm_unpacklo_epi16(a, b);
+        const __m128i ab1 = _mm_unpackhi_epi16(a, b);
+        const __m128i cd0 = _mm_unpacklo_epi16(c, d);
+        const __m128i cd1 = _mm_unpackhi_epi16(c, d);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi32(ab0, cd0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi32(ab0, cd0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_unpacklo_epi32(ab1, cd1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 48), _mm_unpackhi_epi32(ab1, cd1));
+    }
+#endif
+
+    /**
+     * @brief 把一行交错存储的像素拆分到 CN 个平面。
+     * 有 SIMD 版本的组合先按寄存器宽度成块处理, 剩余部分 (以及其它组合) 逐元素复制,
+     * 逐元素循环的通道数是编译期常量, 开启 IMGLIB_NATIVE 时编译器也能用 shuffle 指令向量化。
+     */
+    template <typename T, int CN>
+    static void split_row(const T *src, T *const *dst, size_t cols)
+    {
+        size_t c = 0;
+#if defined(__SSE2__)
+        unsigned char *const *d = reinterpret_cast<unsigned char *const *>(dst);
+        const unsigned char *s = reinterpret_cast<const unsigned char *>(src);
+        if constexpr (CN == 3 && sizeof(T) == 1)
+        {
+            for (; c + 16 <= cols; c += 16)
+            {
+                __m128i c0, c1, c2;
+                split3_u8(s + c * 3, c0, c1, c2);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[0] + c), c0);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[1] + c), c1);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[2] + c), c2);
+            }
+        }
+        else if constexpr (CN == 4 && sizeof(T) == 1)
+        {
+            for (; c + 16 <= cols; c += 16)
+            {
+                __m128i c0, c1, c2, c3;
+                split4_u8(s + c * 4, c0, c1, c2, c3);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[0] + c), c0);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[1] + c), c1);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[2] + c), c2);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d[3] + c), c3);
+            }
+        }
+        else if constexpr (CN == 4 && sizeof(T) == 2)
+        {
+            for (; c + 8 <= cols; c += 8)
+            {
+                unsigned char *const out[4] = {d[0] + c * 2, d[1] + c * 2, d[2] + c * 2, d[3] + c * 2};
+                split4_u16(s + c * 8, out);
+            }
+        }
+        else if constexpr (CN == 4 && sizeof(T) == 4)
+        {
+            for (; c + 4 <= cols; c += 4)
+            {
+                const unsigned char *const in[4] = {s + c * 16, s + c * 16 + 16, s + c * 16 + 32, s + c * 16 + 48};
+                unsigned char *const out[4] = {d[0] + c * 4, d[1] + c * 4, d[2] + c * 4, d[3] + c * 4};
+                transpose4_u32(in, out);
+            }
+        }
+#endif
+        for (; c < cols; ++c)
+        {
+            for (int k = 0; k < CN; ++k)
+                dst[k][c] = src[c * CN + k];
+        }
+    }
+
+    /** @brief 把 CN 个平面的一行交错合并为一行像素, 结构与 split_row 相同。 */
+    template <typename T, int CN>
+    static void merge_row(const T *const *src, T *dst, size_t cols)
+    {
+        size_t c = 0;
+#if defined(__SSE2__)
+        const unsigned char *const *s = reinterpret_cast<const unsigned char *const *>(src);
+        unsigned char *d = reinterpret_cast<unsigned char *>(dst);
+        if constexpr (CN == 3 && sizeof(T) == 1)
+        {
+            for (; c + 16 <= cols; c += 16)
+            {
+                merge3_u8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s[0] + c)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s[1] + c)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s[2] + c)), d + c * 3);
+            }
+        }
+        else if constexpr (CN == 4 && sizeof(T) == 1)
+        {
+            for (; c + 16 <= cols; c += 16)
+            {
+                merge4_u8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s[0] + c)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s[1] + c)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s[2] + c)),
+                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(s[3] + c)), d + c * 4);
+            }
+        }
+        else if constexpr (CN == 4 && sizeof(T) == 2)
+        {
+            for (; c + 8 <= cols; c += 8)
+            {
+                const unsigned char *const in[4] = {s[0] + c * 2, s[1] + c * 2, s[2] + c * 2, s[3] + c * 2};
+                merge4_u16(in, d + c * 8);
+            }
+        }
+        else if constexpr (CN == 4 && sizeof(T) == 4)
+        {
+            for (; c + 4 <= cols; c += 4)
+            {
+                const unsigned char *const in[4] = {s[0] + c * 4, s[1] + c * 4, s[2] + c * 4, s[3] + c * 4};
+                unsigned char *const out[4] = {d + c * 16, d + c * 16 + 16, d + c * 16 + 32, d + c * 16 + 48};
+                transpose4_u32(in, out);
+            }
+        }
+#endif
+        for (; c < cols; ++c)
+        {
+            for (int k = 0; k < CN; ++k)
+                dst[c * CN + k] = src[k][c];
+        }
+    }
+
+    template <typename T, int CN>
+    static void split_kernel(const Image &src, std::vector<Image> &planes)
+    {
+        Image_<const T, CN> s(src);
+        std::vector<Image_<T, 1>> d(planes.begin(), planes.end());
+        const size_t cols = s.cols();
+        parallel_for_rows(s.rows(), cols * sizeof(T) * CN * 2, [&](size_t begin, size_t end)
+                          {
+            T *rows_out[CN];
+            for (size_t r = begin; r < end; ++r)
+            {
+                for (int k = 0; k < CN; ++k)
+                    rows_out[k] = d[k].ptr(r);
+                split_row<T, CN>(s.ptr(r), rows_out, cols);
+            } });
+    }
+
+    template <typename T, int CN>
+    static void merge_kernel(const std::vector<Image> &planes, Image &dst)
+    {
+        std::vector<Image_<const T, 1>> s(planes.begin(), planes.end());
+        Image_<T, CN> d(dst);
+        const size_t cols = d.cols();
+        parallel_for_rows(d.rows(), cols * sizeof(T) * CN * 2, [&](size_t begin, size_t end)
+                          {
+            const T *rows_in[CN];
+            for (size_t r = begin; r < end; ++r)
+            {
+                for (int k = 0; k < CN; ++k)
+                    rows_in[k] = s[k].ptr(r);
+                merge_row<T, CN>(rows_in, d.ptr(r), cols);
+            } });
+    }
+
+    /**
+     * @brief 把多通道图像拆分为单通道图像 (交错存储 -> 平面存储)。
+     * 只需要访问单个通道而不需要复制时, 可以使用零拷贝的 Image::channel()。
+     * @param src 输入图像, 支持所有深度和通道数。
+     * @param dst 输出, 调整为 src.get_channels() 个新分配的单通道图像, 深度与 src 相同。
+     * @throw std::logic_error 如果输入图像为空。
+     */
+    void split(const Image &src, std::vector<Image> &dst)
+    {
+        const std::string F_NAME = "split";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        const Image s = pixel_contiguous(src);
+        std::vector<Image> planes;
+        planes.reserve(s.get_channels());
+        for (int k = 0; k < s.get_channels(); ++k)
+        {
+            planes.emplace_back(s.get_rows(), s.get_cols(), IMG_MAKETYPE(s.get_depth(), 1));
+        }
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { split_kernel<typename decltype(tag)::type, decltype(tag)::channels>(s, planes); });
+        dst = std::move(planes);
+    }
+
+    /**
+     * @brief 把若干单通道图像合并为一个多通道图像 (平面存储 -> 交错存储)。
+     * @param src 1/3/4 个单通道图像, 尺寸和深度必须相同; 第 k 个图像成为输出的第 k 个通道。
+     * @param dst 输出图像, 可以是 src 中的某个图像。
+     * @throw std::invalid_argument 如果图像数量不受支持, 或输入为空、不是单通道、尺寸或深度不一致。
+     */
+    void merge(const std::vector<Image> &src, Image &dst)
+    {
+        const std::string F_NAME = "merge";
+        const size_t count = src.size();
+        if (count != 1 && count != 3 && count != 4)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持合并 1/3/4 个图像, 收到 " + std::to_string(count) + " 个。");
+        }
+        std::vector<Image> planes;
+        planes.reserve(count);
+        for (size_t k = 0; k < count; ++k)
+        {
+            const Image &p = src[k];
+            if (p.empty() || p.get_channels() != 1)
+            {
+                throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "第 " + std::to_string(k) + " 个输入图像为空或不是单通道图像。");
+            }
+            if (p.get_rows() != src[0].get_rows() || p.get_cols() != src[0].get_cols() || p.get_depth() != src[0].get_depth())
+            {
+                throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "第 " + std::to_string(k) + " 个输入图像的尺寸或深度与第 0 个不一致。");
+            }
+            planes.push_back(pixel_contiguous(p));
+        }
+        Image out(src[0].get_rows(), src[0].get_cols(), IMG_MAKETYPE(src[0].get_depth(), static_cast<int>(count)));
+        dispatch_type(out.get_type(), [&](auto tag)
+                      { merge_kernel<typename decltype(tag)::type, decltype(tag)::channels>(planes, out); });
+        dst = out;
+    }
+}
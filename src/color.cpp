@@ -0,0 +1,913 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <algorithm>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace img
+{
+    // BT.601 亮度系数 0.114 B + 0.587 G + 0.299 R, 放大 2^14 后的定点数 (三者之和正好为 1 << 14)
+    static const int GRAY_SHIFT = 14;
+    static const int GRAY_B = 1868;
+    static const int GRAY_G = 9617;
+    static const int GRAY_R = 4899;
+
+#if defined(__SSE2__)
+    /** @brief pmaddwd 的一对 16 位系数: 每个 32 位元素的低位乘第一个操作数, 高位乘第二个操作数。 */
+    static inline __m128i coeff_pair(int lo, int hi)
+    {
+        return _mm_set1_epi32(static_cast<int>((static_cast<unsigned>(hi) << 16) | (static_cast<unsigned>(lo) & 0xFFFFu)));
+    }
+
+    /** @brief 8 个 16 位的 (b, g, r): (c_bg · (b, g) + c_r · (r, 1)) >> SHIFT, 结果为 8 个 16 位数。 */
+    template <int SHIFT>
+    static inline __m128i bgr_madd8(__m128i b, __m128i g, __m128i r, __m128i c_bg, __m128i c_r)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(b, g), c_bg), _mm_madd_epi16(_mm_unpacklo_epi16(r, one), c_r));
+        const __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(b, g), c_bg), _mm_madd_epi16(_mm_unpackhi_epi16(r, one), c_r));
+        return _mm_packs_epi32(_mm_srai_epi32(lo, SHIFT), _mm_srai_epi32(hi, SHIFT));
+    }
+#endif
+
+    /** @brief 不透明 alpha 通道的值: 整数类型取最大值, 浮点类型取 1。 */
+    template <typename T>
+    static T alpha_max()
+    {
+        if constexpr (is_float_type<T>::value)
+            return static_cast<T>(1);
+        else
+            return std::numeric_limits<T>::max();
+    }
+
+    /**
+     * @brief 由 B, G, R 计算灰度值。
+     * 8U/16U 输入使用定点系数 (整数乘加, 便于向量化), 其它深度使用浮点系数。
+     */
+    template <typename S>
+    static auto bgr_to_gray(const S *p)
+    {
+        if constexpr (std::is_same<S, unsigned char>::value || std::is_same<S, unsigned short>::value)
+        {
+            // 16U 时最大和为 65535 * 2^14, 仍在 unsigned int 范围内
+            const unsigned int v = p[0] * static_cast<unsigned int>(GRAY_B) + p[1] * static_cast<unsigned int>(GRAY_G) +
+                                   p[2] * static_cast<unsigned int>(GRAY_R) + (1u << (GRAY_SHIFT - 1));
+            return static_cast<S>(v >> GRAY_SHIFT);
+        }
+        else
+        {
+            return 0.114 * p[0] + 0.587 * p[1] + 0.299 * p[2];
+        }
+    }
+
+    // 每种转换的逐像素操作, S/D 为源/目标通道类型, 深度不同时在同一遍中完成转换
+    template <typename S, typename D>
+    struct BGR2GrayOp
+    {
+        static constexpr int SCN = 3, DCN = 1;
+        void operator()(const S *p, D *q) const { q[0] = truncate_cast<D>(bgr_to_gray(p)); }
+    };
+    template <typename S, typename D>
+    struct BGRA2GrayOp
+    {
+        static constexpr int SCN = 4, DCN = 1;
+        void operator()(const S *p, D *q) const { q[0] = truncate_cast<D>(bgr_to_gray(p)); }
+    };
+    template <typename S, typename D>
+    struct Gray2BGROp
+    {
+        static constexpr int SCN = 1, DCN = 3;
+        void operator()(const S *p, D *q) const { q[0] = q[1] = q[2] = truncate_cast<D>(p[0]); }
+    };
+    template <typename S, typename D>
+    struct Gray2BGRAOp
+    {
+        static constexpr int SCN = 1, DCN = 4;
+        void operator()(const S *p, D *q) const
+        {
+            q[0] = q[1] = q[2] = truncate_cast<D>(p[0]);
+            q[3] = alpha_max<D>();
+        }
+    };
+    template <typename S, typename D>
+    struct BGR2BGRAOp
+    {
+        static constexpr int SCN = 3, DCN = 4;
+        void operator()(const S *p, D *q) const
+        {
+            q[0] = truncate_cast<D>(p[0]);
+            q[1] = truncate_cast<D>(p[1]);
+            q[2] = truncate_cast<D>(p[2]);
+            q[3] = alpha_max<D>();
+        }
+    };
+    template <typename S, typename D>
+    struct BGRA2BGROp
+    {
+        static constexpr int SCN = 4, DCN = 3;
+        void operator()(const S *p, D *q) const
+        {
+            q[0] = truncate_cast<D>(p[0]);
+            q[1] = truncate_cast<D>(p[1]);
+            q[2] = truncate_cast<D>(p[2]);
+        }
+    };
+
+    /**
+     * @brief 一行中由 SIMD 处理的前缀, 返回处理的像素数。默认没有 SIMD 版本, 返回 0;
+     * 8U -> 8U 的 BGR <-> BGRA 和 BGR(A) -> Gray 在下面重载。
+     */
+    template <typename Op, typename S, typename D>
+    static size_t color_row_simd(const Op &, const S *, D *, size_t)
+    {
+        return 0;
+    }
+
+#if defined(__SSE2__)
+    /** @brief 16 个像素的 B/G/R (各 16 字节) 的灰度: 扩展为 16 位后用 pmaddwd 乘加 14 位定点系数, 与 bgr_to_gray 逐位相同。 */
+    static inline __m128i gray16_u8(__m128i b, __m128i g, __m128i r)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c_bg = coeff_pair(GRAY_B, GRAY_G);
+        const __m128i c_r = coeff_pair(GRAY_R, 1 << (GRAY_SHIFT - 1));
+        const __m128i lo = bgr_madd8<GRAY_SHIFT>(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(r, zero), c_bg, c_r);
+        const __m128i hi = bgr_madd8<GRAY_SHIFT>(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero), c_bg, c_r);
+        return _mm_packus_epi16(lo, hi);
+    }
+
+    static size_t color_row_simd(const BGR2GrayOp<unsigned char, unsigned char> &, const unsigned char *p, unsigned char *q, size_t cols)
+    {
+        size_t c = 0;
+        for (; c + 16 <= cols; c += 16)
+        {
+            __m128i b, g, r;
+            split3_u8(p + c * 3, b, g, r);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q + c), gray16_u8(b, g, r));
+        }
+        return c;
+    }
+
+    static size_t color_row_simd(const BGRA2GrayOp<unsigned char, unsigned char> &, const unsigned char *p, unsigned char *q, size_t cols)
+    {
+        size_t c = 0;
+        for (; c + 16 <= cols; c += 16)
+        {
+            __m128i b, g, r, a;
+            split4_u8(p + c * 4, b, g, r, a);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q + c), gray16_u8(b, g, r));
+        }
+        return c;
+    }
+
+    static size_t color_row_simd(const BGR2BGRAOp<unsigned char, unsigned char> &, const unsigned char *p, unsigned char *q, size_t cols)
+    {
+        const __m128i alpha = _mm_set1_epi8(static_cast<char>(-1));
+        size_t c = 0;
+        for (; c + 16 <= cols; c += 16)
+        {
+            __m128i b, g, r;
+            split3_u8(p + c * 3, b, g, r);
+            merge4_u8(b, g, r, alpha, q + c * 4);
+        }
+        return c;
+    }
+
+    static size_t color_row_simd(const BGRA2BGROp<unsigned char, unsigned char> &, const unsigned char *p, unsigned char *q, size_t cols)
+    {
+        size_t c = 0;
+        for (; c + 16 <= cols; c += 16)
+        {
+            __m128i b, g, r, a;
+            split4_u8(p + c * 4, b, g, r, a);
+            merge3_u8(b, g, r, q + c * 3);
+        }
+        return c;
+    }
+#endif
+
+    /**
+     * @brief 逐像素执行颜色转换, 按行并行。
+     * 有 SIMD 版本的组合 (color_row_simd) 先每次处理 16 个像素, 剩余的像素 (以及其它组合) 逐像素执行 op;
+     * 通道数都是编译期常量, 使用 IMGLIB_NATIVE 编译选项时编译器也能把逐像素的循环向量化。
+     */
+    template <typename S, typename D, typename Op>
+    static void color_kernel(const Image &src, Image &dst, Op op)
+    {
+        constexpr int SCN = Op::SCN;
+        constexpr int DCN = Op::DCN;
+        Image_<const S, SCN> s(src);
+        Image_<D, DCN> d(dst);
+        const size_t cols = s.cols();
+        parallel_for_rows(s.rows(), cols * (sizeof(S) * SCN + sizeof(D) * DCN), [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                const S *ps = s.ptr(r);
+                D *pd = d.ptr(r);
+                for (size_t c = color_row_simd(op, ps, pd, cols); c < cols; ++c)
+                {
+                    op(ps + c * SCN, pd + c * DCN);
+                }
+            } });
+    }
+
+    /** @brief 按源深度和目标深度分发, 以 Op<S, D> 执行转换。 */
+    template <template <typename, typename> class Op>
+    static void run_color_op(const Image &src, Image &dst)
+    {
+        dispatch_depth(src.get_depth(), [&](auto src_tag)
+                       {
+            using S = typename decltype(src_tag)::type;
+            dispatch_depth(dst.get_depth(), [&](auto dst_tag)
+                           {
+                using D = typename decltype(dst_tag)::type;
+                color_kernel<S, D>(src, dst, Op<S, D>{}); }); });
+    }
+
+    /**
+     * @brief 颜色空间转换, 可以改变通道数, 也可以在同一遍中改变深度。
+     * 灰度使用 BT.601 系数 (0.114 B + 0.587 G + 0.299 R), 8U/16U 输入使用 14 位定点运算。
+     * 新增的 alpha 通道设为不透明 (整数类型为最大值, 浮点类型为 1)。
+     * @param src 输入图像, 通道数必须与 code 要求的一致。
+     * @param dst 输出图像, 可以与 src 是同一个对象。
+     * @param code 转换方式, 见 ColorConversionCode。
+     * @param dst_depth 输出深度, 为负数时与输入相同。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 code 无效、输入通道数不符合要求或 dst_depth 不受支持。
+     */
+    void cvt_color(const Image &src, Image &dst, ColorConversionCode code, int dst_depth)
+    {
+        const std::string F_NAME = "cvt_color";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        int src_cn = 0;
+        int dst_cn = 0;
+        switch (code)
+        {
+        case COLOR_BGR2GRAY:
+            src_cn = 3, dst_cn = 1;
+            break;
+        case COLOR_BGRA2GRAY:
+            src_cn = 4, dst_cn = 1;
+            break;
+        case COLOR_GRAY2BGR:
+            src_cn = 1, dst_cn = 3;
+            break;
+        case COLOR_GRAY2BGRA:
+            src_cn = 1, dst_cn = 4;
+            break;
+        case COLOR_BGR2BGRA:
+            src_cn = 3, dst_cn = 4;
+            break;
+        case COLOR_BGRA2BGR:
+            src_cn = 4, dst_cn = 3;
+            break;
+        default:
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的颜色转换方式: " + std::to_string(code));
+        }
+        if (src.get_channels() != src_cn)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输入通道数不符合转换要求。需要 " + std::to_string(src_cn) +
+                                        " 通道, 收到 " + std::to_string(src.get_channels()) + " 通道。");
+        }
+        if (dst_depth < 0)
+        {
+            dst_depth = src.get_depth();
+        }
+        if (dst_depth < IMG_8U || dst_depth > IMG_16S)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的输出深度 " + std::to_string(dst_depth) +
+                                        ", 应为 IMG_8U .. IMG_16S 或 -1。");
+        }
+
+        const Image s = pixel_contiguous(src);
+        Image out;
+        try
+        {
+            out.create(s.get_rows(), s.get_cols(), IMG_MAKETYPE(dst_depth, dst_cn));
+        }
+        catch (const std::exception &e)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无法创建输出图像 (dst_depth: " + std::to_string(dst_depth) + "): " + e.what());
+        }
+
+        switch (code)
+        {
+        case COLOR_BGR2GRAY:
+            run_color_op<BGR2GrayOp>(s, out);
+            break;
+        case COLOR_BGRA2GRAY:
+            run_color_op<BGRA2GrayOp>(s, out);
+            break;
+        case COLOR_GRAY2BGR:
+            run_color_op<Gray2BGROp>(s, out);
+            break;
+        case COLOR_GRAY2BGRA:
+            run_color_op<Gray2BGRAOp>(s, out);
+            break;
+        case COLOR_BGR2BGRA:
+            run_color_op<BGR2BGRAOp>(s, out);
+            break;
+        case COLOR_BGRA2BGR:
+            run_color_op<BGRA2BGROp>(s, out);
+            break;
+        default:
+            break;
+        }
+        dst = out;
+    }
+
+    //////////////////////////////////////////YUV//////////////////////////////////////////
+    // YUV <-> BGR 两个方向使用同一套定点系数 (放大 2^YUV_SHIFT), 全程整数运算。
+    // 所有系数的绝对值都小于 2^15, SSE2 可以用 pmaddwd 一次完成两项 16 位乘加
+    static const int YUV_SHIFT = 13;
+
+    static int fixed_coeff(double c)
+    {
+        return static_cast<int>(c * (1 << YUV_SHIFT) + (c >= 0 ? 0.5 : -0.5));
+    }
+
+    // 视频范围 YUV -> BGR: B = y*(Y-16) + bu*(U-128), G = y*(Y-16) - gu*(U-128) - gv*(V-128), R = y*(Y-16) + rv*(V-128)
+    struct YUV2BGRCoeffs
+    {
+        int y, bu, gu, gv, rv;
+    };
+
+    static YUV2BGRCoeffs yuv2bgr_coeffs(YUVMatrix matrix)
+    {
+        if (matrix == YUV_BT709)
+            return {fixed_coeff(1.164383), fixed_coeff(2.112402), fixed_coeff(0.213249),
+                    fixed_coeff(0.532909), fixed_coeff(1.792741)};
+        return {fixed_coeff(1.164383), fixed_coeff(2.017232), fixed_coeff(0.391762),
+                fixed_coeff(0.812968), fixed_coeff(1.596027)};
+    }
+
+    // BGR -> 视频范围 YUV, 每个分量是 B/G/R 的线性组合 (Y 再加 16, U/V 再加 128)
+    struct BGR2YUVCoeffs
+    {
+        int yb, yg, yr;
+        int ub, ug, ur;
+        int vb, vg, vr;
+    };
+
+    static BGR2YUVCoeffs bgr2yuv_coeffs(YUVMatrix matrix)
+    {
+        if (matrix == YUV_BT709)
+            return {fixed_coeff(0.062007), fixed_coeff(0.614231), fixed_coeff(0.182586),
+                    fixed_coeff(0.439216), fixed_coeff(-0.338572), fixed_coeff(-0.100644),
+                    fixed_coeff(-0.040274), fixed_coeff(-0.398942), fixed_coeff(0.439216)};
+        return {fixed_coeff(0.097906), fixed_coeff(0.504129), fixed_coeff(0.256788),
+                fixed_coeff(0.439216), fixed_coeff(-0.290993), fixed_coeff(-0.148223),
+                fixed_coeff(-0.071427), fixed_coeff(-0.367788), fixed_coeff(0.439216)};
+    }
+
+    static inline unsigned char clamp_u8(int v)
+    {
+        return static_cast<unsigned char>(std::min(255, std::max(0, v)));
+    }
+
+    /** @brief 由一个 Y 和预先算好的色度项写出一个 BGR(A) 像素。同一色度样本覆盖的像素共用色度项。 */
+    template <int DCN>
+    static inline void store_bgr(unsigned char *q, int y, int b_uv, int g_uv, int r_uv, int cy)
+    {
+        const int yy = std::max(y - 16, 0) * cy + (1 << (YUV_SHIFT - 1));
+        q[0] = clamp_u8((yy + b_uv) >> YUV_SHIFT);
+        q[1] = clamp_u8((yy + g_uv) >> YUV_SHIFT);
+        q[2] = clamp_u8((yy + r_uv) >> YUV_SHIFT);
+        if (DCN == 4)
+            q[3] = 255;
+    }
+
+#if defined(__SSE2__)
+    /** @brief YUV -> BGR 的 SSE2 系数。 */
+    struct YUV2BGRSimd
+    {
+        __m128i y_bu;  // (cy, bu)
+        __m128i y_gu;  // (cy, -gu)
+        __m128i y_rv;  // (cy, rv)
+        __m128i gv;    // (-gv, 0)
+        __m128i half;
+
+        explicit YUV2BGRSimd(const YUV2BGRCoeffs &k)
+            : y_bu(coeff_pair(k.y, k.bu)), y_gu(coeff_pair(k.y, -k.gu)), y_rv(coeff_pair(k.y, k.rv)), gv(coeff_pair(-k.gv, 0)),
+              half(_mm_set1_epi32(1 << (YUV_SHIFT - 1))) {}
+    };
+
+    /**
+     * @brief 8 个像素的一个输出通道: (a, b) 逐对与 coef 做 pmaddwd 得到 32 位的和, 加上 bias 后右移,
+     * 饱和为 8 个 16 位结果。与标量的 store_bgr 逐位相同。
+     */
+    static inline __m128i yuv_madd8(__m128i a, __m128i b, __m128i coef, __m128i bias_lo, __m128i bias_hi)
+    {
+        const __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coef), bias_lo);
+        const __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), coef), bias_hi);
+        return _mm_packs_epi32(_mm_srai_epi32(lo, YUV_SHIFT), _mm_srai_epi32(hi, YUV_SHIFT));
+    }
+
+    /**
+     * @brief 16 个像素 YUV -> BGR(A): ylo / yhi 为前后 8 个像素的 Y, u / v 为 8 个色度样本 (都是 16 位),
+     * 每个色度样本覆盖相邻两个像素。
+     */
+    template <int DCN>
+    static inline void yuv16_to_bgr(__m128i ylo, __m128i yhi, __m128i u, __m128i v, const YUV2BGRSimd &k, unsigned char *q)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c16 = _mm_set1_epi16(16);
+        const __m128i c128 = _mm_set1_epi16(128);
+        ylo = _mm_max_epi16(_mm_sub_epi16(ylo, c16), zero);
+        yhi = _mm_max_epi16(_mm_sub_epi16(yhi, c16), zero);
+        u = _mm_sub_epi16(u, c128);
+        v = _mm_sub_epi16(v, c128);
+        const __m128i uu[2] = {_mm_unpacklo_epi16(u, u), _mm_unpackhi_epi16(u, u)};
+        const __m128i vv[2] = {_mm_unpacklo_epi16(v, v), _mm_unpackhi_epi16(v, v)};
+        const __m128i yy[2] = {ylo, yhi};
+        __m128i b[2], g[2], r[2];
+        for (int h = 0; h < 2; ++h)
+        {
+            b[h] = yuv_madd8(yy[h], uu[h], k.y_bu, k.half, k.half);
+            r[h] = yuv_madd8(yy[h], vv[h], k.y_rv, k.half, k.half);
+            const __m128i gv_lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vv[h], zero), k.gv), k.half);
+            const __m128i gv_hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vv[h], zero), k.gv), k.half);
+            g[h] = yuv_madd8(yy[h], uu[h], k.y_gu, gv_lo, gv_hi);
+        }
+        const __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+        const __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+        const __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+        if constexpr (DCN == 3)
+        {
+            merge3_u8(b8, g8, r8, q);
+        }
+        else
+        {
+            const __m128i a8 = _mm_set1_epi8(static_cast<char>(-1));
+            const __m128i bg0 = _mm_unpacklo_epi8(b8, g8);
+            const __m128i bg1 = _mm_unpackhi_epi8(b8, g8);
+            const __m128i ra0 = _mm_unpacklo_epi8(r8, a8);
+            const __m128i ra1 = _mm_unpackhi_epi8(r8, a8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q), _mm_unpacklo_epi16(bg0, ra0));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q + 16), _mm_unpackhi_epi16(bg0, ra0));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q + 32), _mm_unpacklo_epi16(bg1, ra1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q + 48), _mm_unpackhi_epi16(bg1, ra1));
+        }
+    }
+
+    /**
+     * @brief BGR -> YUV 的 SSE2 系数。与 (b, g) 配对的系数和与 (r, 1) 配对的系数分开存放,
+     * 后者的高位是舍入项, 一次 pmaddwd 同时完成 r 的乘法和舍入。
+     */
+    struct BGR2YUVSimd
+    {
+        __m128i y_bg, y_r;
+        __m128i u_bg, u_r;
+        __m128i v_bg, v_r;
+
+        BGR2YUVSimd(const BGR2YUVCoeffs &k, int chroma_shift)
+            : y_bg(coeff_pair(k.yb, k.yg)), y_r(coeff_pair(k.yr, 1 << (YUV_SHIFT - 1))),
+              u_bg(coeff_pair(k.ub, k.ug)), u_r(coeff_pair(k.ur, 1 << (chroma_shift - 1))),
+              v_bg(coeff_pair(k.vb, k.vg)), v_r(coeff_pair(k.vr, 1 << (chroma_shift - 1))) {}
+    };
+
+    /**
+     * @brief 读入 16 个 BGR(A) 像素并解交错为 16 位的 B/G/R, 下标 0 / 1 为前后 8 个像素。
+     * 用共享的 split3_u8 / split4_u8 解交错, 再扩展为 16 位。
+     */
+    template <int SCN>
+    static inline void load_bgr16(const unsigned char *p, __m128i *b, __m128i *g, __m128i *r)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i b8, g8, r8;
+        if constexpr (SCN == 3)
+        {
+            split3_u8(p, b8, g8, r8);
+        }
+        else
+        {
+            __m128i a8;
+            split4_u8(p, b8, g8, r8, a8);
+        }
+        b[0] = _mm_unpacklo_epi8(b8, zero), b[1] = _mm_unpackhi_epi8(b8, zero);
+        g[0] = _mm_unpacklo_epi8(g8, zero), g[1] = _mm_unpackhi_epi8(g8, zero);
+        r[0] = _mm_unpacklo_epi8(r8, zero), r[1] = _mm_unpackhi_epi8(r8, zero);
+    }
+#endif
+
+    /**
+     * @brief YUV -> BGR(A) 内核, 格式是模板参数, 每种格式的行循环只有一种读取方式, 没有逐像素的分支。
+     * 4:2:0 格式每次处理共用一行色度的两行, 4:2:2 格式逐行处理; 按 (色度) 行并行。
+     * SSE2 时每次转换 16 个像素 (色度样本和 Y 都扩展为 16 位, 用 pmaddwd 乘加), 剩余的像素对逐对计算,
+     * 每个色度样本的三个色度项只计算一次, 结果与 SIMD 部分相同。
+     */
+    template <YUVFormat F, int DCN>
+    static void yuv_to_bgr_kernel(const YUVView &src, Image &dst, const YUV2BGRCoeffs &k)
+    {
+        Image_<unsigned char, DCN> d(dst);
+        const size_t width = src.width;
+        constexpr bool packed = F == YUV_YUYV;
+        constexpr size_t lines = packed ? 1 : 2; // 每个色度行覆盖的图像行数
+        const size_t chroma_rows = packed ? src.height : src.height / 2;
+#if defined(__SSE2__)
+        const YUV2BGRSimd kv(k);
+#endif
+        parallel_for_rows(chroma_rows, lines * width * (DCN + 2), [&](size_t begin, size_t end)
+                          {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const std::ptrdiff_t ii = static_cast<std::ptrdiff_t>(i);
+                // 本色度行覆盖的 Y 行 (YUYV 时为打包的一行) 和输出行
+                const unsigned char *py[lines];
+                unsigned char *q[lines];
+                for (size_t l = 0; l < lines; ++l)
+                {
+                    py[l] = src.y + static_cast<std::ptrdiff_t>(i * lines + l) * src.y_step;
+                    q[l] = d.ptr(i * lines + l);
+                }
+                const unsigned char *pu = packed ? nullptr : src.u + ii * src.u_step;
+                const unsigned char *pv = F == YUV_I420 ? src.v + ii * src.v_step : nullptr;
+                size_t c = 0;
+#if defined(__SSE2__)
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+                for (; c + 16 <= width; c += 16)
+                {
+                    if constexpr (packed)
+                    {
+                        // Y0 U0 Y1 V0 ...: 偶数字节为 Y; 奇数字节每 32 位中低 16 位为 U, 高 16 位为 V
+                        const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(py[0] + 2 * c));
+                        const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(py[0] + 2 * c + 16));
+                        const __m128i c0 = _mm_srli_epi16(p0, 8);
+                        const __m128i c1 = _mm_srli_epi16(p1, 8);
+                        const __m128i low_words = _mm_set1_epi32(0xFFFF);
+                        const __m128i u = _mm_packs_epi32(_mm_and_si128(c0, low_words), _mm_and_si128(c1, low_words));
+                        const __m128i v = _mm_packs_epi32(_mm_srli_epi32(c0, 16), _mm_srli_epi32(c1, 16));
+                        yuv16_to_bgr<DCN>(_mm_and_si128(p0, low_bytes), _mm_and_si128(p1, low_bytes), u, v, kv, q[0] + c * DCN);
+                    }
+                    else
+                    {
+                        __m128i u;
+                        __m128i v;
+                        if constexpr (F == YUV_NV12)
+                        {
+                            const __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pu + c));
+                            u = _mm_and_si128(uv, low_bytes);
+                            v = _mm_srli_epi16(uv, 8);
+                        }
+                        else
+                        {
+                            u = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pu + c / 2)), zero);
+                            v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(pv + c / 2)), zero);
+                        }
+                        for (size_t l = 0; l < 2; ++l)
+                        {
+                            const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(py[l] + c));
+                            yuv16_to_bgr<DCN>(_mm_unpacklo_epi8(y, zero), _mm_unpackhi_epi8(y, zero), u, v, kv, q[l] + c * DCN);
+                        }
+                    }
+                }
+#endif
+                for (; c < width; c += 2)
+                {
+                    int u;
+                    int v;
+                    int ys[lines][2];
+                    if constexpr (packed)
+                    {
+                        const unsigned char *p = py[0] + 2 * c;
+                        ys[0][0] = p[0], u = p[1], ys[0][1] = p[2], v = p[3];
+                    }
+                    else
+                    {
+                        if constexpr (F == YUV_NV12)
+                            u = pu[c], v = pu[c + 1];
+                        else
+                            u = pu[c / 2], v = pv[c / 2];
+                        for (size_t l = 0; l < 2; ++l)
+                            ys[l][0] = py[l][c], ys[l][1] = py[l][c + 1];
+                    }
+                    u -= 128;
+                    v -= 128;
+                    const int b_uv = k.bu * u;
+                    const int g_uv = -k.gu * u - k.gv * v;
+                    const int r_uv = k.rv * v;
+                    for (size_t l = 0; l < lines; ++l)
+                    {
+                        store_bgr<DCN>(q[l] + c * DCN, ys[l][0], b_uv, g_uv, r_uv, k.y);
+                        store_bgr<DCN>(q[l] + (c + 1) * DCN, ys[l][1], b_uv, g_uv, r_uv, k.y);
+                    }
+                }
+            } });
+    }
+
+    /** @brief 按格式分发 yuv_to_bgr_kernel。 */
+    template <int DCN>
+    static void yuv_to_bgr_dispatch(const YUVView &src, Image &dst, const YUV2BGRCoeffs &k)
+    {
+        switch (src.format)
+        {
+        case YUV_NV12:
+            yuv_to_bgr_kernel<YUV_NV12, DCN>(src, dst, k);
+            break;
+        case YUV_I420:
+            yuv_to_bgr_kernel<YUV_I420, DCN>(src, dst, k);
+            break;
+        default:
+            yuv_to_bgr_kernel<YUV_YUYV, DCN>(src, dst, k);
+            break;
+        }
+    }
+
+    /**
+     * @brief BGR(A) -> YUV 内核, 与 yuv_to_bgr_kernel 一样以格式为模板参数, 行循环中没有逐像素的分支。
+     * Y 逐像素计算; 色度用同一色度样本覆盖的 2x2 (4:2:0) 或 2x1 (4:2:2) 像素的 B/G/R 之和计算,
+     * 等价于对各像素的色度取平均。SSE2 时每次处理 16 个像素: 解交错为 16 位的 B/G/R 后用 pmaddwd 计算 Y,
+     * 两行相加再两两水平求和得到色度块的和, 同样用 pmaddwd 计算 U/V; 剩余的像素对逐对计算, 结果与 SIMD 部分相同。
+     */
+    template <YUVFormat F, int SCN>
+    static void bgr_to_yuv_kernel(const Image &src, unsigned char *out, const BGR2YUVCoeffs &k)
+    {
+        Image_<const unsigned char, SCN> s(src);
+        const size_t width = s.cols();
+        const size_t height = s.rows();
+        constexpr bool packed = F == YUV_YUYV;
+        constexpr size_t lines = packed ? 1 : 2;
+        // 2x2 块的和要多右移 2 位, 2x1 块多右移 1 位
+        constexpr int chroma_shift = YUV_SHIFT + (packed ? 1 : 2);
+        const size_t chroma_rows = packed ? height : height / 2;
+        const int half = 1 << (YUV_SHIFT - 1);
+        const int round = 1 << (chroma_shift - 1);
+        unsigned char *plane_y = out;
+        unsigned char *plane_u = out + width * height;
+        unsigned char *plane_v = plane_u + (width / 2) * (height / 2);
+#if defined(__SSE2__)
+        const BGR2YUVSimd kv(k, chroma_shift);
+#endif
+
+        parallel_for_rows(chroma_rows, lines * width * (SCN + 2), [&](size_t begin, size_t end)
+                          {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const unsigned char *ps[lines];
+                for (size_t l = 0; l < lines; ++l)
+                    ps[l] = s.ptr(i * lines + l);
+                size_t c = 0;
+#if defined(__SSE2__)
+                const __m128i one = _mm_set1_epi16(1);
+                const __m128i c16 = _mm_set1_epi16(16);
+                const __m128i c128 = _mm_set1_epi16(128);
+                for (; c + 16 <= width; c += 16)
+                {
+                    __m128i y8[lines];
+                    __m128i sb[2], sg[2], sr[2];
+                    for (size_t l = 0; l < lines; ++l)
+                    {
+                        __m128i b[2], g[2], r[2];
+                        load_bgr16<SCN>(ps[l] + c * SCN, b, g, r);
+                        y8[l] = _mm_packus_epi16(_mm_add_epi16(bgr_madd8<YUV_SHIFT>(b[0], g[0], r[0], kv.y_bg, kv.y_r), c16),
+                                                 _mm_add_epi16(bgr_madd8<YUV_SHIFT>(b[1], g[1], r[1], kv.y_bg, kv.y_r), c16));
+                        for (int h = 0; h < 2; ++h)
+                        {
+                            sb[h] = l == 0 ? b[h] : _mm_add_epi16(sb[h], b[h]);
+                            sg[h] = l == 0 ? g[h] : _mm_add_epi16(sg[h], g[h]);
+                            sr[h] = l == 0 ? r[h] : _mm_add_epi16(sr[h], r[h]);
+                        }
+                    }
+                    // 相邻两列求和, 得到 8 个色度块的和 (最大 4 * 255, 16 位足够)
+                    const __m128i bb = _mm_packs_epi32(_mm_madd_epi16(sb[0], one), _mm_madd_epi16(sb[1], one));
+                    const __m128i gg = _mm_packs_epi32(_mm_madd_epi16(sg[0], one), _mm_madd_epi16(sg[1], one));
+                    const __m128i rr = _mm_packs_epi32(_mm_madd_epi16(sr[0], one), _mm_madd_epi16(sr[1], one));
+                    const __m128i u = _mm_add_epi16(bgr_madd8<chroma_shift>(bb, gg, rr, kv.u_bg, kv.u_r), c128);
+                    const __m128i v = _mm_add_epi16(bgr_madd8<chroma_shift>(bb, gg, rr, kv.v_bg, kv.v_r), c128);
+                    const __m128i uv8 = _mm_packus_epi16(u, v); // 低 8 字节为 U, 高 8 字节为 V
+                    if constexpr (packed)
+                    {
+                        const __m128i uv = _mm_unpacklo_epi8(uv8, _mm_srli_si128(uv8, 8)); // U0 V0 U1 V1 ...
+                        unsigned char *q = out + i * width * 2 + c * 2;
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(q), _mm_unpacklo_epi8(y8[0], uv));
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(q + 16), _mm_unpackhi_epi8(y8[0], uv));
+                    }
+                    else
+                    {
+                        for (size_t l = 0; l < lines; ++l)
+                            _mm_storeu_si128(reinterpret_cast<__m128i *>(plane_y + (2 * i + l) * width + c), y8[l]);
+                        if constexpr (F == YUV_NV12)
+                        {
+                            _mm_storeu_si128(reinterpret_cast<__m128i *>(plane_u + i * width + c), _mm_unpacklo_epi8(uv8, _mm_srli_si128(uv8, 8)));
+                        }
+                        else
+                        {
+                            _mm_storel_epi64(reinterpret_cast<__m128i *>(plane_u + i * (width / 2) + c / 2), uv8);
+                            _mm_storel_epi64(reinterpret_cast<__m128i *>(plane_v + i * (width / 2) + c / 2), _mm_srli_si128(uv8, 8));
+                        }
+                    }
+                }
+#endif
+                for (; c < width; c += 2)
+                {
+                    int sum_b = 0, sum_g = 0, sum_r = 0;
+                    unsigned char ys[lines][2];
+                    for (size_t l = 0; l < lines; ++l)
+                    {
+                        const unsigned char *p = ps[l] + c * SCN;
+                        for (int x = 0; x < 2; ++x)
+                        {
+                            const int b = p[x * SCN], g = p[x * SCN + 1], r = p[x * SCN + 2];
+                            ys[l][x] = clamp_u8(((k.yb * b + k.yg * g + k.yr * r + half) >> YUV_SHIFT) + 16);
+                            sum_b += b, sum_g += g, sum_r += r;
+                        }
+                    }
+                    const unsigned char u = clamp_u8(((k.ub * sum_b + k.ug * sum_g + k.ur * sum_r + round) >> chroma_shift) + 128);
+                    const unsigned char v = clamp_u8(((k.vb * sum_b + k.vg * sum_g + k.vr * sum_r + round) >> chroma_shift) + 128);
+                    if constexpr (packed)
+                    {
+                        unsigned char *q = out + i * width * 2 + c * 2;
+                        q[0] = ys[0][0], q[1] = u, q[2] = ys[0][1], q[3] = v;
+                    }
+                    else
+                    {
+                        for (size_t l = 0; l < lines; ++l)
+                        {
+                            unsigned char *qy = plane_y + (2 * i + l) * width + c;
+                            qy[0] = ys[l][0], qy[1] = ys[l][1];
+                        }
+                        if constexpr (F == YUV_NV12)
+                        {
+                            unsigned char *quv = plane_u + i * width + c;
+                            quv[0] = u, quv[1] = v;
+                        }
+                        else
+                        {
+                            plane_u[i * (width / 2) + c / 2] = u;
+                            plane_v[i * (width / 2) + c / 2] = v;
+                        }
+                    }
+                }
+            } });
+    }
+
+    /** @brief 按格式分发 bgr_to_yuv_kernel。 */
+    template <int SCN>
+    static void bgr_to_yuv_dispatch(const Image &src, unsigned char *out, YUVFormat format, const BGR2YUVCoeffs &k)
+    {
+        switch (format)
+        {
+        case YUV_NV12:
+            bgr_to_yuv_kernel<YUV_NV12, SCN>(src, out, k);
+            break;
+        case YUV_I420:
+            bgr_to_yuv_kernel<YUV_I420, SCN>(src, out, k);
+            break;
+        default:
+            bgr_to_yuv_kernel<YUV_YUYV, SCN>(src, out, k);
+            break;
+        }
+    }
+
+    /**
+     * @brief 检查 YUV 帧的尺寸: 4:2:0 格式要求宽高都是偶数, 4:2:2 格式要求宽是偶数。
+     * @throw std::invalid_argument 如果尺寸无效或格式未知。
+     */
+    static void check_yuv_size(YUVFormat format, size_t width, size_t height, const std::string &F_NAME)
+    {
+        if (format != YUV_NV12 && format != YUV_I420 && format != YUV_YUYV)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "未知的 YUV 格式: " + std::to_string(format));
+        }
+        if (width == 0 || height == 0 || width % 2 != 0 || (format != YUV_YUYV && height % 2 != 0))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "YUV 帧尺寸无效 (宽度必须为偶数, 4:2:0 格式的高度也必须为偶数)。收到 " +
+                                        std::to_string(width) + " x " + std::to_string(height));
+        }
+    }
+
+    size_t YUVView::frame_size(YUVFormat format, size_t width, size_t height)
+    {
+        return format == YUV_YUYV ? width * height * 2 : width * height + 2 * (width / 2) * (height / 2);
+    }
+
+    YUVView YUVView::nv12(const unsigned char *data, size_t width, size_t height)
+    {
+        YUVView view;
+        view.format = YUV_NV12;
+        view.width = width;
+        view.height = height;
+        view.y = data;
+        view.y_step = static_cast<std::ptrdiff_t>(width);
+        view.u = data + width * height;
+        view.u_step = static_cast<std::ptrdiff_t>(width);
+        return view;
+    }
+
+    YUVView YUVView::i420(const unsigned char *data, size_t width, size_t height)
+    {
+        YUVView view;
+        view.format = YUV_I420;
+        view.width = width;
+        view.height = height;
+        view.y = data;
+        view.y_step = static_cast<std::ptrdiff_t>(width);
+        view.u = data + width * height;
+        view.u_step = static_cast<std::ptrdiff_t>(width / 2);
+        view.v = view.u + (width / 2) * (height / 2);
+        view.v_step = static_cast<std::ptrdiff_t>(width / 2);
+        return view;
+    }
+
+    YUVView YUVView::yuyv(const unsigned char *data, size_t width, size_t height)
+    {
+        YUVView view;
+        view.format = YUV_YUYV;
+        view.width = width;
+        view.height = height;
+        view.y = data;
+        view.y_step = static_cast<std::ptrdiff_t>(width * 2);
+        return view;
+    }
+
+    /**
+     * @brief 把 YUV 帧转换为 BGR / BGRA / 灰度图像。
+     * 灰度输出直接复制 Y 平面 (不做范围扩展)。
+     * @param src YUV 帧视图。
+     * @param dst 输出图像。
+     * @param dst_type IMG_8UC3 (BGR), IMG_8UC4 (BGRA, alpha 为 255) 或 IMG_8UC1。
+     * @param matrix 颜色矩阵 (BT.601 / BT.709)。
+     * @throw std::invalid_argument 如果帧尺寸、格式、数据指针或 dst_type 无效。
+     */
+    void yuv_to_bgr(const YUVView &src, Image &dst, int dst_type, YUVMatrix matrix)
+    {
+        const std::string F_NAME = "yuv_to_bgr";
+        check_yuv_size(src.format, src.width, src.height, F_NAME);
+        if (!src.y || (src.format == YUV_NV12 && !src.u) || (src.format == YUV_I420 && (!src.u || !src.v)))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "YUV 帧的平面指针为空。");
+        }
+        if (dst_type != IMG_8UC1 && dst_type != IMG_8UC3 && dst_type != IMG_8UC4)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输出类型必须为 IMG_8UC1 / IMG_8UC3 / IMG_8UC4, 收到 " + std::to_string(dst_type));
+        }
+
+        Image out(src.height, src.width, dst_type);
+        if (dst_type == IMG_8UC1)
+        {
+            Image_<unsigned char, 1> d(out);
+            for (size_t r = 0; r < src.height; ++r)
+            {
+                const unsigned char *py = src.y + static_cast<std::ptrdiff_t>(r) * src.y_step;
+                unsigned char *q = d.ptr(r);
+                if (src.format == YUV_YUYV)
+                {
+                    for (size_t c = 0; c < src.width; ++c)
+                        q[c] = py[2 * c];
+                }
+                else
+                {
+                    std::memcpy(q, py, src.width);
+                }
+            }
+        }
+        else if (dst_type == IMG_8UC3)
+        {
+            yuv_to_bgr_dispatch<3>(src, out, yuv2bgr_coeffs(matrix));
+        }
+        else
+        {
+            yuv_to_bgr_dispatch<4>(src, out, yuv2bgr_coeffs(matrix));
+        }
+        dst = out;
+    }
+
+    /**
+     * @brief 把 BGR / BGRA 图像转换为紧密排列的 YUV 帧 (alpha 通道被忽略)。
+     * @param src IMG_8UC3 或 IMG_8UC4 图像, 尺寸要满足格式的要求 (见 check_yuv_size)。
+     * @param dst 输出缓冲区, 会被调整为 YUVView::frame_size() 字节。
+     * @param format 输出格式。
+     * @param matrix 颜色矩阵 (BT.601 / BT.709)。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入类型或尺寸不符合要求。
+     */
+    void bgr_to_yuv(const Image &src, std::vector<unsigned char> &dst, YUVFormat format, YUVMatrix matrix)
+    {
+        const std::string F_NAME = "bgr_to_yuv";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (src.get_type() != IMG_8UC3 && src.get_type() != IMG_8UC4)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输入类型必须为 IMG_8UC3 / IMG_8UC4, 收到 " + std::to_string(src.get_type()));
+        }
+        check_yuv_size(format, src.get_cols(), src.get_rows(), F_NAME);
+
+        const Image s = pixel_contiguous(src);
+        dst.resize(YUVView::frame_size(format, s.get_cols(), s.get_rows()));
+        if (s.get_channels() == 3)
+            bgr_to_yuv_dispatch<3>(s, dst.data(), format, bgr2yuv_coeffs(matrix));
+        else
+            bgr_to_yuv_dispatch<4>(s, dst.data(), format, bgr2yuv_coeffs(matrix));
+    }
+}
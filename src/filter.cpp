@@ -0,0 +1,829 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace img
+{
+    // 8U 高斯核的定点位数: 系数之和为 2^8, 水平结果 (最大 255 * 256) 正好放进 16 位
+    static const int GAUSSIAN_FIXED_BITS = 8;
+    // 不超过这个尺寸的 8U 高斯核使用定点实现, 与浮点结果最多相差 2 个灰度级 (通常不超过 1)
+    static const int GAUSSIAN_FIXED_MAX_KSIZE = 9;
+    // 自动确定核尺寸且 sigma 不小于这个值时, 使用递归 (IIR) 近似, 计算量与 sigma 无关
+    static const double GAUSSIAN_IIR_MIN_SIGMA = 8.0;
+    // 递归高斯的水平递推每次同时处理的行数, 每行是一个向量通道
+    static const size_t IIR_ROW_GROUP = 16;
+    // 定点垂直滤波每次处理的元素个数, 32 位累加器放在栈上
+    static const size_t GAUSSIAN_CHUNK = 256;
+
+    /**
+     * @brief 行缓冲滤波框架, 按输出行的水平条带并行。
+     * 每个线程用一个 ksize_y 行的环形缓冲区保存 make_row 生成的行 (每行 ring_width 个 B),
+     * 条带开头重新生成上方的 ksize_y - 1 行 (halo), 之后每个输出行只生成一个新行, 中间结果始终留在 L1/L2 中。
+     * make_row(y, B *row, B *scratch) 生成源图像第 y 行对应的行, y 为 -1 表示 BORDER_CONSTANT 的边界行 (全为 0);
+     * combine(const B *const *rows, r, B *scratch) 由按顺序排列的 ksize_y 行计算输出的第 r 行。
+     * scratch 为线程私有的 scratch_width 个 B, 两个回调轮流使用。
+     */
+    template <typename B, typename MakeRow, typename Combine>
+    static void ring_filter_rows(size_t rows, int ksize_y, int anchor_y, BorderType border, size_t ring_width,
+                                 size_t scratch_width, size_t bytes_per_row, MakeRow &&make_row, Combine &&combine)
+    {
+        const int src_rows = static_cast<int>(rows);
+        parallel_for_rows(rows, bytes_per_row, [&](size_t begin, size_t end)
+                          {
+            std::vector<B> ring(static_cast<size_t>(ksize_y) * ring_width);
+            std::vector<B> scratch(scratch_width);
+            std::vector<const B *> window(ksize_y);
+            int next = static_cast<int>(begin) - anchor_y; // 下一个要生成的行 (可能在图像之外)
+            for (size_t r = begin; r < end; ++r)
+            {
+                const int first = static_cast<int>(r) - anchor_y;
+                for (; next < first + ksize_y; ++next)
+                    make_row(border_interpolate(next, src_rows, border), ring.data() + positive_mod(next, ksize_y) * ring_width, scratch.data());
+                for (int k = 0; k < ksize_y; ++k)
+                    window[k] = ring.data() + positive_mod(first + k, ksize_y) * ring_width;
+                combine(window.data(), r, scratch.data());
+            } });
+    }
+
+    /**
+     * @brief 把源图像的第 y 行转换为 W 类型, 左右分别加上 left / right 个边界像素, 写入 buf。
+     * y 为 -1 时整行填 0。x_map 为边界像素对应的源列号 (先左后右, -1 表示填 0)。
+     */
+    template <typename T, int CN, typename W>
+    static void load_bordered_row(const Image_<const T, CN> &s, int y, const std::vector<int> &x_map, int left, W *buf)
+    {
+        const size_t cols = s.cols();
+        const size_t width = (cols + x_map.size()) * CN;
+        if (y < 0)
+        {
+            std::fill_n(buf, width, W(0));
+            return;
+        }
+        const T *p = s.ptr(static_cast<size_t>(y));
+        W *row = buf + static_cast<size_t>(left) * CN;
+        for (size_t i = 0; i < cols * CN; ++i)
+            row[i] = static_cast<W>(p[i]);
+        for (size_t j = 0; j < x_map.size(); ++j)
+        {
+            // 前 left 个为左边界, 其余为右边界
+            W *q = j < static_cast<size_t>(left) ? buf + j * CN : row + (cols + j - left) * CN;
+            for (int k = 0; k < CN; ++k)
+                q[k] = x_map[j] < 0 ? W(0) : row[static_cast<size_t>(x_map[j]) * CN + k];
+        }
+    }
+
+    /** @brief 左边 left 个、右边 right 个边界像素对应的源列号, 布局见 load_bordered_row。 */
+    static std::vector<int> border_columns(size_t cols, int left, int right, BorderType border)
+    {
+        std::vector<int> x_map;
+        x_map.reserve(static_cast<size_t>(left + right));
+        for (int j = 0; j < left; ++j)
+            x_map.push_back(border_interpolate(j - left, static_cast<int>(cols), border));
+        for (int j = 0; j < right; ++j)
+            x_map.push_back(border_interpolate(static_cast<int>(cols) + j, static_cast<int>(cols), border));
+        return x_map;
+    }
+
+    /** @brief 核中的一个非零系数: 相对于窗口左上角的行 dy、列 dx。 */
+    template <typename W>
+    struct KernelTap
+    {
+        int dy;
+        int dx;
+        W coeff;
+    };
+
+    /**
+     * @brief 不可分解的核: 环形缓冲区保存带边界的源行, 每个输出行对每个非零系数做一次整行的乘加
+     * (acc[i] += c * row[i + dx * CN]), 内层循环是连续内存上的向量乘加。
+     */
+    template <typename T, int CN, typename W>
+    static void filter2d_direct(const Image &src, Image &dst, const std::vector<double> &kernel, int kx, int ky,
+                                Point anchor, BorderType border)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const size_t n = s.cols() * CN;
+        std::vector<KernelTap<W>> taps;
+        for (int i = 0; i < ky; ++i)
+        {
+            for (int j = 0; j < kx; ++j)
+            {
+                const double c = kernel[static_cast<size_t>(i) * kx + j];
+                if (c != 0)
+                    taps.push_back({i, j, static_cast<W>(c)});
+            }
+        }
+        const std::vector<int> x_map = border_columns(s.cols(), anchor.x, kx - 1 - anchor.x, border);
+        const size_t ring_width = n + x_map.size() * CN;
+        ring_filter_rows<W>(s.rows(), ky, anchor.y, border, ring_width, n, n * sizeof(T) * (taps.size() + 1),
+                            [&](int y, W *row, W *)
+                            { load_bordered_row<T, CN, W>(s, y, x_map, anchor.x, row); },
+                            [&](const W *const *rows, size_t r, W *a)
+                            {
+                                std::fill_n(a, n, W(0));
+                                for (const KernelTap<W> &t : taps)
+                                {
+                                    const W *p = rows[t.dy] + static_cast<size_t>(t.dx) * CN;
+                                    const W c = t.coeff;
+                                    for (size_t i = 0; i < n; ++i)
+                                        a[i] += c * p[i];
+                                }
+                                store_row<T, W>(a, d.ptr(r), n);
+                            });
+    }
+
+    /**
+     * @brief 可分解的核: 环形缓冲区保存水平滤波后的行, 每个源行只做一次水平滤波,
+     * 每个输出行由 ky 行做一次垂直滤波, 每个像素的乘加次数由 kx * ky 降为 kx + ky。
+     */
+    template <typename T, int CN, typename W>
+    static void sep_filter(const Image &src, Image &dst, const std::vector<W> &kernel_x, const std::vector<W> &kernel_y,
+                           Point anchor, BorderType border)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const size_t n = s.cols() * CN;
+        const int kx = static_cast<int>(kernel_x.size());
+        const int ky = static_cast<int>(kernel_y.size());
+        const std::vector<int> x_map = border_columns(s.cols(), anchor.x, kx - 1 - anchor.x, border);
+        ring_filter_rows<W>(s.rows(), ky, anchor.y, border, n, n + x_map.size() * CN, n * sizeof(T) * (kx + ky),
+                            [&](int y, W *row, W *b)
+                            {
+                                if (y < 0)
+                                {
+                                    std::fill_n(row, n, W(0));
+                                    return;
+                                }
+                                load_bordered_row<T, CN, W>(s, y, x_map, anchor.x, b);
+                                const W c0 = kernel_x[0];
+                                for (size_t i = 0; i < n; ++i)
+                                    row[i] = c0 * b[i];
+                                for (int j = 1; j < kx; ++j)
+                                {
+                                    const W *p = b + static_cast<size_t>(j) * CN;
+                                    const W c = kernel_x[j];
+                                    for (size_t i = 0; i < n; ++i)
+                                        row[i] += c * p[i];
+                                }
+                            },
+                            [&](const W *const *rows, size_t r, W *a)
+                            {
+                                const W c0 = kernel_y[0];
+                                const W *p0 = rows[0];
+                                for (size_t i = 0; i < n; ++i)
+                                    a[i] = c0 * p0[i];
+                                for (int k = 1; k < ky; ++k)
+                                {
+                                    const W *p = rows[k];
+                                    const W c = kernel_y[k];
+                                    for (size_t i = 0; i < n; ++i)
+                                        a[i] += c * p[i];
+                                }
+                                store_row<T, W>(a, d.ptr(r), n);
+                            });
+    }
+
+    /**
+     * @brief 判断 ky x kx 的核是否为秩 1 (kernel(i, j) = col[i] * row[j]), 是时给出分解。
+     * 以绝对值最大的元素所在的行和列为基, 其它元素与乘积的误差都不超过最大绝对值的 1e-6 倍时视为可分解。
+     */
+    static bool separate_kernel(const std::vector<double> &kernel, int kx, int ky,
+                                std::vector<double> &col, std::vector<double> &row)
+    {
+        size_t best = 0;
+        for (size_t i = 1; i < kernel.size(); ++i)
+        {
+            if (std::abs(kernel[i]) > std::abs(kernel[best]))
+                best = i;
+        }
+        const double pivot = kernel[best];
+        if (pivot == 0)
+            return false;
+        const int r0 = static_cast<int>(best / kx);
+        const int c0 = static_cast<int>(best % kx);
+        row.assign(kernel.begin() + static_cast<std::ptrdiff_t>(r0) * kx, kernel.begin() + static_cast<std::ptrdiff_t>(r0 + 1) * kx);
+        col.resize(ky);
+        for (int i = 0; i < ky; ++i)
+            col[i] = kernel[static_cast<size_t>(i) * kx + c0] / pivot;
+        const double tolerance = std::abs(pivot) * 1e-6;
+        for (int i = 0; i < ky; ++i)
+        {
+            for (int j = 0; j < kx; ++j)
+            {
+                if (std::abs(kernel[static_cast<size_t>(i) * kx + j] - col[i] * row[j]) > tolerance)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief 二维相关 (OpenCV 的 filter2D)。
+     * 秩为 1 且宽高都大于 1 的核分解为水平和垂直两个一维滤波, 其它核直接按非零系数做乘加。
+     * 两种方式都按水平条带并行, 只使用几行的缓冲区, 不需要完整的中间图像。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param kernel IMG_32FC1 或 IMG_64FC1 的核。
+     * @param anchor 核中对准输出像素的位置, (-1, -1) 表示核的中心。
+     * @param border 图像之外像素的取法。
+     * @throw std::logic_error 如果输入图像或核为空。
+     * @throw std::invalid_argument 如果核的类型、anchor 或 border 无效。
+     */
+    void filter2D(const Image &src, Image &dst, const Image &kernel, Point anchor, BorderType border)
+    {
+        const std::string F_NAME = "filter2D";
+        if (src.empty() || kernel.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像或核为空。");
+        }
+        if (kernel.get_type() != IMG_32FC1 && kernel.get_type() != IMG_64FC1)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "核必须是 IMG_32FC1 或 IMG_64FC1, 收到 " +
+                                        depth_to_string(kernel.get_depth()) + "C" + std::to_string(kernel.get_channels()));
+        }
+        const int kx = static_cast<int>(kernel.get_cols());
+        const int ky = static_cast<int>(kernel.get_rows());
+        if (anchor.x == -1 && anchor.y == -1)
+            anchor = Point{kx / 2, ky / 2};
+        if (anchor.x < 0 || anchor.x >= kx || anchor.y < 0 || anchor.y >= ky)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "anchor (" + std::to_string(anchor.x) + ", " +
+                                        std::to_string(anchor.y) + ") 不在核内。");
+        }
+        check_border_type(border, F_NAME);
+
+        std::vector<double> coeffs(static_cast<size_t>(kx) * ky);
+        for (int i = 0; i < ky; ++i)
+        {
+            const unsigned char *p = kernel.data() + static_cast<std::ptrdiff_t>(i) * kernel.get_step();
+            for (int j = 0; j < kx; ++j)
+            {
+                coeffs[static_cast<size_t>(i) * kx + j] = kernel.get_depth() == IMG_32F
+                                                              ? reinterpret_cast<const float *>(p)[j]
+                                                              : reinterpret_cast<const double *>(p)[j];
+            }
+        }
+        std::vector<double> col;
+        std::vector<double> row;
+        const bool separable = kx > 1 && ky > 1 && separate_kernel(coeffs, kx, ky, col, row);
+
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), s.get_type());
+        dispatch_type(s.get_type(), [&](auto tag)
+                      {
+            using T = typename decltype(tag)::type;
+            constexpr int CN = decltype(tag)::channels;
+            using W = FilterWork<T>;
+            if (separable)
+                sep_filter<T, CN, W>(s, out, std::vector<W>(row.begin(), row.end()), std::vector<W>(col.begin(), col.end()), anchor, border);
+            else
+                filter2d_direct<T, CN, W>(s, out, coeffs, kx, ky, anchor, border); });
+        dst = out;
+    }
+
+    /** @brief ksize 个元素的一维高斯核 (和为 1)。 */
+    static std::vector<double> gaussian_kernel(int ksize, double sigma)
+    {
+        std::vector<double> kernel(ksize);
+        const int radius = ksize / 2;
+        double total = 0;
+        for (int i = 0; i < ksize; ++i)
+        {
+            const double x = i - radius;
+            kernel[i] = std::exp(-x * x / (2 * sigma * sigma));
+            total += kernel[i];
+        }
+        for (double &c : kernel)
+            c /= total;
+        return kernel;
+    }
+
+    /**
+     * @brief 8U 高斯模糊的定点实现。
+     * 核量化为和正好为 2^8 的整数 (舍入误差补在中心系数上, 保持对称)。水平滤波在 16 位整数中精确累加,
+     * 对称的两个像素先相加再乘系数; 垂直滤波用 32 位累加器, 最后加 2^15 右移 16 位得到结果,
+     * 累加和不超过 255 * 2^16, 不需要饱和。
+     */
+    template <int CN>
+    static void gaussian_blur_8u(const Image &src, Image &dst, const std::vector<double> &kernel, BorderType border)
+    {
+        Image_<const unsigned char, CN> s(src);
+        Image_<unsigned char, CN> d(dst);
+        const int ksize = static_cast<int>(kernel.size());
+        const int radius = ksize / 2;
+        const size_t n = s.cols() * CN;
+
+        std::vector<std::uint16_t> q(ksize);
+        int total = 0;
+        for (int i = 0; i < ksize; ++i)
+        {
+            q[i] = static_cast<std::uint16_t>(std::lround(kernel[i] * (1 << GAUSSIAN_FIXED_BITS)));
+            total += q[i];
+        }
+        q[radius] = static_cast<std::uint16_t>(q[radius] + (1 << GAUSSIAN_FIXED_BITS) - total);
+
+        const std::vector<int> x_map = border_columns(s.cols(), radius, radius, border);
+        ring_filter_rows<std::uint16_t>(s.rows(), ksize, radius, border, n, n + x_map.size() * CN, n * (ksize + 1),
+                                        [&](int y, std::uint16_t *row, std::uint16_t *b)
+                                        {
+                                            if (y < 0)
+                                            {
+                                                std::fill_n(row, n, std::uint16_t(0));
+                                                return;
+                                            }
+                                            load_bordered_row<unsigned char, CN, std::uint16_t>(s, y, x_map, radius, b);
+                                            const std::uint16_t *c = b + static_cast<size_t>(radius) * CN;
+                                            const std::uint16_t q0 = q[radius];
+                                            for (size_t i = 0; i < n; ++i)
+                                                row[i] = static_cast<std::uint16_t>(q0 * c[i]);
+                                            for (int j = 1; j <= radius; ++j)
+                                            {
+                                                const std::uint16_t qj = q[radius + j];
+                                                const std::uint16_t *left = c - static_cast<size_t>(j) * CN;
+                                                const std::uint16_t *right = c + static_cast<size_t>(j) * CN;
+                                                for (size_t i = 0; i < n; ++i)
+                                                    row[i] = static_cast<std::uint16_t>(row[i] + qj * (left[i] + right[i]));
+                                            }
+                                        },
+                                        [&](const std::uint16_t *const *rows, size_t r, std::uint16_t *)
+                                        {
+                                            unsigned char *out = d.ptr(r);
+                                            std::uint32_t acc[GAUSSIAN_CHUNK];
+                                            for (size_t i0 = 0; i0 < n; i0 += GAUSSIAN_CHUNK)
+                                            {
+                                                const size_t len = std::min(GAUSSIAN_CHUNK, n - i0);
+                                                const std::uint16_t *c = rows[radius] + i0;
+                                                const std::uint32_t q0 = q[radius];
+                                                for (size_t i = 0; i < len; ++i)
+                                                    acc[i] = q0 * c[i];
+                                                for (int j = 1; j <= radius; ++j)
+                                                {
+                                                    const std::uint32_t qj = q[radius + j];
+                                                    const std::uint16_t *up = rows[radius - j] + i0;
+                                                    const std::uint16_t *down = rows[radius + j] + i0;
+                                                    for (size_t i = 0; i < len; ++i)
+                                                        acc[i] += qj * (static_cast<std::uint32_t>(up[i]) + down[i]);
+                                                }
+                                                for (size_t i = 0; i < len; ++i)
+                                                    out[i0 + i] = static_cast<unsigned char>((acc[i] + (1u << 15)) >> 16);
+                                            }
+                                        });
+    }
+
+    /**
+     * @brief Young & van Vliet 三阶递归高斯滤波的系数:
+     * w[n] = b * x[n] + a1 * w[n - 1] + a2 * w[n - 2] + a3 * w[n - 3], 正向一遍、反向一遍。
+     * m 为 Triggs & Sdika 的反向初值矩阵 (已乘以 b), 见 iir_backward_init。
+     */
+    struct IirCoeffs
+    {
+        double b;
+        double a1;
+        double a2;
+        double a3;
+        double m[3][3];
+    };
+
+    static IirCoeffs young_van_vliet(double sigma)
+    {
+        const double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1 - 0.26891 * sigma);
+        const double q2 = q * q;
+        const double q3 = q2 * q;
+        const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+        const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+        const double b3 = 0.422205 * q3;
+        IirCoeffs k{1 - (b1 + b2 + b3) / b0, b1 / b0, b2 / b0, b3 / b0, {}};
+        const double a1 = k.a1;
+        const double a2 = k.a2;
+        const double a3 = k.a3;
+        const double scale = k.b / ((1 + a1 - a2 + a3) * (1 - a1 - a2 - a3) * (1 + a2 + (a1 - a3) * a3));
+        const double m[3][3] = {{-a3 * a1 + 1 - a3 * a3 - a2, (a3 + a1) * (a2 + a3 * a1), a3 * (a1 + a3 * a2)},
+                                {a1 + a3 * a2, -(a2 - 1) * (a2 + a3 * a1), -(a3 * a1 + a3 * a3 + a2 - 1) * a3},
+                                {a3 * a1 + a2 + a1 * a1 - a2 * a2, a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3, a3 * (a1 + a3 * a2)}};
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                k.m[i][j] = m[i][j] * scale;
+        }
+        return k;
+    }
+
+    /**
+     * @brief 反向递推的初值 (Triggs & Sdika 2006): 图像之外的输入等于最后一个输入 u 时,
+     * 正向结果在末尾之后按齐次递推收敛到 u, 反向结果 y[N - 1], y[N], y[N + 1] 与 u 的差
+     * 是正向最后三个结果 w[N - 1], w[N - 2], w[N - 3] 与 u 的差的线性组合。
+     * m 的元素随 sigma 增大 (sigma = 100 时约为 2000), 所以用 double 计算以免抵消误差。
+     */
+    template <typename W>
+    static inline void iir_backward_init(const IirCoeffs &k, W u, W w1, W w2, W w3, W *y)
+    {
+        const double e[3] = {static_cast<double>(w1) - u, static_cast<double>(w2) - u, static_cast<double>(w3) - u};
+        for (int i = 0; i < 3; ++i)
+            y[i] = static_cast<W>(u + k.m[i][0] * e[0] + k.m[i][1] * e[1] + k.m[i][2] * e[2]);
+    }
+
+    /**
+     * @brief 沿行方向的递推: 每次取 IIR_ROW_GROUP 行转置到 tile 中 (tile[元素][行]), 这些行作为向量的各个通道
+     * 同时递推, 依赖链之间互相独立, 内层循环跨行向量化。结果写入 W 类型的 buf。
+     * tile 末尾多出两个元素的位置, 存放反向递推在图像之外的初值 y[cols], y[cols + 1]。
+     */
+    template <typename T, int CN, typename W>
+    static void iir_rows(const Image &src, Image &buf, const IirCoeffs &k)
+    {
+        Image_<const T, CN> s(src);
+        Image_<W, CN> d(buf);
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        const size_t n = cols * CN;
+        const size_t G = IIR_ROW_GROUP;
+        const W b = static_cast<W>(k.b);
+        const W a1 = static_cast<W>(k.a1);
+        const W a2 = static_cast<W>(k.a2);
+        const W a3 = static_cast<W>(k.a3);
+        const size_t groups = (rows + G - 1) / G;
+        parallel_for_rows(groups, G * n * (sizeof(T) + sizeof(W) * 3), [&](size_t begin, size_t end)
+                          {
+            std::vector<W> tile((n + 2 * CN) * G);
+            std::vector<W> last(CN * G);
+            for (size_t g = begin; g < end; ++g)
+            {
+                const size_t r0 = g * G;
+                const size_t count = std::min(G, rows - r0);
+                for (size_t j = 0; j < G; ++j)
+                {
+                    const T *p = s.ptr(r0 + std::min(j, count - 1));
+                    for (size_t e = 0; e < n; ++e)
+                        tile[e * G + j] = static_cast<W>(p[e]);
+                }
+                std::copy(tile.begin() + (n - CN) * G, tile.begin() + n * G, last.begin());
+                // 左侧图像之外的像素等于第 0 个像素, 正向递推处于稳态, 第 0 个像素保持不变
+                for (size_t x = 1; x < cols; ++x)
+                {
+                    const size_t x1 = x - 1;
+                    const size_t x2 = x >= 2 ? x - 2 : 0;
+                    const size_t x3 = x >= 3 ? x - 3 : 0;
+                    for (int c = 0; c < CN; ++c)
+                    {
+                        W *t = tile.data() + (x * CN + c) * G;
+                        const W *t1 = tile.data() + (x1 * CN + c) * G;
+                        const W *t2 = tile.data() + (x2 * CN + c) * G;
+                        const W *t3 = tile.data() + (x3 * CN + c) * G;
+                        for (size_t j = 0; j < G; ++j)
+                            t[j] = b * t[j] + a1 * t1[j] + a2 * t2[j] + a3 * t3[j];
+                    }
+                }
+                // 右侧不是稳态 (正向结果落后于输入), 最后一个像素和图像之外的两个初值由 iir_backward_init 给出
+                const size_t l1 = cols - 1;
+                const size_t l2 = cols >= 2 ? cols - 2 : 0;
+                const size_t l3 = cols >= 3 ? cols - 3 : 0;
+                for (int c = 0; c < CN; ++c)
+                {
+                    for (size_t j = 0; j < G; ++j)
+                    {
+                        W y[3];
+                        iir_backward_init<W>(k, last[c * G + j], tile[(l1 * CN + c) * G + j], tile[(l2 * CN + c) * G + j],
+                                             tile[(l3 * CN + c) * G + j], y);
+                        for (size_t i = 0; i < 3; ++i)
+                            tile[((l1 + i) * CN + c) * G + j] = y[i];
+                    }
+                }
+                for (size_t x = cols - 1; x-- > 0;)
+                {
+                    for (int c = 0; c < CN; ++c)
+                    {
+                        W *t = tile.data() + (x * CN + c) * G;
+                        const W *t1 = tile.data() + ((x + 1) * CN + c) * G;
+                        const W *t2 = tile.data() + ((x + 2) * CN + c) * G;
+                        const W *t3 = tile.data() + ((x + 3) * CN + c) * G;
+                        for (size_t j = 0; j < G; ++j)
+                            t[j] = b * t[j] + a1 * t1[j] + a2 * t2[j] + a3 * t3[j];
+                    }
+                }
+                for (size_t j = 0; j < count; ++j)
+                {
+                    W *q = d.ptr(r0 + j);
+                    for (size_t e = 0; e < n; ++e)
+                        q[e] = tile[e * G + j];
+                }
+            } });
+    }
+
+    /**
+     * @brief 在 W 类型的图像上沿列方向做正向和反向递推, 按列分条并行。
+     * 内层循环沿一行连续, 可以向量化; 图像之外的行等于边界行 (BORDER_REPLICATE):
+     * 正向从稳态开始, 反向的初值由 iir_backward_init 给出, 图像之外的两行存放在 below 中。
+     */
+    template <typename W>
+    static void iir_columns(Image &img, const IirCoeffs &k)
+    {
+        const size_t rows = img.get_rows();
+        const size_t n = img.get_cols() * img.get_channels();
+        const W b = static_cast<W>(k.b);
+        const W a1 = static_cast<W>(k.a1);
+        const W a2 = static_cast<W>(k.a2);
+        const W a3 = static_cast<W>(k.a3);
+        unsigned char *base = img.data();
+        const std::ptrdiff_t step = img.get_step();
+        auto row = [&](std::ptrdiff_t y)
+        {
+            y = std::max<std::ptrdiff_t>(0, std::min<std::ptrdiff_t>(static_cast<std::ptrdiff_t>(rows) - 1, y));
+            return reinterpret_cast<W *>(base + y * step);
+        };
+        const size_t stripes = std::max<size_t>(1, std::min(num_threads(), n / 16));
+        parallel_for_rows(stripes, rows * n * sizeof(W) * 2 / stripes, [&](size_t begin, size_t end)
+                          {
+            const size_t i0 = n * begin / stripes;
+            const size_t i1 = n * end / stripes;
+            const std::vector<W> last(row(static_cast<std::ptrdiff_t>(rows) - 1) + i0, row(static_cast<std::ptrdiff_t>(rows) - 1) + i1);
+            std::vector<W> below(2 * n);
+            // 第 0 行的正向结果等于它本身
+            for (std::ptrdiff_t y = 1; y < static_cast<std::ptrdiff_t>(rows); ++y)
+            {
+                W *p = row(y);
+                const W *p1 = row(y - 1);
+                const W *p2 = row(y - 2);
+                const W *p3 = row(y - 3);
+                for (size_t i = i0; i < i1; ++i)
+                    p[i] = b * p[i] + a1 * p1[i] + a2 * p2[i] + a3 * p3[i];
+            }
+            const std::ptrdiff_t last_row = static_cast<std::ptrdiff_t>(rows) - 1;
+            {
+                W *p = row(last_row);
+                const W *p2 = row(last_row - 1);
+                const W *p3 = row(last_row - 2);
+                for (size_t i = i0; i < i1; ++i)
+                {
+                    W y[3];
+                    iir_backward_init<W>(k, last[i - i0], p[i], p2[i], p3[i], y);
+                    p[i] = y[0];
+                    below[i] = y[1];
+                    below[n + i] = y[2];
+                }
+            }
+            // 反向第 y 行用到的第 y + 1 .. y + 3 行可能是 below 中图像之外的行
+            auto back_row = [&](std::ptrdiff_t y) -> const W *
+            {
+                if (y <= last_row)
+                    return row(y);
+                return below.data() + static_cast<size_t>(y - last_row - 1) * n;
+            };
+            for (std::ptrdiff_t y = last_row - 1; y >= 0; --y)
+            {
+                W *p = row(y);
+                const W *p1 = back_row(y + 1);
+                const W *p2 = back_row(y + 2);
+                const W *p3 = back_row(y + 3);
+                for (size_t i = i0; i < i1; ++i)
+                    p[i] = b * p[i] + a1 * p1[i] + a2 * p2[i] + a3 * p3[i];
+            } });
+    }
+
+    /**
+     * @brief 大 sigma 的递归高斯近似, 每个像素的计算量与 sigma 无关。
+     * 中间结果为 W 类型 (float, 32S / 64F 为 double) 的完整图像: 先逐组行做水平递推, 再按列分条做垂直递推。
+     */
+    template <typename T, int CN, typename W>
+    static void gaussian_iir(const Image &src, Image &dst, double sigma)
+    {
+        const IirCoeffs k = young_van_vliet(sigma);
+        Image buf(src.get_rows(), src.get_cols(), Image_<W, CN>::type);
+        iir_rows<T, CN, W>(src, buf, k);
+        iir_columns<W>(buf, k);
+        Image_<W, CN> b(buf);
+        Image_<T, CN> d(dst);
+        const size_t n = b.cols() * CN;
+        parallel_for_rows(b.rows(), n * (sizeof(T) + sizeof(W)), [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+                store_row<T, W>(b.ptr(r), d.ptr(r), n); });
+    }
+
+    /**
+     * @brief 高斯模糊。
+     * - 8U 且 ksize <= 9: 定点实现 (gaussian_blur_8u);
+     * - ksize 为 0, sigma >= 8 且 border 为 BORDER_REPLICATE: 递归近似 (gaussian_iir), 其边界处理只能是复制边缘,
+     *   因此其它 border 仍走有限长的核;
+     * - 其它: 浮点的可分解滤波 (sep_filter)。
+     * 有限长的实现都按水平条带并行, 每个线程重新计算条带上方的 halo 行。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param ksize 核的尺寸, 正奇数; 为 0 时由 sigma 确定 (8U 为 6 * sigma + 1, 其它为 8 * sigma + 1, 取奇数)。
+     * @param sigma 标准差; <= 0 时由 ksize 确定: 0.3 * ((ksize - 1) * 0.5 - 1) + 0.8。
+     * @param border 图像之外像素的取法。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 ksize、sigma 或 border 无效。
+     */
+    void gaussian_blur(const Image &src, Image &dst, int ksize, double sigma, BorderType border)
+    {
+        const std::string F_NAME = "gaussian_blur";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (ksize < 0 || (ksize > 0 && ksize % 2 == 0) || (ksize == 0 && !(sigma > 0)))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "ksize 必须是正奇数, 或为 0 并给出正的 sigma。收到 ksize = " +
+                                        std::to_string(ksize) + ", sigma = " + std::to_string(sigma));
+        }
+        check_border_type(border, F_NAME);
+        const bool use_iir = ksize == 0 && sigma >= GAUSSIAN_IIR_MIN_SIGMA && border == BORDER_REPLICATE;
+        if (ksize == 0)
+            ksize = static_cast<int>(std::lround(sigma * (src.get_depth() == IMG_8U ? 3 : 4) * 2 + 1)) | 1;
+        if (!(sigma > 0))
+            sigma = 0.3 * ((ksize - 1) * 0.5 - 1) + 0.8;
+
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), s.get_type());
+        if (use_iir)
+        {
+            dispatch_type(s.get_type(), [&](auto tag)
+                          {
+                using T = typename decltype(tag)::type;
+                gaussian_iir<T, decltype(tag)::channels, FilterWork<T>>(s, out, sigma); });
+        }
+        else if (s.get_depth() == IMG_8U && ksize <= GAUSSIAN_FIXED_MAX_KSIZE)
+        {
+            const std::vector<double> kernel = gaussian_kernel(ksize, sigma);
+            dispatch_channels<unsigned char>(s.get_channels(), [&](auto tag)
+                                             { gaussian_blur_8u<decltype(tag)::channels>(s, out, kernel, border); });
+        }
+        else
+        {
+            const std::vector<double> kernel = gaussian_kernel(ksize, sigma);
+            const Point anchor{ksize / 2, ksize / 2};
+            dispatch_type(s.get_type(), [&](auto tag)
+                          {
+                using T = typename decltype(tag)::type;
+                using W = FilterWork<T>;
+                const std::vector<W> k(kernel.begin(), kernel.end());
+                sep_filter<T, decltype(tag)::channels, W>(s, out, k, k, anchor, border); });
+        }
+        dst = out;
+    }
+
+    // 盒式滤波的累加类型: 8 位整数用 int, 其它整数用 int64, 都是精确的; 浮点数用 double, 滑动加减的误差可以忽略
+    template <typename T>
+    using BoxSum = typename std::conditional<std::is_integral<T>::value && sizeof(T) == 1, int,
+                                             typename std::conditional<std::is_integral<T>::value, std::int64_t, double>::type>::type;
+
+    /**
+     * @brief 盒式滤波内核, 按输出行的水平条带并行。
+     * 每个源行先做一次水平的滑动和 (每个像素一次加一次减), 放入 ky 行的环形缓冲区;
+     * 列和 colsum 随输出行下移, 每行加上新进入的行、减去离开的行, 这一步跨列连续, 可以向量化。
+     * 每个像素的计算量与窗口大小无关。
+     */
+    template <typename T, int CN, typename D>
+    static void box_filter_kernel(const Image &src, Image &dst, Size ksize, Point anchor, bool normalize, BorderType border)
+    {
+        using S = BoxSum<T>;
+        using R = FilterWork<D>;
+        Image_<const T, CN> s(src);
+        Image_<D, CN> d(dst);
+        const int kx = ksize.width;
+        const int ky = ksize.height;
+        const size_t cols = s.cols();
+        const size_t n = cols * CN;
+        const int src_rows = static_cast<int>(s.rows());
+        const std::vector<int> x_map = border_columns(cols, anchor.x, kx - 1 - anchor.x, border);
+        const R scale = static_cast<R>(normalize ? 1.0 / (static_cast<double>(kx) * ky) : 1.0);
+
+        parallel_for_rows(s.rows(), n * (sizeof(T) + sizeof(D)) * 2, [&](size_t begin, size_t end)
+                          {
+            std::vector<S> bordered(n + x_map.size() * CN);
+            std::vector<std::vector<S>> ring(ky, std::vector<S>(n));
+            std::vector<S> incoming(n);
+            std::vector<S> colsum(n, S(0));
+            std::vector<R> out_row(n);
+            // 第 v 行 (可能在图像之外) 的水平滑动和
+            auto row_sum = [&](int v, S *q)
+            {
+                const int y = border_interpolate(v, src_rows, border);
+                if (y < 0)
+                {
+                    std::fill_n(q, n, S(0));
+                    return;
+                }
+                load_bordered_row<T, CN, S>(s, y, x_map, anchor.x, bordered.data());
+                const S *b = bordered.data();
+                S acc[CN] = {};
+                for (int j = 0; j < kx; ++j)
+                {
+                    for (int k = 0; k < CN; ++k)
+                        acc[k] += b[j * CN + k];
+                }
+                for (size_t x = 0; x + 1 < cols; ++x)
+                {
+                    for (int k = 0; k < CN; ++k)
+                    {
+                        q[x * CN + k] = acc[k];
+                        acc[k] += b[(x + kx) * CN + k] - b[x * CN + k];
+                    }
+                }
+                for (int k = 0; k < CN; ++k)
+                    q[(cols - 1) * CN + k] = acc[k];
+            };
+
+            const int first = static_cast<int>(begin) - anchor.y;
+            for (int k = 0; k < ky; ++k)
+            {
+                S *row = ring[positive_mod(first + k, ky)].data();
+                row_sum(first + k, row);
+                for (size_t i = 0; i < n; ++i)
+                    colsum[i] += row[i];
+            }
+            for (size_t r = begin; r < end; ++r)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    out_row[i] = static_cast<R>(colsum[i]) * scale;
+                store_row<D, R>(out_row.data(), d.ptr(r), n);
+                if (r + 1 == end)
+                    break;
+                // 离开窗口的行与新进入的行在环形缓冲区中是同一个位置
+                const int leaving = static_cast<int>(r) - anchor.y;
+                row_sum(leaving + ky, incoming.data());
+                std::vector<S> &old = ring[positive_mod(leaving, ky)];
+                const S *in = incoming.data();
+                const S *out = old.data();
+                S *c = colsum.data();
+                for (size_t i = 0; i < n; ++i)
+                    c[i] += in[i] - out[i];
+                old.swap(incoming);
+            } });
+    }
+
+    /**
+     * @brief 盒式滤波 (窗口内的和或均值)。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 通道数与 src 相同, 可以与 src 是同一个对象。
+     * @param ddepth 输出深度: -1 表示与 src 相同, 或为 IMG_32S (src 为整数时)、IMG_32F、IMG_64F。
+     * @param ksize 窗口尺寸, 宽高都至少为 1。
+     * @param anchor 窗口中对准输出像素的位置, (-1, -1) 表示窗口中心。
+     * @param normalize 为 true 时输出均值, 否则输出和 (整数输出饱和)。
+     * @param border 图像之外像素的取法。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 ddepth、ksize、anchor 或 border 无效。
+     */
+    void box_filter(const Image &src, Image &dst, int ddepth, Size ksize, Point anchor, bool normalize, BorderType border)
+    {
+        const std::string F_NAME = "box_filter";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (ksize.width <= 0 || ksize.height <= 0)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "窗口尺寸无效: " + std::to_string(ksize.width) + " x " +
+                                        std::to_string(ksize.height));
+        }
+        if (anchor.x == -1 && anchor.y == -1)
+            anchor = Point{ksize.width / 2, ksize.height / 2};
+        if (anchor.x < 0 || anchor.x >= ksize.width || anchor.y < 0 || anchor.y >= ksize.height)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "anchor (" + std::to_string(anchor.x) + ", " +
+                                        std::to_string(anchor.y) + ") 不在窗口内。");
+        }
+        check_border_type(border, F_NAME);
+        const int depth = src.get_depth();
+        if (ddepth < 0)
+            ddepth = depth;
+        const bool integer_src = !(depth == IMG_32F || depth == IMG_64F || depth == IMG_16F);
+        if (!(ddepth == depth || ddepth == IMG_32F || ddepth == IMG_64F || (ddepth == IMG_32S && integer_src)))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的输出深度 " + depth_to_string(ddepth) +
+                                        " (输入为 " + depth_to_string(depth) + ")");
+        }
+
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), IMG_MAKETYPE(ddepth, s.get_channels()));
+        dispatch_type(s.get_type(), [&](auto tag)
+                      {
+            using T = typename decltype(tag)::type;
+            constexpr int CN = decltype(tag)::channels;
+            if (ddepth == depth)
+                box_filter_kernel<T, CN, T>(s, out, ksize, anchor, normalize, border);
+            else if (ddepth == IMG_32S)
+                box_filter_kernel<T, CN, int>(s, out, ksize, anchor, normalize, border);
+            else if (ddepth == IMG_32F)
+                box_filter_kernel<T, CN, float>(s, out, ksize, anchor, normalize, border);
+            else
+                box_filter_kernel<T, CN, double>(s, out, ksize, anchor, normalize, border); });
+        dst = out;
+    }
+
+    /**
+     * @brief 均值滤波, 等价于 box_filter(src, dst, -1, ksize, anchor, true, border)。
+     * 参数和异常同 box_filter。
+     */
+    void blur(const Image &src, Image &dst, Size ksize, Point anchor, BorderType border)
+    {
+        box_filter(src, dst, -1, ksize, anchor, true, border);
+    }
+}
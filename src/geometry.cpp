@@ -0,0 +1,253 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+namespace img
+{
+    // 按像素字节数选择寄存器内转置的微内核, size 为微内核处理的方块边长 (0 表示没有 SIMD 版本)
+    // 只搬运字节, 与通道类型无关: 例如 8UC4 和 32FC1 都是 4 字节像素, 共用同一个微内核
+    template <size_t PIXEL_SIZE>
+    struct MicroTranspose
+    {
+        static constexpr size_t size = 0;
+        static void apply(const unsigned char *, std::ptrdiff_t, unsigned char *, std::ptrdiff_t) {}
+    };
+
+#if defined(__SSE2__)
+    // 1 字节像素: 8x8 方块, 三轮 unpack (8 位 -> 16 位 -> 32 位) 完成转置
+    template <>
+    struct MicroTranspose<1>
+    {
+        static constexpr size_t size = 8;
+        static void apply(const unsigned char *src, std::ptrdiff_t sstep, unsigned char *dst, std::ptrdiff_t dstep)
+        {
+            __m128i r[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i * sstep));
+            }
+            const __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+            const __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+            const __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+            const __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+            const __m128i b0 = _mm_unpacklo_epi16(a0, a1); // 第 0-3 列, 第 0-3 行
+            const __m128i b1 = _mm_unpackhi_epi16(a0, a1); // 第 4-7 列, 第 0-3 行
+            const __m128i b2 = _mm_unpacklo_epi16(a2, a3); // 第 0-3 列, 第 4-7 行
+            const __m128i b3 = _mm_unpackhi_epi16(a2, a3); // 第 4-7 列, 第 4-7 行
+            const __m128i c[4] = {_mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+                                  _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)};
+            for (int i = 0; i < 4; ++i)
+            {
+                // 每个 c[i] 的低 8 字节和高 8 字节分别是转置后的一行
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + (2 * i) * dstep), c[i]);
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + (2 * i + 1) * dstep), _mm_srli_si128(c[i], 8));
+            }
+        }
+    };
+
+    // 4 字节像素: 4x4 方块, 用 _MM_TRANSPOSE4_PS 在寄存器内转置 (按位搬运, 对 32S / 8UC4 同样适用)
+    template <>
+    struct MicroTranspose<4>
+    {
+        static constexpr size_t size = 4;
+        static void apply(const unsigned char *src, std::ptrdiff_t sstep, unsigned char *dst, std::ptrdiff_t dstep)
+        {
+            __m128 r0 = _mm_loadu_ps(reinterpret_cast<const float *>(src));
+            __m128 r1 = _mm_loadu_ps(reinterpret_cast<const float *>(src + sstep));
+            __m128 r2 = _mm_loadu_ps(reinterpret_cast<const float *>(src + 2 * sstep));
+            __m128 r3 = _mm_loadu_ps(reinterpret_cast<const float *>(src + 3 * sstep));
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(reinterpret_cast<float *>(dst), r0);
+            _mm_storeu_ps(reinterpret_cast<float *>(dst + dstep), r1);
+            _mm_storeu_ps(reinterpret_cast<float *>(dst + 2 * dstep), r2);
+            _mm_storeu_ps(reinterpret_cast<float *>(dst + 3 * dstep), r3);
+        }
+    };
+#endif
+
+    /**
+     * @brief 转置 src 中 [i0, i1) x [j0, j1) 的一个块: d(j, i) = s(i, j)。
+     * 块内先用寄存器内转置的微内核处理完整的小方块, 剩下的边角逐像素复制。
+     */
+    template <typename T, int CN>
+    static void transpose_tile(const Image_<const T, CN> &s, const Image_<T, CN> &d,
+                               size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+        using Pixel = Vec<T, CN>;
+        using Micro = MicroTranspose<sizeof(Pixel)>;
+        constexpr size_t M = Micro::size;
+        size_t i = i0;
+        if (M > 0)
+        {
+            for (; i + M <= i1; i += M)
+            {
+                size_t j = j0;
+                for (; j + M <= j1; j += M)
+                {
+                    Micro::apply(reinterpret_cast<const unsigned char *>(s(i, j)), s.step(),
+                                 reinterpret_cast<unsigned char *>(d(j, i)), d.step());
+                }
+                for (; j < j1; ++j)
+                {
+                    for (size_t ii = i; ii < i + M; ++ii)
+                    {
+                        *reinterpret_cast<Pixel *>(d(j, ii)) = *reinterpret_cast<const Pixel *>(s(ii, j));
+                    }
+                }
+            }
+        }
+        for (; i < i1; ++i)
+        {
+            for (size_t j = j0; j < j1; ++j)
+            {
+                *reinterpret_cast<Pixel *>(d(j, i)) = *reinterpret_cast<const Pixel *>(s(i, j));
+            }
+        }
+    }
+
+    /**
+     * @brief 分块转置: 把图像切成 B x B 的块, 每个块的源和目标 (各约 4KB) 都能留在 L1 中,
+     * 避免逐列写目标时的缓存和 TLB 缺失。按块行并行。
+     * dst 可以是行翻转视图 (负行步长), rotate 利用这一点一次完成转置和翻转。
+     */
+    template <typename T, int CN>
+    static void transpose_kernel(const Image &src, Image &dst)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        constexpr size_t PS = sizeof(T) * CN;
+        constexpr size_t B = PS <= 1 ? 64 : (PS <= 4 ? 32 : 16);
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        const size_t tile_rows = (rows + B - 1) / B;
+        parallel_for_rows(tile_rows, B * cols * PS, [&](size_t begin, size_t end)
+                          {
+            for (size_t ti = begin; ti < end; ++ti)
+            {
+                const size_t i0 = ti * B;
+                const size_t i1 = std::min(rows, i0 + B);
+                for (size_t j0 = 0; j0 < cols; j0 += B)
+                {
+                    transpose_tile<T, CN>(s, d, i0, i1, j0, std::min(cols, j0 + B));
+                }
+            } });
+    }
+
+    /** @brief 翻转: 行翻转时倒序读取行, 列翻转时每行内倒序复制像素。按行并行。 */
+    template <typename T, int CN>
+    static void flip_kernel(const Image &src, Image &dst, bool flip_rows, bool flip_cols)
+    {
+        using Pixel = Vec<T, CN>;
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        parallel_for_rows(rows, cols * sizeof(Pixel), [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                const Pixel *ps = s.pixels(flip_rows ? rows - 1 - r : r).data();
+                Pixel *pd = d.pixels(r).data();
+                if (!flip_cols)
+                {
+                    std::memcpy(pd, ps, cols * sizeof(Pixel));
+                    continue;
+                }
+                for (size_t c = 0; c < cols; ++c)
+                {
+                    pd[c] = ps[cols - 1 - c];
+                }
+            } });
+    }
+
+    /**
+     * @brief 转置图像 (行列互换), 结果尺寸为 cols x rows。
+     * @param src 输入图像, 支持所有深度和通道数。
+     * @param dst 输出图像, 可以与 src 是同一个对象。
+     * @throw std::logic_error 如果输入图像为空。
+     */
+    void transpose(const Image &src, Image &dst)
+    {
+        const std::string F_NAME = "transpose";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_cols(), s.get_rows(), s.get_type());
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { transpose_kernel<typename decltype(tag)::type, decltype(tag)::channels>(s, out); });
+        dst = out;
+    }
+
+    /**
+     * @brief 翻转图像。
+     * @param src 输入图像, 支持所有深度和通道数。
+     * @param dst 输出图像, 可以与 src 是同一个对象。
+     * @param flip_code FLIP_VERTICAL 上下翻转, FLIP_HORIZONTAL 左右翻转, FLIP_BOTH 两者都做。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 flip_code 无效。
+     */
+    void flip(const Image &src, Image &dst, FlipCode flip_code)
+    {
+        const std::string F_NAME = "flip";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (flip_code != FLIP_BOTH && flip_code != FLIP_VERTICAL && flip_code != FLIP_HORIZONTAL)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的翻转方式: " + std::to_string(flip_code));
+        }
+        const bool flip_rows = flip_code != FLIP_HORIZONTAL;
+        const bool flip_cols = flip_code != FLIP_VERTICAL;
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), s.get_type());
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { flip_kernel<typename decltype(tag)::type, decltype(tag)::channels>(s, out, flip_rows, flip_cols); });
+        dst = out;
+    }
+
+    /**
+     * @brief 按 90 度的整数倍顺时针旋转图像。
+     * 90/270 度通过把转置的输入或输出换成行翻转视图实现, 只需要一遍分块转置:
+     *   顺时针 90 度  = transpose(src.flip_rows())
+     *   顺时针 270 度 = transpose(src) 写入 dst.flip_rows()
+     * @param src 输入图像, 支持所有深度和通道数。
+     * @param dst 输出图像, 可以与 src 是同一个对象。
+     * @param rotate_code ROTATE_90 / ROTATE_180 / ROTATE_270。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 rotate_code 无效。
+     */
+    void rotate(const Image &src, Image &dst, RotateCode rotate_code)
+    {
+        const std::string F_NAME = "rotate";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (rotate_code == ROTATE_180)
+        {
+            flip(src, dst, FLIP_BOTH);
+            return;
+        }
+        if (rotate_code != ROTATE_90 && rotate_code != ROTATE_270)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的旋转方式: " + std::to_string(rotate_code));
+        }
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_cols(), s.get_rows(), s.get_type());
+        const Image in_view = rotate_code == ROTATE_90 ? s.flip_rows() : s;
+        Image out_view = rotate_code == ROTATE_90 ? out : out.flip_rows();
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { transpose_kernel<typename decltype(tag)::type, decltype(tag)::channels>(in_view, out_view); });
+        dst = out;
+    }
+}
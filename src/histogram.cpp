@@ -0,0 +1,507 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+namespace img
+{
+    // 每个通道使用的子直方图个数: 相邻像素写入不同的子直方图, 连续相同的值 (平坦区域) 不会反复
+    // 读写同一个计数器, 避免每次自增都等待上一次的存储 (store-to-load forwarding 停顿), 最后再相加
+    static const int HIST_SUBS = 4;
+
+    /**
+     * @brief 建立 值 -> 区间下标 的查找表, 覆盖 levels 个可能的输入值。
+     * 范围之外的值映射到额外的 "丢弃" 区间 (下标为 bins), 统计时不需要任何分支。
+     */
+    static std::vector<int> build_bin_lut(size_t levels, int bins, double range_min, double range_max)
+    {
+        std::vector<int> lut(levels);
+        const double scale = bins / (range_max - range_min);
+        for (size_t v = 0; v < levels; ++v)
+        {
+            const double x = static_cast<double>(v);
+            if (x < range_min || x >= range_max)
+                lut[v] = bins;
+            else
+                lut[v] = std::min(bins - 1, static_cast<int>((x - range_min) * scale));
+        }
+        return lut;
+    }
+
+    /**
+     * @brief 把 [r0, r1) 行累加到子直方图 sub 中。
+     * sub 的布局为 [通道][子直方图][bins + 1], 第 c 个像素写入第 c % HIST_SUBS 个子直方图;
+     * mask 为零的像素通过按元素选择写入丢弃区间。
+     */
+    template <typename T, int CN, bool MASKED>
+    static void hist_rows(const Image_<const T, CN> &s, const Image &mask, size_t r0, size_t r1,
+                          const int *lut, int bins, unsigned int *sub)
+    {
+        const size_t stride = static_cast<size_t>(bins) + 1;
+        const size_t cols = s.cols();
+        for (size_t r = r0; r < r1; ++r)
+        {
+            const T *p = s.ptr(r);
+            const unsigned char *m = MASKED ? mask.data() + static_cast<std::ptrdiff_t>(r) * mask.get_step() : nullptr;
+            auto count = [&](int u, size_t c)
+            {
+                const bool on = !MASKED || m[c] != 0;
+                for (int k = 0; k < CN; ++k)
+                {
+                    const int b = on ? lut[p[c * CN + k]] : bins;
+                    ++sub[(static_cast<size_t>(k) * HIST_SUBS + u) * stride + b];
+                }
+            };
+            size_t c = 0;
+            for (; c + HIST_SUBS <= cols; c += HIST_SUBS)
+            {
+                for (int u = 0; u < HIST_SUBS; ++u)
+                    count(u, c + u);
+            }
+            for (; c < cols; ++c)
+                count(0, c);
+        }
+    }
+
+    /**
+     * @brief 按行并行统计直方图。每个线程使用私有的子直方图 (32 位计数),
+     * 每处理不超过 2^31 个像素就并入线程私有的 64 位直方图, 最后在锁内合并到结果中。
+     */
+    template <typename T, int CN>
+    static void calc_hist_kernel(const Image &src, const Image &mask, const std::vector<int> &lut, int bins,
+                                 std::vector<std::vector<size_t>> &hist)
+    {
+        Image_<const T, CN> s(src);
+        const bool masked = !mask.empty();
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        const size_t stride = static_cast<size_t>(bins) + 1;
+        const size_t batch_rows = std::max<size_t>(1, (static_cast<size_t>(1) << 31) / cols);
+        std::mutex merge_mutex;
+        parallel_for_rows(rows, cols * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            std::vector<unsigned int> sub(CN * HIST_SUBS * stride);
+            std::vector<size_t> local(CN * static_cast<size_t>(bins), 0);
+            for (size_t r0 = begin; r0 < end; r0 += batch_rows)
+            {
+                const size_t r1 = std::min(end, r0 + batch_rows);
+                std::fill(sub.begin(), sub.end(), 0u);
+                if (masked)
+                    hist_rows<T, CN, true>(s, mask, r0, r1, lut.data(), bins, sub.data());
+                else
+                    hist_rows<T, CN, false>(s, mask, r0, r1, lut.data(), bins, sub.data());
+                for (int k = 0; k < CN; ++k)
+                {
+                    for (int u = 0; u < HIST_SUBS; ++u)
+                    {
+                        const unsigned int *h = sub.data() + (static_cast<size_t>(k) * HIST_SUBS + u) * stride;
+                        size_t *out = local.data() + static_cast<size_t>(k) * bins;
+                        for (int b = 0; b < bins; ++b)
+                            out[b] += h[b];
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            for (int k = 0; k < CN; ++k)
+            {
+                for (int b = 0; b < bins; ++b)
+                    hist[k][b] += local[static_cast<size_t>(k) * bins + b];
+            } });
+    }
+
+    /**
+     * @brief 计算每个通道的直方图。
+     * 值到区间的映射预先算成查找表, 所以任意的 bins 和范围都与默认的 256 个区间一样快。
+     * @param src IMG_8U 或 IMG_16U 图像, 支持 ROI 等视图。
+     * @param hist 输出, 调整为 src.get_channels() 个长度为 bins 的直方图。
+     * @param bins 区间个数, 1 到 65536。
+     * @param range_min 统计范围的下界 (包含)。
+     * @param range_max 统计范围的上界 (不包含)。
+     * @param mask 可选的掩码, 为空图像时统计所有像素。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果深度不受支持、bins 或范围无效、mask 不符合要求。
+     */
+    void calc_hist(const Image &src, std::vector<std::vector<size_t>> &hist, int bins,
+                   double range_min, double range_max, const Image &mask)
+    {
+        const std::string F_NAME = "calc_hist";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (src.get_depth() != IMG_8U && src.get_depth() != IMG_16U)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 IMG_8U / IMG_16U 图像, 收到 " + depth_to_string(src.get_depth()));
+        }
+        if (bins <= 0 || bins > 65536)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "区间个数必须在 1 到 65536 之间, 收到 " + std::to_string(bins));
+        }
+        if (!(range_min < range_max))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "统计范围无效: [" + std::to_string(range_min) + ", " + std::to_string(range_max) + ")");
+        }
+        if (!mask.empty())
+        {
+            Image::check_mask(src, mask, F_NAME);
+        }
+
+        const Image s = pixel_contiguous(src);
+        const Image m = mask.empty() ? Image() : pixel_contiguous(mask);
+        const size_t levels = s.get_depth() == IMG_8U ? 256 : 65536;
+        const std::vector<int> lut = build_bin_lut(levels, bins, range_min, range_max);
+        std::vector<std::vector<size_t>> result(s.get_channels(), std::vector<size_t>(bins, 0));
+        if (s.get_depth() == IMG_8U)
+        {
+            dispatch_channels<unsigned char>(s.get_channels(), [&](auto tag)
+                                             { calc_hist_kernel<unsigned char, decltype(tag)::channels>(s, m, lut, bins, result); });
+        }
+        else
+        {
+            dispatch_channels<unsigned short>(s.get_channels(), [&](auto tag)
+                                              { calc_hist_kernel<unsigned short, decltype(tag)::channels>(s, m, lut, bins, result); });
+        }
+        hist = std::move(result);
+    }
+
+    template <int CN>
+    static void lut_kernel(const Image &src, Image &dst, const unsigned char *table)
+    {
+        Image_<const unsigned char, CN> s(src);
+        Image_<unsigned char, CN> d(dst);
+        const size_t n = s.cols() * CN;
+        parallel_for_rows(s.rows(), n * 2, [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                const unsigned char *p = s.ptr(r);
+                unsigned char *q = d.ptr(r);
+                for (size_t i = 0; i < n; ++i)
+                    q[i] = table[p[i]];
+            } });
+    }
+
+    /**
+     * @brief 查找表变换: dst 的每个元素为 table[src 的对应元素]。
+     * @param src IMG_8U 图像, 支持所有通道数。
+     * @param table 256 项的查找表, 所有通道共用。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入深度不是 IMG_8U 或查找表不是 256 项。
+     */
+    void lut(const Image &src, const std::vector<unsigned char> &table, Image &dst)
+    {
+        const std::string F_NAME = "lut";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (src.get_depth() != IMG_8U)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 IMG_8U 图像, 收到 " + depth_to_string(src.get_depth()));
+        }
+        if (table.size() != 256)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "查找表必须有 256 项, 收到 " + std::to_string(table.size()) + " 项。");
+        }
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), s.get_type());
+        dispatch_channels<unsigned char>(s.get_channels(), [&](auto tag)
+                                         { lut_kernel<decltype(tag)::channels>(s, out, table.data()); });
+        dst = out;
+    }
+
+    /**
+     * @brief 由直方图计算均衡化的查找表: 累积分布线性映射到 [0, 255], 最小的出现值映射到 0。
+     * 只有一种值的图像保持不变。
+     */
+    static std::vector<unsigned char> equalize_table(const std::vector<size_t> &hist)
+    {
+        std::vector<unsigned char> table(256);
+        size_t total = 0;
+        for (size_t h : hist)
+            total += h;
+        int first = 0;
+        while (first < 256 && hist[first] == 0)
+            ++first;
+        if (first == 256 || hist[first] == total)
+        {
+            for (int v = 0; v < 256; ++v)
+                table[v] = static_cast<unsigned char>(v);
+            return table;
+        }
+        const double scale = 255.0 / static_cast<double>(total - hist[first]);
+        size_t acc = 0;
+        for (int v = first + 1; v < 256; ++v)
+        {
+            acc += hist[v];
+            table[v] = truncate_value<unsigned char>(acc * scale);
+        }
+        return table;
+    }
+
+    /**
+     * @brief CLAHE 中一个块的查找表: 直方图在 clip_limit 倍平均高度处截断,
+     * 截掉的部分平均分给所有区间 (余数隔固定间隔分配), 再按累积分布映射到 [0, 255]。
+     */
+    static void clahe_tile_table(std::vector<size_t> hist, size_t area, double clip_limit, unsigned char *table)
+    {
+        if (clip_limit > 0)
+        {
+            const size_t limit = std::max<size_t>(1, static_cast<size_t>(clip_limit * area / 256));
+            size_t excess = 0;
+            for (size_t &h : hist)
+            {
+                if (h > limit)
+                {
+                    excess += h - limit;
+                    h = limit;
+                }
+            }
+            const size_t batch = excess / 256;
+            size_t residual = excess % 256;
+            for (size_t &h : hist)
+                h += batch;
+            if (residual > 0)
+            {
+                const size_t step = std::max<size_t>(256 / residual, 1);
+                for (size_t v = 0; v < 256 && residual > 0; v += step, --residual)
+                    ++hist[v];
+            }
+        }
+        const double scale = 255.0 / static_cast<double>(area);
+        size_t acc = 0;
+        for (int v = 0; v < 256; ++v)
+        {
+            acc += hist[v];
+            table[v] = truncate_value<unsigned char>(acc * scale);
+        }
+    }
+
+    /**
+     * @brief 统计从 p 开始、每行 step 字节的 w x h 个 8U 像素的直方图到 hist (256 个区间)。
+     * 直接读指针, 不构造 Image 视图: 它在并行区域的线程中调用, Image 的拷贝会并发修改共享的引用计数。
+     */
+    static void tile_hist(const unsigned char *p, std::ptrdiff_t step, size_t w, size_t h, std::vector<size_t> &hist)
+    {
+        size_t sub[HIST_SUBS][256] = {};
+        for (size_t r = 0; r < h; ++r, p += step)
+        {
+            size_t c = 0;
+            for (; c + HIST_SUBS <= w; c += HIST_SUBS)
+            {
+                for (int u = 0; u < HIST_SUBS; ++u)
+                    ++sub[u][p[c + u]];
+            }
+            for (; c < w; ++c)
+                ++sub[0][p[c]];
+        }
+        hist.assign(256, 0);
+        for (int u = 0; u < HIST_SUBS; ++u)
+        {
+            for (int v = 0; v < 256; ++v)
+                hist[v] += sub[u][v];
+        }
+    }
+
+    /**
+     * @brief 单通道 8U 图像的 CLAHE。
+     * 第一步按块行并行, 用 tile_hist 统计每个块并生成查找表;
+     * 第二步按行并行, 每个像素在相邻四个块的查找表之间双线性插值。
+     * 每列对应的左右块和权重只与列号有关, 预先算好, 内层循环只剩四次查表和乘加。
+     */
+    static void clahe_gray(const Image &src, Image &dst, double clip_limit, int tiles_x, int tiles_y)
+    {
+        const Image s = pixel_contiguous(src);
+        const size_t rows = s.get_rows();
+        const size_t cols = s.get_cols();
+        const size_t tx_count = static_cast<size_t>(tiles_x);
+        const size_t ty_count = static_cast<size_t>(tiles_y);
+        std::vector<unsigned char> tables(tx_count * ty_count * 256);
+        const unsigned char *base = s.data();
+        const std::ptrdiff_t step = s.get_step();
+
+        parallel_for_rows(ty_count, rows / ty_count * cols, [&](size_t begin, size_t end)
+                          {
+            std::vector<size_t> hist;
+            for (size_t ty = begin; ty < end; ++ty)
+            {
+                const size_t y0 = rows * ty / ty_count;
+                const size_t y1 = rows * (ty + 1) / ty_count;
+                for (size_t tx = 0; tx < tx_count; ++tx)
+                {
+                    const size_t x0 = cols * tx / tx_count;
+                    const size_t x1 = cols * (tx + 1) / tx_count;
+                    tile_hist(base + static_cast<std::ptrdiff_t>(y0) * step + x0, step, x1 - x0, y1 - y0, hist);
+                    clahe_tile_table(hist, (x1 - x0) * (y1 - y0), clip_limit, tables.data() + (ty * tx_count + tx) * 256);
+                }
+            } });
+
+        // 像素中心相对于块中心的位置: t = (x + 0.5) / 块宽 - 0.5, 左右块为 floor(t) 和 floor(t) + 1 (边界处夹到有效范围)
+        const float inv_tw = static_cast<float>(tx_count) / static_cast<float>(cols);
+        const float inv_th = static_cast<float>(ty_count) / static_cast<float>(rows);
+        std::vector<size_t> left(cols);
+        std::vector<size_t> right(cols);
+        std::vector<float> wx(cols);
+        for (size_t x = 0; x < cols; ++x)
+        {
+            const float t = (static_cast<float>(x) + 0.5f) * inv_tw - 0.5f;
+            const int t1 = static_cast<int>(std::floor(t));
+            wx[x] = t - static_cast<float>(t1);
+            left[x] = static_cast<size_t>(std::max(t1, 0)) * 256;
+            right[x] = static_cast<size_t>(std::min(t1 + 1, tiles_x - 1)) * 256;
+        }
+
+        Image out(rows, cols, IMG_8UC1);
+        Image_<const unsigned char, 1> sv(s);
+        Image_<unsigned char, 1> dv(out);
+        parallel_for_rows(rows, cols * 2, [&](size_t begin, size_t end)
+                          {
+            for (size_t y = begin; y < end; ++y)
+            {
+                const float t = (static_cast<float>(y) + 0.5f) * inv_th - 0.5f;
+                const int t1 = static_cast<int>(std::floor(t));
+                const float wy = t - static_cast<float>(t1);
+                const unsigned char *top = tables.data() + static_cast<size_t>(std::max(t1, 0)) * tx_count * 256;
+                const unsigned char *bottom = tables.data() + static_cast<size_t>(std::min(t1 + 1, tiles_y - 1)) * tx_count * 256;
+                const unsigned char *p = sv.ptr(y);
+                unsigned char *q = dv.ptr(y);
+                for (size_t x = 0; x < cols; ++x)
+                {
+                    const unsigned char v = p[x];
+                    const float a = top[left[x] + v] + wx[x] * (top[right[x] + v] - top[left[x] + v]);
+                    const float b = bottom[left[x] + v] + wx[x] * (bottom[right[x] + v] - bottom[left[x] + v]);
+                    q[x] = static_cast<unsigned char>(a + wy * (b - a) + 0.5f);
+                }
+            } });
+        dst = out;
+    }
+
+    /** @brief dst 的 B/G/R 为 src 加上亮度的变化量 (y_new - y) 后饱和, alpha 不变。 */
+    template <int CN>
+    static void luma_delta_kernel(const Image &src, const Image &y, const Image &y_new, Image &dst)
+    {
+        Image_<const unsigned char, CN> s(src);
+        Image_<const unsigned char, 1> yv(y);
+        Image_<const unsigned char, 1> nv(y_new);
+        Image_<unsigned char, CN> d(dst);
+        const size_t cols = s.cols();
+        parallel_for_rows(s.rows(), cols * (CN * 2 + 2), [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                const unsigned char *p = s.ptr(r);
+                const unsigned char *py = yv.ptr(r);
+                const unsigned char *pn = nv.ptr(r);
+                unsigned char *q = d.ptr(r);
+                for (size_t c = 0; c < cols; ++c)
+                {
+                    const int delta = static_cast<int>(pn[c]) - static_cast<int>(py[c]);
+                    for (int k = 0; k < 3; ++k)
+                        q[c * CN + k] = static_cast<unsigned char>(std::min(255, std::max(0, p[c * CN + k] + delta)));
+                    if (CN == 4)
+                        q[c * CN + 3] = p[c * CN + 3];
+                }
+            } });
+    }
+
+    /**
+     * @brief 对 8U 图像执行单通道的均衡化 op(in, out)。
+     * 单通道图像直接执行; EQUALIZE_PER_CHANNEL 时对 B/G/R 各自执行 (alpha 不变);
+     * EQUALIZE_LUMA 时只对亮度执行, 再把亮度的变化量加到 B/G/R 上, 相当于在 YCrCb 空间中只修改 Y。
+     */
+    template <typename Op>
+    static void equalize_with_mode(const Image &src, Image &dst, EqualizeMode mode, Op op)
+    {
+        const int cn = src.get_channels();
+        if (cn == 1)
+        {
+            op(src, dst);
+            return;
+        }
+        if (mode == EQUALIZE_PER_CHANNEL)
+        {
+            std::vector<Image> planes;
+            split(src, planes);
+            for (int k = 0; k < 3; ++k)
+                op(planes[k], planes[k]);
+            merge(planes, dst);
+            return;
+        }
+        Image y;
+        cvt_color(src, y, cn == 3 ? COLOR_BGR2GRAY : COLOR_BGRA2GRAY);
+        Image y_new;
+        op(y, y_new);
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), s.get_type());
+        if (cn == 3)
+            luma_delta_kernel<3>(s, y, y_new, out);
+        else
+            luma_delta_kernel<4>(s, y, y_new, out);
+        dst = out;
+    }
+
+    /** @brief equalize_hist 和 clahe 共用的输入检查。 */
+    static void check_equalize_input(const Image &src, EqualizeMode mode, const std::string &F_NAME)
+    {
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (src.get_depth() != IMG_8U)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 IMG_8U 图像, 收到 " + depth_to_string(src.get_depth()));
+        }
+        if (mode != EQUALIZE_LUMA && mode != EQUALIZE_PER_CHANNEL)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的均衡化方式: " + std::to_string(mode));
+        }
+    }
+
+    /**
+     * @brief 全局直方图均衡化: 由 calc_hist 的结果生成查找表, 再用 lut 一遍完成映射。
+     * @param src IMG_8U 图像, 1/3/4 通道。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param mode 多通道图像的处理方式, 见 EqualizeMode。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入深度不是 IMG_8U 或 mode 无效。
+     */
+    void equalize_hist(const Image &src, Image &dst, EqualizeMode mode)
+    {
+        check_equalize_input(src, mode, "equalize_hist");
+        equalize_with_mode(src, dst, mode, [](const Image &in, Image &out)
+                           {
+            std::vector<std::vector<size_t>> hist;
+            calc_hist(in, hist);
+            lut(in, equalize_table(hist[0]), out); });
+    }
+
+    /**
+     * @brief 限制对比度的自适应直方图均衡化 (CLAHE)。
+     * @param src IMG_8U 图像, 1/3/4 通道。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param clip_limit 截断阈值, 为每块直方图平均高度 (块像素数 / 256) 的倍数; <= 0 时不截断。
+     * @param tiles_x 水平方向的块数, 1 到图像宽度。
+     * @param tiles_y 垂直方向的块数, 1 到图像高度。
+     * @param mode 多通道图像的处理方式, 见 EqualizeMode。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入深度不是 IMG_8U、块数无效或 mode 无效。
+     */
+    void clahe(const Image &src, Image &dst, double clip_limit, int tiles_x, int tiles_y, EqualizeMode mode)
+    {
+        const std::string F_NAME = "clahe";
+        check_equalize_input(src, mode, F_NAME);
+        if (tiles_x <= 0 || tiles_y <= 0 ||
+            static_cast<size_t>(tiles_x) > src.get_cols() || static_cast<size_t>(tiles_y) > src.get_rows())
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "块数无效 (必须在 1 到图像尺寸之间)。收到 " +
+                                        std::to_string(tiles_x) + " x " + std::to_string(tiles_y));
+        }
+        equalize_with_mode(src, dst, mode, [&](const Image &in, Image &out)
+                           { clahe_gray(in, out, clip_limit, tiles_x, tiles_y); });
+    }
+}
@@ -1,4 +1,5 @@
 #include "../include/imglib.h"
+#include "image_internal.h"
 #include <cstring>
 #include <stdexcept>
 #include <algorithm>
@@ -34,6 +35,12 @@ namespace img
             return "IMG_32F";
         case IMG_64F:
             return "IMG_64F";
+        case IMG_16F:
+            return "IMG_16F";
+        case IMG_8S:
+            return "IMG_8S";
+        case IMG_16S:
+            return "IMG_16S";
         default:
             return "未知深度";
         }
@@ -71,6 +78,7 @@ namespace img
         m_type = -1;
         m_channel_size = 0;
         m_step = 0;
+        m_pixel_step = 0;
         m_data_start = nullptr;
         m_datastorage = nullptr; // m_datastorage 指向的内存（如果是对齐块的一部分）已随原始块释放
     }
@@ -81,11 +89,12 @@ namespace img
      * @param rows 图像的行数。
      * @param cols 图像的列数。
      * @param type 图像类型。
+     * @param zero_init 是否把像素数据清零。紧接着会被完整覆盖的场合 (例如 clone) 传 false 可以省掉一次写内存。
      * @throw std::invalid_argument 如果图像类型无效、维度无效、或无法确定通道大小。
      * @throw std::overflow_error 如果内存大小计算发生溢出。
      * @throw std::runtime_error 如果内存分配失败或手动对齐失败。
      */
-    void Image::allocate(size_t rows, size_t cols, int type)
+    void Image::allocate(size_t rows, size_t cols, int type, bool zero_init)
     {
         const std::string F_NAME = "";
         if (type < 0)
@@ -119,6 +128,15 @@ namespace img
         case IMG_64F:
             channel_size = 8;
             break;
+        case IMG_16F:
+            channel_size = 2;
+            break;
+        case IMG_8S:
+            channel_size = 1;
+            break;
+        case IMG_16S:
+            channel_size = 2;
+            break;
         default:
             throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的图像深度类型。收到 type: " + std::to_string(type) + " (解析出的深度: " + depth_to_string(depth) + ")");
         }
@@ -170,7 +188,8 @@ namespace img
         try
         {
             // 值初始化 () 会将分配的内存清零
-            original_raw_ptr = new unsigned char[allocation_request_size]();
+            original_raw_ptr = zero_init ? new unsigned char[allocation_request_size]()
+                                         : new unsigned char[allocation_request_size];
             // 在release函数中会delete[] original_raw_ptr
         }
         catch (const std::bad_alloc &e)
@@ -209,7 +228,8 @@ namespace img
         m_cols = cols;
         m_type = type;
         m_channel_size = channel_size;
-        m_step = step;
+        m_step = static_cast<std::ptrdiff_t>(step);
+        m_pixel_step = pixel_size;
     }
 
     /** @brief 默认构造函数。创建一个空的 Image 对象。 */
@@ -219,6 +239,7 @@ namespace img
           m_type(-1),
           m_channel_size(0),
           m_step(0),
+          m_pixel_step(0),
           m_data_start(nullptr),
           m_datastorage(nullptr),
           m_refcount(nullptr)
@@ -238,6 +259,7 @@ namespace img
           m_type(-1),
           m_channel_size(0),
           m_step(0),
+          m_pixel_step(0),
           m_data_start(nullptr),
           m_datastorage(nullptr),
           m_refcount(nullptr)
@@ -270,6 +292,7 @@ namespace img
           m_type(other.m_type),
           m_channel_size(other.m_channel_size),
           m_step(other.m_step),
+          m_pixel_step(other.m_pixel_step),
           m_data_start(other.m_data_start),
           m_datastorage(other.m_datastorage),
           m_refcount(other.m_refcount)
@@ -296,6 +319,7 @@ namespace img
           m_type(other.m_type),
           m_channel_size(other.m_channel_size),
           m_step(other.m_step),
+          m_pixel_step(other.m_pixel_step),
           m_data_start(other.m_data_start),
           m_datastorage(other.m_datastorage),
           m_refcount(other.m_refcount)
@@ -309,6 +333,7 @@ namespace img
         other.m_type = -1;
         other.m_channel_size = 0;
         other.m_step = 0;
+        other.m_pixel_step = 0;
         other.m_data_start = nullptr;
         other.m_datastorage = nullptr;
         other.m_refcount = nullptr;
@@ -343,6 +368,7 @@ namespace img
         m_type = other.m_type;
         m_channel_size = other.m_channel_size;
         m_step = other.m_step;
+        m_pixel_step = other.m_pixel_step;
         m_data_start = other.m_data_start;
         m_datastorage = other.m_datastorage;
         m_refcount = other.m_refcount;
@@ -371,6 +397,7 @@ namespace img
         m_type = other.m_type;
         m_channel_size = other.m_channel_size;
         m_step = other.m_step;
+        m_pixel_step = other.m_pixel_step;
         m_data_start = other.m_data_start;
         m_datastorage = other.m_datastorage;
         m_refcount = other.m_refcount;
@@ -380,6 +407,7 @@ namespace img
         other.m_type = -1;
         other.m_channel_size = 0;
         other.m_step = 0;
+        other.m_pixel_step = 0;
         other.m_data_start = nullptr;
         other.m_datastorage = nullptr;
         other.m_refcount = nullptr;
@@ -413,10 +441,58 @@ namespace img
         }
     }
 
+    /**
+     * @brief 内部辅助函数：逐行复制两幅同尺寸同类型图像的有效像素数据。
+     * 只复制每行 cols * pixel_size 字节, 不会读取 ROI 之外的数据; 两幅图像都连续时合并成一次复制。
+     * 任一方的行内像素不紧密排列时 (列下采样/单通道视图), 逐像素复制。
+     * 复制量超过最后一级缓存时使用 streaming 存储, 避免把调用者的工作集挤出缓存。
+     */
+    static void copy_pixels(const Image &src, Image &dst)
+    {
+        const size_t row_bytes = src.get_cols() * src.get_pixel_size();
+        const size_t rows = src.get_rows();
+        const bool stream = row_bytes * rows > last_level_cache_size();
+        const unsigned char *ps = src.data();
+        unsigned char *pd = dst.data();
+
+        if (src.is_continuous() && dst.is_continuous())
+        {
+            copy_bytes(pd, ps, row_bytes * rows, stream);
+        }
+        else if (src.is_pixel_contiguous() && dst.is_pixel_contiguous())
+        {
+            for (size_t r = 0; r < rows; ++r)
+            {
+                const std::ptrdiff_t ri = static_cast<std::ptrdiff_t>(r);
+                copy_bytes(pd + ri * dst.get_step(), ps + ri * src.get_step(), row_bytes, stream);
+            }
+        }
+        else
+        {
+            const size_t pixel_size = src.get_pixel_size();
+            for (size_t r = 0; r < rows; ++r)
+            {
+                const std::ptrdiff_t ri = static_cast<std::ptrdiff_t>(r);
+                const unsigned char *s_row = ps + ri * src.get_step();
+                unsigned char *d_row = pd + ri * dst.get_step();
+                for (size_t c = 0; c < src.get_cols(); ++c)
+                {
+                    std::memcpy(d_row + c * dst.get_pixel_step(), s_row + c * src.get_pixel_step(), pixel_size);
+                }
+            }
+            return;
+        }
+        if (stream)
+        {
+            stream_fence();
+        }
+    }
+
     /**
      * @brief 创建图像的深拷贝（克隆）。
      * 分配新的内存（包括新的引用计数），并将当前图像的像素数据完整复制过去。
      * 返回的新 Image 对象拥有独立的数据副本，其引用计数初始化为1。
+     * 对 ROI 视图只复制 ROI 内的数据, 结果总是连续存储的 (step == cols * pixel_size)。
      * 声明为const,因为clone不会改变原来的对象
      * @return 一个包含独立数据的新 Image 对象。
      * @throw std::logic_error 如果原始图像为空，无法克隆有效数据 (尽管技术上可以克隆一个空图像)。
@@ -432,21 +508,101 @@ namespace img
         Image new_image; // 调用默认构造函数
         try
         {
-            // create 将调用 allocate，后者会分配新的 m_datastorage（含引用计数）
-            // 并设置 new_image 的所有成员。
-            new_image.create(m_rows, m_cols, m_type);
+            // 数据马上会被完整覆盖, 不需要清零
+            new_image.allocate(m_rows, m_cols, m_type, false);
         }
         catch (const std::exception &e)
         {
             throw std::runtime_error(IMG_ERROR_PREFIX(F_NAME) + "克隆时创建新图像失败. 原始错误: " + e.what());
         }
 
-        if (m_data_start && new_image.m_data_start && m_rows > 0 && m_cols > 0) // 确保行列都大于0
+        copy_pixels(*this, new_image);
+        return new_image;
+    }
+
+    /**
+     * @brief 把当前图像的像素数据复制到 dst。
+     * 如果 dst 的尺寸和类型与当前图像相同, 直接写入 dst 现有的内存 (dst 可以是 ROI 视图,
+     * 此时会修改其父图像的对应区域); 否则 dst 会被重新分配为连续存储的新图像。
+     * 源和目标指向同一块数据时不做任何事。源和目标部分重叠时结果未定义。
+     * @param dst 目标图像。
+     * @throw std::logic_error 如果当前图像为空。
+     * @throw std::runtime_error 如果为 dst 分配内存失败。
+     */
+    void Image::copy_to(Image &dst) const
+    {
+        const std::string F_NAME = "copy_to";
+        if (empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法复制一个空的图像。");
+        }
+        if (dst.m_data_start == m_data_start && dst.m_step == m_step && dst.m_pixel_step == m_pixel_step &&
+            dst.m_rows == m_rows && dst.m_cols == m_cols && dst.m_type == m_type)
+        {
+            return;
+        }
+        if (dst.empty() || dst.m_rows != m_rows || dst.m_cols != m_cols || dst.m_type != m_type)
+        {
+            dst = this->clone();
+            return;
+        }
+        copy_pixels(*this, dst);
+    }
+
+    /**
+     * @brief 只把 mask 中非零位置的像素复制到 dst, 其余位置保持 dst 原来的值。
+     * 如果 dst 的尺寸或类型与当前图像不同, dst 会先被重新分配并清零。
+     * @param dst 目标图像。
+     * @param mask 与当前图像同尺寸的 IMG_8UC1 掩码。
+     * @throw std::logic_error 如果当前图像或掩码为空。
+     * @throw std::invalid_argument 如果掩码类型或尺寸不符合要求。
+     */
+    void Image::copy_to(Image &dst, const Image &mask) const
+    {
+        const std::string F_NAME = "copy_to";
+        check_mask(*this, mask, F_NAME);
+        if (dst.empty() || dst.m_rows != m_rows || dst.m_cols != m_cols || dst.m_type != m_type)
+        {
+            dst.create(m_rows, m_cols, m_type);
+        }
+        dispatch_type(m_type, [&](auto tag)
+                      { copy_masked_kernel<typename decltype(tag)::type, decltype(tag)::channels>(*this, dst, mask); });
+    }
+
+    /**
+     * @brief 把图像的所有像素设置为 value (第 k 个通道取 value[k], 整数类型会饱和处理)。
+     * 对 ROI 视图只修改 ROI 内的像素。
+     * @param value 每个通道的值。
+     * @return 对当前对象的引用。
+     * @throw std::logic_error 如果图像为空。
+     */
+    Image &Image::set_to(const Scalar &value)
+    {
+        const std::string F_NAME = "set_to";
+        if (empty())
         {
-            std::memcpy(new_image.m_data_start, m_data_start, m_rows * m_step);
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法填充空图像。");
         }
+        dispatch_type(m_type, [&](auto tag)
+                      { fill_kernel<typename decltype(tag)::type, decltype(tag)::channels>(*this, value); });
+        return *this;
+    }
 
-        return new_image;
+    /**
+     * @brief 只把 mask 中非零位置对应的像素设置为 value。
+     * @param value 每个通道的值。
+     * @param mask 与当前图像同尺寸的 IMG_8UC1 掩码。
+     * @return 对当前对象的引用。
+     * @throw std::logic_error 如果图像或掩码为空。
+     * @throw std::invalid_argument 如果掩码类型或尺寸不符合要求。
+     */
+    Image &Image::set_to(const Scalar &value, const Image &mask)
+    {
+        const std::string F_NAME = "set_to";
+        check_mask(*this, mask, F_NAME);
+        dispatch_type(m_type, [&](auto tag)
+                      { fill_masked_kernel<typename decltype(tag)::type, decltype(tag)::channels>(*this, value, mask); });
+        return *this;
     }
 
     /**
@@ -469,7 +625,7 @@ namespace img
             throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法获取空图像的行指针。");
         }
 
-        return m_data_start + r * m_step;
+        return m_data_start + static_cast<std::ptrdiff_t>(r) * m_step;
     }
     /**
      * @brief 返回指向指定行的起始位置的常量指针。
@@ -490,56 +646,7 @@ namespace img
             throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法获取空图像的行指针。");
         }
 
-        return m_data_start + r * m_step;
-    }
-
-// 辅助宏
-#define IMAGE_SCALAR_OP_LOOP(OP, TYPE, truncate_value)                                \
-    for (size_t r = 0; r < m_rows; ++r)                                           \
-    {                                                                             \
-        unsigned char *row_ptr = this->get_rowptr(r);                             \
-        for (size_t c = 0; c < m_cols; ++c)                                       \
-        {                                                                         \
-            TYPE *pixel_ptr = reinterpret_cast<TYPE *>(row_ptr + c * pixel_size); \
-            for (int chan = 0; chan < channel_cnt; ++chan)                        \
-            {                                                                     \
-                double result = static_cast<double>(pixel_ptr[chan]) OP scalar_d; \
-                pixel_ptr[chan] = truncate_value(result);                             \
-            }                                                                     \
-        }                                                                         \
-    }
-
-    // 这一个模板的核心功能是把double类型的值转换成对应的图像的数值类型,对于整数类型的值会进行范围限制,超过时进行截断
-    template <typename T>
-    T truncate_value(double value)
-    {
-        return static_cast<T>(value);
-    }
-
-    template <>
-    unsigned char truncate_value<unsigned char>(double value)
-    {
-        value = std::round(value);
-        return static_cast<unsigned char>(
-            std::max(0.0, std::min(255.0, value)));
-    }
-
-    template <>
-    unsigned short truncate_value<unsigned short>(double value)
-    {
-        value = std::round(value);
-        return static_cast<unsigned short>(
-            std::max(0.0, std::min(65535.0, value)));
-    }
-
-    // int的大小在不同平台上可能会有所不同,所以这里使用了std::numeric_limits来获取int的最大值和最小值
-    template <>
-    int truncate_value<int>(double value)
-    {
-        value = std::round(value);
-        return static_cast<int>(
-            std::max(static_cast<double>(std::numeric_limits<int>::min()),
-                     std::min(static_cast<double>(std::numeric_limits<int>::max()), value)));
+        return m_data_start + static_cast<std::ptrdiff_t>(r) * m_step;
     }
 
     Image &Image::operator+=(double scalar)
@@ -548,31 +655,10 @@ namespace img
         if (empty())
             throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "图像为空，无法执行标量加法。");
 
-        int depth = get_depth();              // 依赖 m_type
-        int channel_cnt = get_channels();     // 依赖 m_type
-        size_t pixel_size = get_pixel_size(); // 依赖 m_type, m_channel_size
-        double scalar_d = scalar;
-
-        switch (depth)
-        {
-        case IMG_8U:
-            IMAGE_SCALAR_OP_LOOP(+, unsigned char, truncate_value<unsigned char>);
-            break;
-        case IMG_16U:
-            IMAGE_SCALAR_OP_LOOP(+, unsigned short, truncate_value<unsigned short>);
-            break;
-        case IMG_32S:
-            IMAGE_SCALAR_OP_LOOP(+, int, truncate_value<int>);
-            break;
-        case IMG_32F:
-            IMAGE_SCALAR_OP_LOOP(+, float, truncate_value<float>);
-            break;
-        case IMG_64F:
-            IMAGE_SCALAR_OP_LOOP(+, double, truncate_value<double>);
-            break;
-        default:
-            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的图像深度类型 (" + depth_to_string(depth) + ") 进行标量加法。");
-        }
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v + scalar; }); });
         return *this;
     }
     // operator-=, operator*=, operator/= 类似
@@ -582,30 +668,10 @@ namespace img
         const std::string F_NAME = "图像-标量";
         if (empty())
             throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "图像为空，无法执行标量减法。");
-        int depth = get_depth();
-        int channel_cnt = get_channels();
-        size_t pixel_size = get_pixel_size();
-        double scalar_d = scalar;
-        switch (depth)
-        {
-        case IMG_8U:
-            IMAGE_SCALAR_OP_LOOP(-, unsigned char, truncate_value<unsigned char>);
-            break;
-        case IMG_16U:
-            IMAGE_SCALAR_OP_LOOP(-, unsigned short, truncate_value<unsigned short>);
-            break;
-        case IMG_32S:
-            IMAGE_SCALAR_OP_LOOP(-, int, truncate_value<int>);
-            break;
-        case IMG_32F:
-            IMAGE_SCALAR_OP_LOOP(-, float, truncate_value<float>);
-            break;
-        case IMG_64F:
-            IMAGE_SCALAR_OP_LOOP(-, double, truncate_value<double>);
-            break;
-        default:
-            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的图像深度类型 (" + depth_to_string(depth) + ") 进行标量减法。");
-        }
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v - scalar; }); });
         return *this;
     }
 
@@ -614,64 +680,79 @@ namespace img
         const std::string F_NAME = "图像*标量";
         if (empty())
             throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "图像为空，无法执行标量乘法。");
-        int depth = get_depth();
-        int channel_cnt = get_channels();
-        size_t pixel_size = get_pixel_size();
-        double scalar_d = scalar;
-        switch (depth)
-        {
-        case IMG_8U:
-            IMAGE_SCALAR_OP_LOOP(*, unsigned char, truncate_value<unsigned char>);
-            break;
-        case IMG_16U:
-            IMAGE_SCALAR_OP_LOOP(*, unsigned short, truncate_value<unsigned short>);
-            break;
-        case IMG_32S:
-            IMAGE_SCALAR_OP_LOOP(*, int, truncate_value<int>);
-            break;
-        case IMG_32F:
-            IMAGE_SCALAR_OP_LOOP(*, float, truncate_value<float>);
-            break;
-        case IMG_64F:
-            IMAGE_SCALAR_OP_LOOP(*, double, truncate_value<double>);
-            break;
-        default:
-            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的图像深度类型 (" + depth_to_string(depth) + ") 进行标量乘法。");
-        }
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v * scalar; }); });
         return *this;
     }
 
     Image &Image::operator/=(double scalar)
     {
-        const std::string F_NAME = "图像*标量";
+        const std::string F_NAME = "图像/标量";
         if (empty())
             throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "图像为空，无法执行标量除法。");
         if (std::abs(scalar) < std::numeric_limits<double>::epsilon())
             throw std::runtime_error(IMG_ERROR_PREFIX(F_NAME) + "检测到除以零或接近零的数。");
-        int depth = get_depth();
-        int channel_cnt = get_channels();
-        size_t pixel_size = get_pixel_size();
-        double scalar_d = scalar;
-        switch (depth)
-        {
-        case IMG_8U:
-            IMAGE_SCALAR_OP_LOOP(/, unsigned char, truncate_value<unsigned char>);
-            break;
-        case IMG_16U:
-            IMAGE_SCALAR_OP_LOOP(/, unsigned short, truncate_value<unsigned short>);
-            break;
-        case IMG_32S:
-            IMAGE_SCALAR_OP_LOOP(/, int, truncate_value<int>);
-            break;
-        case IMG_32F:
-            IMAGE_SCALAR_OP_LOOP(/, float, truncate_value<float>);
-            break;
-        case IMG_64F:
-            IMAGE_SCALAR_OP_LOOP(/, double, truncate_value<double>);
-            break;
-        default:
-            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的图像深度类型 (" + depth_to_string(depth) + ") 进行标量除法。");
-        }
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v / scalar; }); });
+        return *this;
+    }
+
+    /**
+     * @brief 带掩码的标量加法, 只修改 mask 非零位置的像素。
+     * 减法/乘法/除法版本与之相同。
+     * @param scalar 要加上的标量。
+     * @param mask 与当前图像同尺寸的 IMG_8UC1 掩码。
+     * @return 对当前对象的引用。
+     * @throw std::logic_error 如果图像或掩码为空。
+     * @throw std::invalid_argument 如果掩码类型或尺寸不符合要求。
+     */
+    Image &Image::add(double scalar, const Image &mask)
+    {
+        const std::string F_NAME = "带掩码的图像+标量";
+        check_mask(*this, mask, F_NAME);
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v + scalar; }, &mask); });
+        return *this;
+    }
+
+    Image &Image::subtract(double scalar, const Image &mask)
+    {
+        const std::string F_NAME = "带掩码的图像-标量";
+        check_mask(*this, mask, F_NAME);
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v - scalar; }, &mask); });
+        return *this;
+    }
+
+    Image &Image::multiply(double scalar, const Image &mask)
+    {
+        const std::string F_NAME = "带掩码的图像*标量";
+        check_mask(*this, mask, F_NAME);
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v * scalar; }, &mask); });
+        return *this;
+    }
+
+    Image &Image::divide(double scalar, const Image &mask)
+    {
+        const std::string F_NAME = "带掩码的图像/标量";
+        check_mask(*this, mask, F_NAME);
+        if (std::abs(scalar) < std::numeric_limits<double>::epsilon())
+            throw std::runtime_error(IMG_ERROR_PREFIX(F_NAME) + "检测到除以零或接近零的数。");
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_unary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, [scalar](double v)
+                            { return v / scalar; }, &mask); });
         return *this;
     }
 
@@ -718,23 +799,6 @@ namespace img
         return result;
     }
 
-#define IMAGE_IMAGE_OP_LOOP(OP, TYPE, truncate_value)                                                                        \
-    for (size_t r = 0; r < m_rows; ++r)                                                                                  \
-    {                                                                                                                    \
-        unsigned char *row_ptr_this = this->get_rowptr(r);                                                               \
-        const unsigned char *row_ptr_other = other.get_rowptr(r);                                                        \
-        for (size_t c = 0; c < m_cols; ++c)                                                                              \
-        {                                                                                                                \
-            TYPE *pixel_ptr_this = reinterpret_cast<TYPE *>(row_ptr_this + c * pixel_size);                              \
-            const TYPE *pixel_ptr_other = reinterpret_cast<const TYPE *>(row_ptr_other + c * pixel_size);                \
-            for (int chan = 0; chan < channel_cnt; ++chan)                                                               \
-            {                                                                                                            \
-                double result = static_cast<double>(pixel_ptr_this[chan]) OP static_cast<double>(pixel_ptr_other[chan]); \
-                pixel_ptr_this[chan] = truncate_value(result);                                                               \
-            }                                                                                                            \
-        }                                                                                                                \
-    }
-
     /**
      * @brief 静态函数,用于检查两个图像是否兼容进行逐元素操作。
      * 兼容条件：两者都非空，具有相同的行数、列数和类型。
@@ -769,35 +833,39 @@ namespace img
         }
     }
 
+    /**
+     * @brief 静态函数,用于检查掩码是否可以用于图像 img 的带掩码操作。
+     * 要求: 两者都非空, mask 的类型为 IMG_8UC1 且尺寸与 img 相同。mask 中非零的位置表示要处理的像素。
+     * @throw std::logic_error 如果任一图像为空。
+     * @throw std::invalid_argument 如果 mask 类型或尺寸不符合要求。
+     */
+    void Image::check_mask(const Image &img, const Image &mask, const std::string &operation_name)
+    {
+        const std::string F_CONTEXT = IMG_ERROR_PREFIX(operation_name) + "掩码检查失败: ";
+        if (img.empty() || mask.empty())
+        {
+            throw std::logic_error(F_CONTEXT + "图像和掩码都不能为空。");
+        }
+        if (mask.get_type() != IMG_8UC1)
+        {
+            throw std::invalid_argument(F_CONTEXT + "掩码类型必须为 IMG_8UC1, 收到 type: " + std::to_string(mask.get_type()));
+        }
+        if (mask.get_rows() != img.get_rows() || mask.get_cols() != img.get_cols())
+        {
+            throw std::invalid_argument(F_CONTEXT + "掩码尺寸与图像不匹配。图像 (rows,cols): (" +
+                                        std::to_string(img.get_rows()) + "," + std::to_string(img.get_cols()) + "), 掩码 (rows,cols): (" +
+                                        std::to_string(mask.get_rows()) + "," + std::to_string(mask.get_cols()) + ").");
+        }
+    }
+
     Image &Image::operator+=(const Image &other)
     {
         const std::string F_NAME = "图像相加";
         check_compatibility(*this, other, F_NAME);
-
-        int depth = get_depth();
-        int channel_cnt = get_channels();
-        size_t pixel_size = get_pixel_size();
-
-        switch (depth)
-        {
-        case IMG_8U:
-            IMAGE_IMAGE_OP_LOOP(+, unsigned char, truncate_value<unsigned char>);
-            break;
-        case IMG_16U:
-            IMAGE_IMAGE_OP_LOOP(+, unsigned short, truncate_value<unsigned short>);
-            break;
-        case IMG_32S:
-            IMAGE_IMAGE_OP_LOOP(+, int, truncate_value<int>);
-            break;
-        case IMG_32F:
-            IMAGE_IMAGE_OP_LOOP(+, float, truncate_value<float>);
-            break;
-        case IMG_64F:
-            IMAGE_IMAGE_OP_LOOP(+, double, truncate_value<double>);
-            break;
-        default:
-            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "内部错误: 不支持的图像深度 (" + depth_to_string(depth) + ") 在类型匹配后仍然出现。");
-        }
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_binary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, other, [](auto a, auto b)
+                            { return a + b; }); });
         return *this;
     }
 
@@ -805,29 +873,40 @@ namespace img
     {
         const std::string F_NAME = "图像相减";
         check_compatibility(*this, other, F_NAME);
-        int depth = get_depth();
-        int channel_cnt = get_channels();
-        size_t pixel_size = get_pixel_size();
-        switch (depth)
-        {
-        case IMG_8U:
-            IMAGE_IMAGE_OP_LOOP(-, unsigned char, truncate_value<unsigned char>);
-            break;
-        case IMG_16U:
-            IMAGE_IMAGE_OP_LOOP(-, unsigned short, truncate_value<unsigned short>);
-            break;
-        case IMG_32S:
-            IMAGE_IMAGE_OP_LOOP(-, int, truncate_value<int>);
-            break;
-        case IMG_32F:
-            IMAGE_IMAGE_OP_LOOP(-, float, truncate_value<float>);
-            break;
-        case IMG_64F:
-            IMAGE_IMAGE_OP_LOOP(-, double, truncate_value<double>);
-            break;
-        default:
-            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "内部错误: 不支持的图像深度 (" + depth_to_string(depth) + ") 在类型匹配后仍然出现。");
-        }
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_binary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, other, [](auto a, auto b)
+                            { return a - b; }); });
+        return *this;
+    }
+
+    /**
+     * @brief 带掩码的图像加法, 只修改 mask 非零位置的像素。减法版本与之相同。
+     * @param other 与当前图像同尺寸同类型的图像。
+     * @param mask 与当前图像同尺寸的 IMG_8UC1 掩码。
+     * @return 对当前对象的引用。
+     */
+    Image &Image::add(const Image &other, const Image &mask)
+    {
+        const std::string F_NAME = "带掩码的图像相加";
+        check_compatibility(*this, other, F_NAME);
+        check_mask(*this, mask, F_NAME);
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_binary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, other, [](auto a, auto b)
+                            { return a + b; }, &mask); });
+        return *this;
+    }
+
+    Image &Image::subtract(const Image &other, const Image &mask)
+    {
+        const std::string F_NAME = "带掩码的图像相减";
+        check_compatibility(*this, other, F_NAME);
+        check_mask(*this, mask, F_NAME);
+        dispatch_type(m_type, [&](auto tag)
+                      { apply_binary_op<typename decltype(tag)::type, decltype(tag)::channels>(
+                            *this, other, [](auto a, auto b)
+                            { return a - b; }, &mask); });
         return *this;
     }
 
@@ -897,17 +976,92 @@ namespace img
         // ROI 的 m_data_start 是基于源的 m_data_start 进行偏移
         if (this->m_data_start)
         { // 只有当源图像有数据区时，偏移才有意义
-            roi_view.m_data_start = this->m_data_start + (y * this->m_step) + (x * this->get_pixel_size());
+            roi_view.m_data_start = this->m_data_start + static_cast<std::ptrdiff_t>(y) * this->m_step + x * this->m_pixel_step;
         }
         roi_view.m_rows = height;
         roi_view.m_cols = width;
         roi_view.m_type = this->m_type;
         roi_view.m_channel_size = this->m_channel_size;
         roi_view.m_step = this->m_step; // ROI 的 step 与原图相同
+        roi_view.m_pixel_step = this->m_pixel_step;
 
         return roi_view;
     }
 
+    /**
+     * @brief 创建下采样视图: 每隔 row_factor 行、col_factor 列取一个像素, 不复制数据。
+     * 结果的尺寸为 ceil(rows / row_factor) x ceil(cols / col_factor)。
+     * 列下采样后行内像素不再紧密排列, 库函数会在需要时自动压缩; 也可以调用 clone() 得到连续的副本。
+     * @param row_factor 行方向的采样间隔 (>= 1)。
+     * @param col_factor 列方向的采样间隔 (>= 1)。
+     * @return 与原图像共享数据的视图。
+     * @throw std::logic_error 如果图像为空。
+     * @throw std::invalid_argument 如果采样间隔为 0。
+     */
+    Image Image::subsample(size_t row_factor, size_t col_factor) const
+    {
+        const std::string F_NAME = "subsample";
+        if (empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法从空图像创建视图。");
+        }
+        if (row_factor == 0 || col_factor == 0)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "采样间隔必须大于零。");
+        }
+        Image view = *this; // 软拷贝, 共享数据和引用计数
+        view.m_rows = (m_rows + row_factor - 1) / row_factor;
+        view.m_cols = (m_cols + col_factor - 1) / col_factor;
+        view.m_step = m_step * static_cast<std::ptrdiff_t>(row_factor);
+        view.m_pixel_step = m_pixel_step * col_factor;
+        return view;
+    }
+
+    /**
+     * @brief 创建上下翻转的视图, 不复制数据。
+     * 视图的第一行是原图像的最后一行, 行步长为原步长的相反数。
+     * @return 与原图像共享数据的视图。
+     * @throw std::logic_error 如果图像为空。
+     */
+    Image Image::flip_rows() const
+    {
+        const std::string F_NAME = "flip_rows";
+        if (empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法从空图像创建视图。");
+        }
+        Image view = *this;
+        view.m_data_start = m_data_start + static_cast<std::ptrdiff_t>(m_rows - 1) * m_step;
+        view.m_step = -m_step;
+        return view;
+    }
+
+    /**
+     * @brief 创建只包含第 index 个通道的单通道视图, 不复制数据。
+     * 视图的像素步长等于原图像的像素步长, 所以行内像素不紧密排列。
+     * @param index 通道索引 (从0开始)。
+     * @return 与原图像共享数据的单通道视图。
+     * @throw std::logic_error 如果图像为空。
+     * @throw std::out_of_range 如果通道索引超出范围。
+     */
+    Image Image::channel(int index) const
+    {
+        const std::string F_NAME = "channel";
+        if (empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "无法从空图像创建视图。");
+        }
+        if (index < 0 || index >= get_channels())
+        {
+            throw std::out_of_range(IMG_ERROR_PREFIX(F_NAME) + "通道索引超出范围。收到 " + std::to_string(index) +
+                                    ", 通道数: " + std::to_string(get_channels()));
+        }
+        Image view = *this;
+        view.m_data_start = m_data_start + index * m_channel_size;
+        view.m_type = IMG_MAKETYPE(get_depth(), 1);
+        return view;
+    }
+
     /**
      * @brief 将图像转换为另一种数据类型。
      * 创建一个具有指定 `new_type` 的新图像。像素值将直接从源类型转换为目标类型，
@@ -957,6 +1111,9 @@ namespace img
             case IMG_32S:
             case IMG_32F:
             case IMG_64F:
+            case IMG_16F:
+            case IMG_8S:
+            case IMG_16S:
                 valid_depth = true;
                 break;
             }
@@ -994,74 +1151,36 @@ namespace img
         //     throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "源图像数据指针 (m_data_start) 为空，但图像尺寸非零。无法执行像素转换。");
         // }
 
-        int src_depth = this->get_depth();
-
-        size_t src_pixel_byte_size = this->get_pixel_size();
-        size_t dst_pixel_byte_size = dst_image.get_pixel_size();
-        unsigned char src_channel_byte_size = this->m_channel_size;
-        unsigned char dst_channel_byte_size = dst_image.m_channel_size;
-
-        for (size_t r = 0; r < m_rows; ++r)
-        {
-            const unsigned char *src_row_ptr = this->get_rowptr(r);
-            unsigned char *dst_row_ptr = dst_image.get_rowptr(r);
-
-            for (size_t c = 0; c < m_cols; ++c)
-            {
-                for (int ch = 0; ch < src_channels; ++ch) 
+        // 行内像素不紧密排列的视图先压缩成连续图像
+        const Image src = pixel_contiguous(*this);
+        // 外层按源类型分发得到 <S, CN>, 内层只按目标深度分发得到 D, 两者通道数相同
+        dispatch_type(m_type, [&](auto src_tag)
+                      {
+            using S = typename decltype(src_tag)::type;
+            constexpr int CN = decltype(src_tag)::channels;
+            dispatch_depth(new_depth, [&](auto dst_tag)
+                           {
+                using D = typename decltype(dst_tag)::type;
+                Image_<const S, CN> src_view(src);
+                Image_<D, CN> dst_view(dst_image);
+                const size_t n = m_cols * CN;
+                for (size_t r = 0; r < m_rows; ++r)
                 {
-                    const unsigned char *p_src_channel = src_row_ptr + c * src_pixel_byte_size + ch * src_channel_byte_size;
-                    unsigned char *p_dst_channel = dst_row_ptr + c * dst_pixel_byte_size + ch * dst_channel_byte_size;
-
-                    // 读取源像素值并转换为 double 作为中间表示
-                    double intermediate_val_double = 0.0;
-                    switch (src_depth)
+                    const S *ps = src_view.ptr(r);
+                    D *pd = dst_view.ptr(r);
+                    if constexpr ((std::is_same<S, float16>::value && std::is_same<D, float>::value) ||
+                                  (std::is_same<S, float>::value && std::is_same<D, float16>::value))
                     {
-                    case IMG_8U:
-                        intermediate_val_double = static_cast<double>(*reinterpret_cast<const unsigned char *>(p_src_channel));
-                        break;
-                    case IMG_16U:
-                        intermediate_val_double = static_cast<double>(*reinterpret_cast<const unsigned short *>(p_src_channel));
-                        break;
-                    case IMG_32S:
-                        intermediate_val_double = static_cast<double>(*reinterpret_cast<const int *>(p_src_channel));
-                        break;
-                    case IMG_32F:
-                        intermediate_val_double = static_cast<double>(*reinterpret_cast<const float *>(p_src_channel));
-                        break;
-                    case IMG_64F:
-                        intermediate_val_double = *reinterpret_cast<const double *>(p_src_channel);
-                        break;
-                    default:
-                        // 此处理论上不应到达，因为源图像类型在创建时已验证
-                        throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "内部错误: 遇到未处理的源图像深度 (" + depth_to_string(src_depth) + ").");
+                        // 16F <-> 32F 有专门的 (F16C 向量化的) 转换
+                        convert_half_row(ps, pd, n);
+                        continue;
                     }
-
-                    // 将中间值转换为目标类型，并使用 truncate_value 进行饱和处理
-                    switch (new_depth)
+                    for (size_t i = 0; i < n; ++i)
                     {
-                    case IMG_8U:
-                        *reinterpret_cast<unsigned char *>(p_dst_channel) = truncate_value<unsigned char>(intermediate_val_double);
-                        break;
-                    case IMG_16U:
-                        *reinterpret_cast<unsigned short *>(p_dst_channel) = truncate_value<unsigned short>(intermediate_val_double);
-                        break;
-                    case IMG_32S:
-                        *reinterpret_cast<int *>(p_dst_channel) = truncate_value<int>(intermediate_val_double);
-                        break;
-                    case IMG_32F:
-                        *reinterpret_cast<float *>(p_dst_channel) = truncate_value<float>(intermediate_val_double);
-                        break; // truncate_value<float> 只是 static_cast
-                    case IMG_64F:
-                        *reinterpret_cast<double *>(p_dst_channel) = truncate_value<double>(intermediate_val_double);
-                        break; // truncate_value<double> 只是 static_cast
-                    default:
-                        // 此处理论上不应到达，因为目标图像类型在创建 dst_image 时已通过 allocate 验证
-                        throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "内部错误: 遇到未处理的目标图像深度 (" + depth_to_string(new_depth) + ").");
+                        // 以 double 作为中间表示, 再用 truncate_value 进行饱和处理
+                        pd[i] = truncate_value<D>(static_cast<double>(ps[i]));
                     }
-                }
-            }
-        }
+                } }); });
         return dst_image;
     }
 
@@ -1083,6 +1202,10 @@ namespace img
            << ", 通道数: " << get_channels() << ")" << std::endl;
         os << "每通道字节大小: " << m_channel_size << std::endl;
         os << "每行步长 (字节): " << m_step << std::endl;
+        if (!is_pixel_contiguous())
+        {
+            os << "像素步长 (字节): " << m_pixel_step << std::endl;
+        }
         os << "引用计数: " << (m_refcount ? *m_refcount : 0) << std::endl;
     }
     std::ostream &operator<<(std::ostream &os, const Image &img)
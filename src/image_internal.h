@@ -0,0 +1,801 @@
+#pragma once
+// 库内部使用的辅助模板, 不对用户公开 (只被 src/ 下的源文件包含)
+
+#include "../include/imglib.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <exception>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__) && defined(__AVX__)
+#include <immintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace img
+{
+    // 这一个模板的核心功能是把double类型的值转换成对应的图像的数值类型,对于整数类型的值会进行范围限制,超过时进行截断
+    template <typename T>
+    inline T truncate_value(double value)
+    {
+        return static_cast<T>(value);
+    }
+
+    template <>
+    inline unsigned char truncate_value<unsigned char>(double value)
+    {
+        value = std::round(value);
+        return static_cast<unsigned char>(
+            std::max(0.0, std::min(255.0, value)));
+    }
+
+    template <>
+    inline unsigned short truncate_value<unsigned short>(double value)
+    {
+        value = std::round(value);
+        return static_cast<unsigned short>(
+            std::max(0.0, std::min(65535.0, value)));
+    }
+
+    template <>
+    inline signed char truncate_value<signed char>(double value)
+    {
+        value = std::round(value);
+        return static_cast<signed char>(
+            std::max(-128.0, std::min(127.0, value)));
+    }
+
+    template <>
+    inline short truncate_value<short>(double value)
+    {
+        value = std::round(value);
+        return static_cast<short>(
+            std::max(-32768.0, std::min(32767.0, value)));
+    }
+
+    // int的大小在不同平台上可能会有所不同,所以这里使用了std::numeric_limits来获取int的最大值和最小值
+    template <>
+    inline int truncate_value<int>(double value)
+    {
+        value = std::round(value);
+        return static_cast<int>(
+            std::max(static_cast<double>(std::numeric_limits<int>::min()),
+                     std::min(static_cast<double>(std::numeric_limits<int>::max()), value)));
+    }
+
+    /** @brief T 是否为浮点通道类型 (包括 float16)。 */
+    template <typename T>
+    struct is_float_type : std::integral_constant<bool, std::is_floating_point<T>::value || std::is_same<T, float16>::value>
+    {
+    };
+
+    /**
+     * @brief 一行 float16 与 float 之间的批量转换。
+     * 启用 F16C 时每次用 vcvtph2ps / vcvtps2ph 转换 8 个元素, 剩余部分逐个转换。
+     */
+    inline void convert_half_row(const float16 *src, float *dst, size_t n)
+    {
+        size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+        }
+#endif
+        for (; i < n; ++i)
+            dst[i] = src[i];
+    }
+
+    inline void convert_half_row(const float *src, float16 *dst, size_t n)
+    {
+        size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), h);
+        }
+#endif
+        for (; i < n; ++i)
+            dst[i] = src[i];
+    }
+
+    /**
+     * @brief 把 S 类型的值转换为 D 类型, 必要时饱和处理。
+     * 目标是浮点数、或源的取值范围完全落在目标范围内时直接 static_cast, 只有可能越界时才经过 truncate_value,
+     * 所以在整数 -> 更宽的整数/浮点数这类常见路径上没有额外开销。
+     */
+    template <typename D, typename S>
+    inline D truncate_cast(S value)
+    {
+        if constexpr (is_float_type<D>::value)
+        {
+            return static_cast<D>(value);
+        }
+        else if constexpr (std::is_integral<S>::value &&
+                           std::numeric_limits<S>::min() >= std::numeric_limits<D>::min() &&
+                           std::numeric_limits<S>::max() <= std::numeric_limits<D>::max())
+        {
+            return static_cast<D>(value);
+        }
+        else
+        {
+            return truncate_value<D>(static_cast<double>(value));
+        }
+    }
+
+    // 滤波/插值时的中间类型: 32S / 64F 用 double 才不损失精度, 其它深度用 float
+    template <typename T>
+    using FilterWork = typename std::conditional<std::is_same<T, int>::value || std::is_same<T, double>::value, double, float>::type;
+
+    /**
+     * @brief 把一行 W 类型的结果写为 T 类型, 整数四舍五入 (与 _mm_cvtps_epi32 一致, 取最近偶数) 并饱和。
+     * float -> 8U 用 SSE2 一次转换 16 个元素。
+     */
+    template <typename T, typename W>
+    inline void store_row(const W *acc, T *q, size_t n)
+    {
+        size_t i = 0;
+        if constexpr (std::is_same<T, float16>::value && std::is_same<W, float>::value)
+        {
+            convert_half_row(acc, q, n);
+            return;
+        }
+        else if constexpr (is_float_type<T>::value)
+        {
+            for (; i < n; ++i)
+                q[i] = static_cast<T>(acc[i]);
+        }
+        else
+        {
+#if defined(__SSE2__)
+            if constexpr (std::is_same<T, unsigned char>::value && std::is_same<W, float>::value)
+            {
+                for (; i + 16 <= n; i += 16)
+                {
+                    const __m128i a = _mm_cvtps_epi32(_mm_loadu_ps(acc + i));
+                    const __m128i b = _mm_cvtps_epi32(_mm_loadu_ps(acc + i + 4));
+                    const __m128i c = _mm_cvtps_epi32(_mm_loadu_ps(acc + i + 8));
+                    const __m128i d = _mm_cvtps_epi32(_mm_loadu_ps(acc + i + 12));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(q + i),
+                                     _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+                }
+            }
+#endif
+            for (; i < n; ++i)
+                q[i] = truncate_value<T>(std::nearbyint(static_cast<double>(acc[i])));
+        }
+    }
+
+    /**
+     * @brief 返回行内像素紧密排列的图像: 本身满足时直接返回 (软拷贝), 否则返回压缩后的副本。
+     * 内核只处理紧密排列的像素 (Image_ 的要求), 只读的输入先经过这个函数。
+     */
+    inline Image pixel_contiguous(const Image &img)
+    {
+        return img.is_pixel_contiguous() ? img : img.clone();
+    }
+
+    /**
+     * @brief 在行内像素紧密排列的图像上原地执行 f(Image &)。
+     * img 不满足时先在压缩后的副本上执行, 再把结果写回 img (列下采样/单通道视图)。
+     */
+    template <typename F>
+    void modify_pixel_contiguous(Image &img, F &&f)
+    {
+        if (img.is_pixel_contiguous())
+        {
+            f(img);
+            return;
+        }
+        Image tmp = img.clone();
+        f(tmp);
+        tmp.copy_to(img);
+    }
+
+    /**
+     * @brief 返回最后一级缓存的大小 (字节), 只在第一次调用时查询。
+     * 查询不到时按 8MB 估计。
+     */
+    inline size_t last_level_cache_size()
+    {
+        static const size_t size = []
+        {
+            long bytes = -1;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+            bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+            if (bytes <= 0)
+                bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+            return bytes > 0 ? static_cast<size_t>(bytes) : static_cast<size_t>(8) << 20;
+        }();
+        return size;
+    }
+
+    /**
+     * @brief 复制 n 个字节。stream 为 true 时使用非临时 (streaming) 存储,
+     * 写入的数据绕过缓存, 不会把当前工作集挤出缓存; 适合远大于缓存的复制。
+     * 调用者在全部复制结束后需要调用 stream_fence()。
+     */
+    inline void copy_bytes(unsigned char *dst, const unsigned char *src, size_t n, bool stream)
+    {
+#if defined(__SSE2__)
+        if (stream && n >= 64)
+        {
+            // 先用普通复制把目标地址对齐到 16 字节
+            const size_t head = (16 - (reinterpret_cast<std::uintptr_t>(dst) & 15)) & 15;
+            std::memcpy(dst, src, head);
+            dst += head;
+            src += head;
+            n -= head;
+            size_t i = 0;
+            for (; i + 64 <= n; i += 64)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+                _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i), a);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 16), b);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 32), c);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 48), d);
+            }
+            std::memcpy(dst + i, src + i, n - i);
+            return;
+        }
+#endif
+        (void)stream;
+        std::memcpy(dst, src, n);
+    }
+
+    /** @brief 使之前的 streaming 存储对其它线程/后续读取可见。 */
+    inline void stream_fence()
+    {
+#if defined(__SSE2__)
+        _mm_sfence();
+#endif
+    }
+
+#if defined(__SSE2__)
+    // 3/4 通道 1 字节像素的交错/解交错, 只用 SSE2 的 unpack/pack 指令; channels.cpp 和 color.cpp 共用
+
+    /**
+     * @brief 16 个 3 通道 1 字节像素 (48 字节) 解交错为 3 个通道各 16 字节。
+     * 每一轮把三个寄存器按 8 字节错位交织, 四轮之后三个通道各自归位。
+     */
+    inline void split3_u8(const unsigned char *src, __m128i &c0, __m128i &c1, __m128i &c2)
+    {
+        __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+        __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+        for (int round = 0; round < 4; ++round)
+        {
+            const __m128i n0 = _mm_unpacklo_epi8(t0, _mm_unpackhi_epi64(t1, t1));
+            const __m128i n1 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t0, t0), t2);
+            const __m128i n2 = _mm_unpacklo_epi8(t1, _mm_unpackhi_epi64(t2, t2));
+            t0 = n0, t1 = n1, t2 = n2;
+        }
+        c0 = t0, c1 = t1, c2 = t2;
+    }
+
+    /**
+     * @brief 3 个通道各 16 字节交错为 16 个 3 通道像素, 写入 dst 的 48 字节。每一轮把 (t0, t1, t2) 的偶数字节和奇数字节重新打包,
+     * 是 split3_u8 每一轮 unpack 的逆, 同样四轮完成。
+     */
+    inline void merge3_u8(__m128i t0, __m128i t1, __m128i t2, unsigned char *dst)
+    {
+        const __m128i mask = _mm_set1_epi16(0x00FF);
+        for (int round = 0; round < 4; ++round)
+        {
+            const __m128i e0 = _mm_and_si128(t0, mask);
+            const __m128i e1 = _mm_and_si128(t1, mask);
+            const __m128i e2 = _mm_and_si128(t2, mask);
+            const __m128i o0 = _mm_srli_epi16(t0, 8);
+            const __m128i o1 = _mm_srli_epi16(t1, 8);
+            const __m128i o2 = _mm_srli_epi16(t2, 8);
+            t0 = _mm_packus_epi16(e0, e1);
+            t1 = _mm_packus_epi16(e2, o0);
+            t2 = _mm_packus_epi16(o1, o2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), t0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), t1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), t2);
+    }
+
+    /** @brief 16 个 4 通道 1 字节像素 (64 字节) 解交错为 4 个通道各 16 字节: 三轮 8 位 unpack 加一轮 16 位 unpack。 */
+    inline void split4_u8(const unsigned char *src, __m128i &c0, __m128i &c1, __m128i &c2, __m128i &c3)
+    {
+        __m128i u0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));      // 像素 0-3
+        __m128i u1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16)); // 像素 4-7
+        __m128i u2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)); // 像素 8-11
+        __m128i u3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48)); // 像素 12-15
+        __m128i v0 = _mm_unpacklo_epi8(u0, u2);
+        __m128i v1 = _mm_unpackhi_epi8(u0, u2);
+        __m128i v2 = _mm_unpacklo_epi8(u1, u3);
+        __m128i v3 = _mm_unpackhi_epi8(u1, u3);
+        u0 = _mm_unpacklo_epi8(v0, v2); // 通道 0-3 的像素 0, 4, 8, 12
+        u1 = _mm_unpackhi_epi8(v0, v2); // 像素 1, 5, 9, 13
+        u2 = _mm_unpacklo_epi8(v1, v3); // 像素 2, 6, 10, 14
+        u3 = _mm_unpackhi_epi8(v1, v3); // 像素 3, 7, 11, 15
+        v0 = _mm_unpacklo_epi8(u0, u1); // 通道 0/1, 像素对 (0,1) (4,5) (8,9) (12,13)
+        v1 = _mm_unpackhi_epi8(u0, u1); // 通道 2/3
+        v2 = _mm_unpacklo_epi8(u2, u3); // 通道 0/1, 像素对 (2,3) (6,7) (10,11) (14,15)
+        v3 = _mm_unpackhi_epi8(u2, u3); // 通道 2/3
+        c0 = _mm_unpacklo_epi16(v0, v2);
+        c1 = _mm_unpackhi_epi16(v0, v2);
+        c2 = _mm_unpacklo_epi16(v1, v3);
+        c3 = _mm_unpackhi_epi16(v1, v3);
+    }
+
+    /** @brief 4 个通道各 16 字节交错为 16 个 4 通道像素, 写入 dst 的 64 字节: 一轮 8 位 unpack 加一轮 16 位 unpack。 */
+    inline void merge4_u8(__m128i a, __m128i b, __m128i c, __m128i d, unsigned char *dst)
+    {
+        const __m128i ab0 = _mm_unpacklo_epi8(a, b);
+        const __m128i ab1 = _mm_unpackhi_epi8(a, b);
+        const __m128i cd0 = _mm_unpacklo_epi8(c, d);
+        const __m128i cd1 = _mm_unpackhi_epi8(c, d);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi16(ab0, cd0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi16(ab0, cd0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_unpacklo_epi16(ab1, cd1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 48), _mm_unpackhi_epi16(ab1, cd1));
+    }
+#endif
+
+    /**
+     * @brief 返回并行内核使用的线程数上限, 只在第一次调用时确定。
+     * 默认为硬件线程数, 可以通过环境变量 IMGLIB_NUM_THREADS 覆盖 (例如设为 1 关闭并行)。
+     */
+    inline size_t num_threads()
+    {
+        static const size_t n = []
+        {
+            const char *env = std::getenv("IMGLIB_NUM_THREADS");
+            if (env)
+            {
+                const long v = std::strtol(env, nullptr, 10);
+                if (v > 0)
+                    return static_cast<size_t>(v);
+            }
+            return std::max<size_t>(1, std::thread::hardware_concurrency());
+        }();
+        return n;
+    }
+
+    /**
+     * @brief 按行把工作拆分到多个线程: f(row_begin, row_end) 处理 [row_begin, row_end) 行。
+     * 总数据量 (rows * bytes_per_row) 小于阈值时直接在当前线程执行, 避免创建线程的开销。
+     * 工作线程中抛出的第一个异常会在所有线程结束后重新抛出。
+     */
+    template <typename F>
+    void parallel_for_rows(size_t rows, size_t bytes_per_row, F &&f)
+    {
+        const size_t min_bytes_per_thread = static_cast<size_t>(1) << 20; // 每个线程至少处理 1MB
+        const size_t total_bytes = rows * bytes_per_row;
+        size_t n_threads = num_threads();
+        n_threads = std::min(n_threads, std::max<size_t>(1, total_bytes / min_bytes_per_thread));
+        n_threads = std::min(n_threads, rows);
+        if (n_threads <= 1)
+        {
+            f(static_cast<size_t>(0), rows);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors(n_threads);
+        workers.reserve(n_threads - 1);
+        const size_t chunk = rows / n_threads;
+        const size_t extra = rows % n_threads;
+        size_t begin = 0;
+        for (size_t t = 0; t < n_threads; ++t)
+        {
+            const size_t end = begin + chunk + (t < extra ? 1 : 0);
+            auto job = [&f, &errors, t, begin, end]
+            {
+                try
+                {
+                    f(begin, end);
+                }
+                catch (...)
+                {
+                    errors[t] = std::current_exception();
+                }
+            };
+            if (t + 1 == n_threads)
+                job(); // 最后一块由当前线程处理
+            else
+                workers.emplace_back(job);
+            begin = end;
+        }
+        for (auto &w : workers)
+        {
+            w.join();
+        }
+        for (auto &e : errors)
+        {
+            if (e)
+                std::rethrow_exception(e);
+        }
+    }
+
+    /** @brief 非负的 v mod n (n > 0), 用于环形缓冲区的下标 (v 可能为负)。 */
+    inline int positive_mod(int v, int n)
+    {
+        const int m = v % n;
+        return m < 0 ? m + n : m;
+    }
+
+    /**
+     * @brief 把图像之外的坐标 p 映射到 [0, len) 内 (len 为行数或列数)。
+     * BORDER_CONSTANT 时返回 -1, 由调用者填充常数; 反射方式在 p 超出多个周期时 (核比图像大) 反复反射。
+     */
+    inline int border_interpolate(int p, int len, BorderType border)
+    {
+        if (static_cast<unsigned>(p) < static_cast<unsigned>(len))
+            return p;
+        switch (border)
+        {
+        case BORDER_REPLICATE:
+            return p < 0 ? 0 : len - 1;
+        case BORDER_REFLECT:
+        case BORDER_REFLECT_101:
+        {
+            if (len == 1)
+                return 0;
+            const int delta = border == BORDER_REFLECT_101 ? 1 : 0;
+            do
+            {
+                if (p < 0)
+                    p = -p - 1 + delta;
+                else
+                    p = 2 * len - 1 - p - delta;
+            } while (static_cast<unsigned>(p) >= static_cast<unsigned>(len));
+            return p;
+        }
+        case BORDER_WRAP:
+            p %= len;
+            return p < 0 ? p + len : p;
+        default:
+            return -1;
+        }
+    }
+
+    /** @brief 检查 border 是否为有效的 BorderType。 */
+    inline void check_border_type(BorderType border, const std::string &F_NAME)
+    {
+        if (border < BORDER_CONSTANT || border > BORDER_REFLECT_101)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的边界类型: " + std::to_string(border));
+        }
+    }
+
+    /** @brief 把 Scalar 按通道转换 (饱和) 为 CN 个 T 组成的像素值。 */
+    template <typename T, int CN>
+    inline Vec<T, CN> scalar_to_pixel(const Scalar &value)
+    {
+        Vec<T, CN> px;
+        for (int k = 0; k < CN; ++k)
+        {
+            px[k] = truncate_value<T>(value[k]);
+        }
+        return px;
+    }
+
+    /**
+     * @brief 把图像的每个像素设置为 value。
+     * 像素的所有字节都相同时 (例如清零) 每行直接 memset; 否则先构造一行模板, 再逐行 memcpy。
+     * 大图像按行并行。
+     */
+    template <typename T, int CN>
+    void fill_kernel(Image &img, const Scalar &value)
+    {
+        const Vec<T, CN> px = scalar_to_pixel<T, CN>(value);
+        if (!img.is_pixel_contiguous())
+        {
+            // 行内像素不紧密排列的视图逐像素写入, 不需要先读出原来的数据
+            for (size_t r = 0; r < img.get_rows(); ++r)
+            {
+                unsigned char *p = img.data() + static_cast<std::ptrdiff_t>(r) * img.get_step();
+                for (size_t c = 0; c < img.get_cols(); ++c)
+                {
+                    std::memcpy(p + c * img.get_pixel_step(), &px, sizeof(px));
+                }
+            }
+            return;
+        }
+        Image_<T, CN> view(img);
+        const size_t row_bytes = view.cols() * sizeof(T) * CN;
+
+        const unsigned char *px_bytes = reinterpret_cast<const unsigned char *>(&px);
+        const bool uniform = std::all_of(px_bytes, px_bytes + sizeof(px),
+                                         [px_bytes](unsigned char b)
+                                         { return b == px_bytes[0]; });
+
+        std::vector<Vec<T, CN>> pattern;
+        if (!uniform)
+        {
+            pattern.assign(view.cols(), px);
+        }
+        const bool continuous = img.is_continuous();
+        parallel_for_rows(view.rows(), row_bytes, [&](size_t begin, size_t end)
+                          {
+            if (uniform && continuous)
+            {
+                // 连续存储时整块一次 memset
+                std::memset(view.ptr(begin), px_bytes[0], (end - begin) * row_bytes);
+                return;
+            }
+            for (size_t r = begin; r < end; ++r)
+            {
+                if (uniform)
+                    std::memset(view.ptr(r), px_bytes[0], row_bytes);
+                else
+                    std::memcpy(view.ptr(r), pattern.data(), row_bytes);
+            } });
+    }
+
+    /**
+     * @brief 只把 mask 非零位置的像素设置为 value。
+     * 用按元素选择 (m ? v : old) 代替分支, 编译器会把它生成为向量的 blend 指令。
+     */
+    template <typename T, int CN>
+    void fill_masked_kernel(Image &img, const Scalar &value, const Image &mask)
+    {
+        if (!img.is_pixel_contiguous())
+        {
+            modify_pixel_contiguous(img, [&](Image &tmp)
+                                    { fill_masked_kernel<T, CN>(tmp, value, mask); });
+            return;
+        }
+        Image_<T, CN> view(img);
+        Image_<const unsigned char, 1> mask_view(pixel_contiguous(mask));
+        const Vec<T, CN> px = scalar_to_pixel<T, CN>(value);
+        const size_t cols = view.cols();
+        parallel_for_rows(view.rows(), cols * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                T *p = view.ptr(r);
+                const unsigned char *m = mask_view.ptr(r);
+                for (size_t c = 0; c < cols; ++c)
+                {
+                    for (int k = 0; k < CN; ++k)
+                    {
+                        p[c * CN + k] = m[c] ? px[k] : p[c * CN + k];
+                    }
+                }
+            } });
+    }
+
+    /** @brief 与 T 同宽的无符号整数, 1/2 字节的通道类型用它查表和按位选择。 */
+    template <typename T>
+    using BitsOf = typename std::conditional<sizeof(T) == 1, unsigned char, unsigned short>::type;
+
+    /** @brief mask 元素对应的选择掩码: 非零为全 1, 零为全 0。每个像素只算一次, 所有通道共用。 */
+    template <typename B>
+    inline B mask_bits(unsigned char m)
+    {
+        return static_cast<B>(-static_cast<int>(m != 0));
+    }
+
+    /** @brief 按位选择: mk 全 1 时取 v, 全 0 时保留 old。编译为 and / andnot / or, 没有分支, 可以向量化。 */
+    template <typename B>
+    inline B select_bits(B mk, B v, B old)
+    {
+        return static_cast<B>((v & mk) | (old & ~mk));
+    }
+
+    /**
+     * @brief 二元运算 op(a, b) 的结果。op 只做加减:
+     * 8/16 位整数在 int 中计算再饱和, float16 在 float 中计算, 只有 32S / 32F / 64F 经过 double。
+     */
+    template <typename T, typename Op>
+    inline T binary_value(Op op, T a, T b)
+    {
+        if constexpr (std::is_integral<T>::value && sizeof(T) <= 2)
+        {
+            const int v = op(static_cast<int>(a), static_cast<int>(b));
+            return static_cast<T>(std::min<int>(std::numeric_limits<T>::max(), std::max<int>(std::numeric_limits<T>::min(), v)));
+        }
+        else if constexpr (std::is_same<T, float16>::value)
+        {
+            return static_cast<T>(static_cast<float>(op(static_cast<float>(a), static_cast<float>(b))));
+        }
+        else
+        {
+            return truncate_value<T>(op(static_cast<double>(a), static_cast<double>(b)));
+        }
+    }
+
+    /**
+     * @brief 对图像的每个通道元素执行 dst = truncate_value(op(dst))。
+     * CN 是编译期常量, 所以每一行可以当作 cols * CN 个元素的一维数组来处理。
+     * 1/2 字节的类型 (8U/8S/16U/16S/16F) 的结果只取决于元素的位模式: 先对所有可能的值算出查找表
+     * (与逐元素计算的结果相同), 之后每个元素只查一次表。16 位的表有 65536 项, 元素比这更少的图像仍然逐元素计算。
+     * mask 非空时只更新 mask 非零的像素: 查表类型每个像素算一次选择掩码, 各通道用 and / andnot 合并新旧值;
+     * 其它类型按像素取一次 mask, 各通道按元素选择。都没有逐元素的分支。
+     * 调用者负责检查 mask (Image::check_mask)。
+     */
+    template <typename T, int CN, typename Op>
+    void apply_unary_op(Image &img, Op op, const Image *mask = nullptr)
+    {
+        if (!img.is_pixel_contiguous())
+        {
+            modify_pixel_contiguous(img, [&](Image &tmp)
+                                    { apply_unary_op<T, CN>(tmp, op, mask); });
+            return;
+        }
+        const Image mask_c = mask ? pixel_contiguous(*mask) : Image();
+        Image_<T, CN> view(img);
+        const size_t cols = view.cols();
+        using B = BitsOf<T>;
+        std::vector<B> lut;
+        if constexpr (sizeof(T) <= 2)
+        {
+            const size_t entries = static_cast<size_t>(1) << (8 * sizeof(T));
+            if (view.rows() * cols * CN >= entries)
+            {
+                lut.resize(entries);
+                for (size_t i = 0; i < entries; ++i)
+                {
+                    const B in = static_cast<B>(i);
+                    T x;
+                    std::memcpy(&x, &in, sizeof(T));
+                    const T y = truncate_value<T>(op(static_cast<double>(x)));
+                    std::memcpy(&lut[i], &y, sizeof(T));
+                }
+            }
+        }
+        parallel_for_rows(view.rows(), cols * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                T *p = view.ptr(r);
+                const unsigned char *m = mask ? mask_c.data() + static_cast<std::ptrdiff_t>(r) * mask_c.get_step() : nullptr;
+                if constexpr (sizeof(T) <= 2)
+                {
+                    if (!lut.empty())
+                    {
+                        B *pb = reinterpret_cast<B *>(p);
+                        const B *t = lut.data();
+                        if (!m)
+                        {
+                            for (size_t i = 0; i < cols * CN; ++i)
+                                pb[i] = t[pb[i]];
+                            continue;
+                        }
+                        for (size_t c = 0; c < cols; ++c)
+                        {
+                            const B mk = mask_bits<B>(m[c]);
+                            for (int k = 0; k < CN; ++k)
+                                pb[c * CN + k] = select_bits(mk, t[pb[c * CN + k]], pb[c * CN + k]);
+                        }
+                        continue;
+                    }
+                }
+                if (!m)
+                {
+                    for (size_t i = 0; i < cols * CN; ++i)
+                    {
+                        p[i] = truncate_value<T>(op(static_cast<double>(p[i])));
+                    }
+                    continue;
+                }
+                for (size_t c = 0; c < cols; ++c)
+                {
+                    const bool on = m[c] != 0;
+                    for (int k = 0; k < CN; ++k)
+                    {
+                        const T v = truncate_value<T>(op(static_cast<double>(p[c * CN + k])));
+                        p[c * CN + k] = on ? v : p[c * CN + k];
+                    }
+                }
+            } });
+    }
+
+    /**
+     * @brief 对两幅同类型同尺寸的图像逐元素执行 dst = op(dst, src), 结果的计算见 binary_value。
+     * op 要能接受 int / float / double 参数 (泛型 lambda)。
+     * mask 非空时 1/2 字节的类型每个像素算一次选择掩码, 各通道用 and / andnot 合并新旧值; 其它类型按像素取一次 mask。
+     * 调用者负责先调用 Image::check_compatibility (以及 Image::check_mask)。
+     */
+    template <typename T, int CN, typename Op>
+    void apply_binary_op(Image &dst, const Image &src, Op op, const Image *mask = nullptr)
+    {
+        if (!dst.is_pixel_contiguous())
+        {
+            modify_pixel_contiguous(dst, [&](Image &tmp)
+                                    { apply_binary_op<T, CN>(tmp, src, op, mask); });
+            return;
+        }
+        const Image mask_c = mask ? pixel_contiguous(*mask) : Image();
+        Image_<T, CN> dst_view(dst);
+        Image_<const T, CN> src_view(pixel_contiguous(src));
+        const size_t cols = dst_view.cols();
+        parallel_for_rows(dst_view.rows(), cols * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                T *pd = dst_view.ptr(r);
+                const T *ps = src_view.ptr(r);
+                if (!mask)
+                {
+                    for (size_t i = 0; i < cols * CN; ++i)
+                    {
+                        pd[i] = binary_value<T>(op, pd[i], ps[i]);
+                    }
+                    continue;
+                }
+                const unsigned char *m = mask_c.data() + static_cast<std::ptrdiff_t>(r) * mask_c.get_step();
+                if constexpr (sizeof(T) <= 2)
+                {
+                    using B = BitsOf<T>;
+                    B *pb = reinterpret_cast<B *>(pd);
+                    for (size_t c = 0; c < cols; ++c)
+                    {
+                        const B mk = mask_bits<B>(m[c]);
+                        for (int k = 0; k < CN; ++k)
+                        {
+                            const T v = binary_value<T>(op, pd[c * CN + k], ps[c * CN + k]);
+                            B vb;
+                            std::memcpy(&vb, &v, sizeof(T));
+                            pb[c * CN + k] = select_bits(mk, vb, pb[c * CN + k]);
+                        }
+                    }
+                }
+                else
+                {
+                    for (size_t c = 0; c < cols; ++c)
+                    {
+                        const bool on = m[c] != 0;
+                        for (int k = 0; k < CN; ++k)
+                        {
+                            const T v = binary_value<T>(op, pd[c * CN + k], ps[c * CN + k]);
+                            pd[c * CN + k] = on ? v : pd[c * CN + k];
+                        }
+                    }
+                }
+            } });
+    }
+
+    /** @brief 只把 mask 非零位置的像素从 src 复制到 dst (按元素选择, 无分支)。 */
+    template <typename T, int CN>
+    void copy_masked_kernel(const Image &src, Image &dst, const Image &mask)
+    {
+        if (!dst.is_pixel_contiguous())
+        {
+            modify_pixel_contiguous(dst, [&](Image &tmp)
+                                    { copy_masked_kernel<T, CN>(src, tmp, mask); });
+            return;
+        }
+        Image_<const T, CN> src_view(pixel_contiguous(src));
+        Image_<T, CN> dst_view(dst);
+        Image_<const unsigned char, 1> mask_view(pixel_contiguous(mask));
+        const size_t cols = src_view.cols();
+        parallel_for_rows(src_view.rows(), cols * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            for (size_t r = begin; r < end; ++r)
+            {
+                const T *ps = src_view.ptr(r);
+                T *pd = dst_view.ptr(r);
+                const unsigned char *m = mask_view.ptr(r);
+                for (size_t c = 0; c < cols; ++c)
+                {
+                    for (int k = 0; k < CN; ++k)
+                    {
+                        pd[c * CN + k] = m[c] ? ps[c * CN + k] : pd[c * CN + k];
+                    }
+                }
+            } });
+    }
+}
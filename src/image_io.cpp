@@ -391,7 +391,8 @@ namespace img
         {
             try
             {
-                return handler->h_write(filename, img);
+                // 处理器按行读取紧密排列的像素, 列下采样/单通道视图先压缩
+                return handler->h_write(filename, img.is_pixel_contiguous() ? img : img.clone());
             }
             catch (const std::exception &e)
             {
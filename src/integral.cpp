@@ -0,0 +1,224 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace img
+{
+    // 列方向累加时按列分条并行, 条的起点按这么多个元素对齐, 相邻线程不会写同一个缓存行
+    static const size_t INTEGRAL_STRIPE_ALIGN = 16;
+
+    /**
+     * @brief 一行的前缀和: q[(c + 1) * CN + k] = p[0..c] 中第 k 个通道之和, q 的第 0 个像素为 0。
+     * 8U -> 32S 的单通道和四通道有 SSE2 实现: 单通道在寄存器内用两次移位相加求 4 个元素的前缀和,
+     * 四通道的一个像素正好是一个寄存器, 直接与上一个像素的结果相加。
+     */
+    template <typename T, typename ST, int CN>
+    static void row_prefix(const T *p, ST *q, size_t cols)
+    {
+        for (int k = 0; k < CN; ++k)
+            q[k] = 0;
+        q += CN;
+        size_t c = 0;
+        ST acc[CN] = {};
+#if defined(__SSE2__)
+        if constexpr (std::is_same<T, unsigned char>::value && std::is_same<ST, int>::value && (CN == 1 || CN == 4))
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i run = zero;
+            const size_t n = cols * CN;
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                std::int32_t raw;
+                std::memcpy(&raw, p + i, 4);
+                __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(raw), zero), zero);
+                if (CN == 1)
+                {
+                    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+                    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+                }
+                v = _mm_add_epi32(v, run);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(q + i), v);
+                run = CN == 1 ? _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)) : v;
+            }
+            c = i / CN;
+            for (int k = 0; k < CN; ++k)
+                acc[k] = c > 0 ? q[(c - 1) * CN + k] : 0;
+        }
+#endif
+        for (; c < cols; ++c)
+        {
+            for (int k = 0; k < CN; ++k)
+            {
+                acc[k] += static_cast<ST>(p[c * CN + k]);
+                q[c * CN + k] = acc[k];
+            }
+        }
+    }
+
+    /** @brief 一行平方和的前缀和, 布局同 row_prefix。 */
+    template <typename T, int CN>
+    static void row_prefix_sq(const T *p, double *q, size_t cols)
+    {
+        for (int k = 0; k < CN; ++k)
+            q[k] = 0;
+        q += CN;
+        double acc[CN] = {};
+        for (size_t c = 0; c < cols; ++c)
+        {
+            for (int k = 0; k < CN; ++k)
+            {
+                const double v = static_cast<double>(p[c * CN + k]);
+                acc[k] += v * v;
+                q[c * CN + k] = acc[k];
+            }
+        }
+    }
+
+    /** @brief 把 [y0, y1) 行的 [i0, i1) 元素逐行加上上一行的对应元素 (列方向的前缀和)。 */
+    template <typename ST>
+    static void column_accumulate(unsigned char *base, std::ptrdiff_t step, size_t y0, size_t y1, size_t i0, size_t i1)
+    {
+        for (size_t y = y0; y < y1; ++y)
+        {
+            const ST *prev = reinterpret_cast<const ST *>(base + static_cast<std::ptrdiff_t>(y - 1) * step);
+            ST *q = reinterpret_cast<ST *>(base + static_cast<std::ptrdiff_t>(y) * step);
+            for (size_t i = i0; i < i1; ++i)
+                q[i] += prev[i];
+        }
+    }
+
+    /**
+     * @brief 积分图内核。
+     * 输出按行块处理, 一个块的大小约为每个线程 1MB, 能留在缓存中: 先按行并行计算块内每一行的前缀和,
+     * 再按列分条并行, 每条从上一块的最后一行开始逐行向下累加。两步都在缓存中的块上进行,
+     * 整个计算只读写一遍内存。sqsum 为空指针时不计算平方和。
+     */
+    template <typename T, typename ST, int CN>
+    static void integral_kernel(const Image &src, Image &sum, Image *sqsum)
+    {
+        Image_<const T, CN> s(src);
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        const size_t width = (cols + 1) * CN;
+        unsigned char *sum_base = sum.data();
+        const std::ptrdiff_t sum_step = sum.get_step();
+        unsigned char *sq_base = sqsum ? sqsum->data() : nullptr;
+        const std::ptrdiff_t sq_step = sqsum ? sqsum->get_step() : 0;
+
+        std::fill_n(reinterpret_cast<ST *>(sum_base), width, ST(0));
+        if (sqsum)
+            std::fill_n(reinterpret_cast<double *>(sq_base), width, 0.0);
+
+        const size_t row_bytes = width * (sizeof(ST) + (sqsum ? sizeof(double) : 0));
+        const size_t block_rows = std::max<size_t>(1, (num_threads() << 20) / row_bytes);
+        const size_t stripes = std::max<size_t>(1, std::min(num_threads(), width / INTEGRAL_STRIPE_ALIGN));
+        for (size_t b0 = 0; b0 < rows; b0 += block_rows)
+        {
+            const size_t b1 = std::min(rows, b0 + block_rows);
+            // 源图像第 r 行的结果写入输出的第 r + 1 行
+            parallel_for_rows(b1 - b0, row_bytes, [&](size_t begin, size_t end)
+                              {
+                for (size_t r = b0 + begin; r < b0 + end; ++r)
+                {
+                    row_prefix<T, ST, CN>(s.ptr(r), reinterpret_cast<ST *>(sum_base + static_cast<std::ptrdiff_t>(r + 1) * sum_step), cols);
+                    if (sqsum)
+                        row_prefix_sq<T, CN>(s.ptr(r), reinterpret_cast<double *>(sq_base + static_cast<std::ptrdiff_t>(r + 1) * sq_step), cols);
+                } });
+            parallel_for_rows(stripes, (b1 - b0) * row_bytes / stripes, [&](size_t begin, size_t end)
+                              {
+                const size_t i0 = width * begin / stripes / INTEGRAL_STRIPE_ALIGN * INTEGRAL_STRIPE_ALIGN;
+                const size_t i1 = end == stripes ? width : width * end / stripes / INTEGRAL_STRIPE_ALIGN * INTEGRAL_STRIPE_ALIGN;
+                column_accumulate<ST>(sum_base, sum_step, b0 + 1, b1 + 1, i0, i1);
+                if (sqsum)
+                    column_accumulate<double>(sq_base, sq_step, b0 + 1, b1 + 1, i0, i1); });
+        }
+    }
+
+    /**
+     * @brief integral 的两个重载共用的实现: 检查参数, 确定 sum 的深度并分发。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入深度、sdepth 不受支持, 或显式要求的 IMG_32S 的和可能溢出。
+     */
+    static void integral_impl(const Image &src, Image &sum, Image *sqsum, int sdepth)
+    {
+        const std::string F_NAME = "integral";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        const int depth = src.get_depth();
+        if (depth != IMG_8U && depth != IMG_32F)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 IMG_8U / IMG_32F 图像, 收到 " + depth_to_string(depth));
+        }
+        // 每个通道的总和最大为 像素数 * 255, 超出 int 时 IMG_32S 会回绕
+        const bool int_may_overflow = static_cast<double>(src.get_rows()) * src.get_cols() * 255.0 > std::numeric_limits<int>::max();
+        if (sdepth < 0)
+            sdepth = depth == IMG_8U && !int_may_overflow ? IMG_32S : IMG_64F;
+        if (!(sdepth == IMG_64F || (depth == IMG_8U && sdepth == IMG_32S)))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "不支持的积分图深度 " + depth_to_string(sdepth) +
+                                        " (输入为 " + depth_to_string(depth) + ")");
+        }
+        // 调用者显式要求 IMG_32S 时不悄悄换成 IMG_64F, 而是报错
+        if (sdepth == IMG_32S && int_may_overflow)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "图像过大, IMG_32S 的积分图可能溢出, 请使用 IMG_64F。");
+        }
+
+        const Image s = pixel_contiguous(src);
+        const int cn = s.get_channels();
+        Image sum_out(s.get_rows() + 1, s.get_cols() + 1, IMG_MAKETYPE(sdepth, cn));
+        Image sq_out;
+        if (sqsum)
+            sq_out = Image(s.get_rows() + 1, s.get_cols() + 1, IMG_MAKETYPE(IMG_64F, cn));
+        Image *sq_ptr = sqsum ? &sq_out : nullptr;
+        if (depth == IMG_8U && sdepth == IMG_32S)
+        {
+            dispatch_channels<unsigned char>(cn, [&](auto tag)
+                                             { integral_kernel<unsigned char, int, decltype(tag)::channels>(s, sum_out, sq_ptr); });
+        }
+        else if (depth == IMG_8U)
+        {
+            dispatch_channels<unsigned char>(cn, [&](auto tag)
+                                             { integral_kernel<unsigned char, double, decltype(tag)::channels>(s, sum_out, sq_ptr); });
+        }
+        else
+        {
+            dispatch_channels<float>(cn, [&](auto tag)
+                                     { integral_kernel<float, double, decltype(tag)::channels>(s, sum_out, sq_ptr); });
+        }
+        sum = sum_out;
+        if (sqsum)
+            *sqsum = sq_out;
+    }
+
+    /**
+     * @brief 计算积分图。
+     * @param src IMG_8U 或 IMG_32F 图像, 支持 ROI 等视图。
+     * @param sum 输出, (rows + 1) x (cols + 1), 通道数与 src 相同。
+     * @param sdepth sum 的深度, -1 表示默认 (IMG_8U 输入为 IMG_32S, 和可能超出 int 时为 IMG_64F; IMG_32F 输入为 IMG_64F)。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果深度不受支持, 或显式要求的 IMG_32S 的和可能溢出。
+     */
+    void integral(const Image &src, Image &sum, int sdepth)
+    {
+        integral_impl(src, sum, nullptr, sdepth);
+    }
+
+    /**
+     * @brief 同时计算积分图和平方和的积分图。
+     * @param sqsum 输出, 平方和的积分图, 深度为 IMG_64F, 尺寸和通道数同 sum。
+     * 其它参数和异常同 integral(src, sum, sdepth)。
+     */
+    void integral(const Image &src, Image &sum, Image &sqsum, int sdepth)
+    {
+        integral_impl(src, sum, &sqsum, sdepth);
+    }
+}
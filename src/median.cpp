@@ -0,0 +1,387 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace img
+{
+    // 按列分条的宽度 (元素个数), 直方图方法中一条的列直方图 (每列 256 个 16 位计数) 能留在 L2 中
+    static const size_t MEDIAN_STRIPE = 256;
+    // 不超过这个尺寸的窗口使用排序网络, 更大的使用直方图方法
+    static const int MEDIAN_SORTNET_MAX_KSIZE = 5;
+
+    static inline unsigned char v_min(unsigned char a, unsigned char b) { return a < b ? a : b; }
+    static inline unsigned char v_max(unsigned char a, unsigned char b) { return a < b ? b : a; }
+#if defined(__SSE2__)
+    static inline __m128i v_min(__m128i a, __m128i b) { return _mm_min_epu8(a, b); }
+    static inline __m128i v_max(__m128i a, __m128i b) { return _mm_max_epu8(a, b); }
+#endif
+
+    /** @brief 比较交换: 之后 a <= b。V 为单个 8 位值或 16 个 8 位值的向量, 向量时每个通道各自比较。 */
+    template <typename V>
+    static inline void sort_pair(V &a, V &b)
+    {
+        const V t = v_min(a, b);
+        b = v_max(a, b);
+        a = t;
+    }
+
+    /** @brief 9 个值的中值, 19 次比较交换的排序网络 (只保证 p[4] 为中值)。 */
+    template <typename V>
+    static inline V median9(V *p)
+    {
+        sort_pair(p[1], p[2]); sort_pair(p[4], p[5]); sort_pair(p[7], p[8]);
+        sort_pair(p[0], p[1]); sort_pair(p[3], p[4]); sort_pair(p[6], p[7]);
+        sort_pair(p[1], p[2]); sort_pair(p[4], p[5]); sort_pair(p[7], p[8]);
+        sort_pair(p[0], p[3]); sort_pair(p[5], p[8]); sort_pair(p[4], p[7]);
+        sort_pair(p[3], p[6]); sort_pair(p[1], p[4]); sort_pair(p[2], p[5]);
+        sort_pair(p[4], p[7]); sort_pair(p[4], p[2]); sort_pair(p[6], p[4]);
+        sort_pair(p[4], p[2]);
+        return p[4];
+    }
+
+    /** @brief 25 个值的中值, 99 次比较交换的排序网络 (只保证 p[12] 为中值)。 */
+    template <typename V>
+    static inline V median25(V *p)
+    {
+        sort_pair(p[1], p[2]); sort_pair(p[0], p[1]); sort_pair(p[1], p[2]); sort_pair(p[4], p[5]); sort_pair(p[3], p[4]);
+        sort_pair(p[4], p[5]); sort_pair(p[0], p[3]); sort_pair(p[2], p[5]); sort_pair(p[2], p[3]); sort_pair(p[1], p[4]);
+        sort_pair(p[1], p[2]); sort_pair(p[3], p[4]); sort_pair(p[7], p[8]); sort_pair(p[6], p[7]); sort_pair(p[7], p[8]);
+        sort_pair(p[10], p[11]); sort_pair(p[9], p[10]); sort_pair(p[10], p[11]); sort_pair(p[6], p[9]); sort_pair(p[8], p[11]);
+        sort_pair(p[8], p[9]); sort_pair(p[7], p[10]); sort_pair(p[7], p[8]); sort_pair(p[9], p[10]); sort_pair(p[0], p[6]);
+        sort_pair(p[4], p[10]); sort_pair(p[4], p[6]); sort_pair(p[2], p[8]); sort_pair(p[2], p[4]); sort_pair(p[6], p[8]);
+        sort_pair(p[1], p[7]); sort_pair(p[5], p[11]); sort_pair(p[5], p[7]); sort_pair(p[3], p[9]); sort_pair(p[3], p[5]);
+        sort_pair(p[7], p[9]); sort_pair(p[1], p[2]); sort_pair(p[3], p[4]); sort_pair(p[5], p[6]); sort_pair(p[7], p[8]);
+        sort_pair(p[9], p[10]); sort_pair(p[13], p[14]); sort_pair(p[12], p[13]); sort_pair(p[13], p[14]); sort_pair(p[16], p[17]);
+        sort_pair(p[15], p[16]); sort_pair(p[16], p[17]); sort_pair(p[12], p[15]); sort_pair(p[14], p[17]); sort_pair(p[14], p[15]);
+        sort_pair(p[13], p[16]); sort_pair(p[13], p[14]); sort_pair(p[15], p[16]); sort_pair(p[19], p[20]); sort_pair(p[18], p[19]);
+        sort_pair(p[19], p[20]); sort_pair(p[21], p[22]); sort_pair(p[23], p[24]); sort_pair(p[21], p[23]); sort_pair(p[22], p[24]);
+        sort_pair(p[22], p[23]); sort_pair(p[18], p[21]); sort_pair(p[20], p[23]); sort_pair(p[20], p[21]); sort_pair(p[19], p[22]);
+        sort_pair(p[22], p[24]); sort_pair(p[19], p[20]); sort_pair(p[21], p[22]); sort_pair(p[23], p[24]); sort_pair(p[12], p[18]);
+        sort_pair(p[16], p[22]); sort_pair(p[16], p[18]); sort_pair(p[14], p[20]); sort_pair(p[20], p[24]); sort_pair(p[14], p[16]);
+        sort_pair(p[18], p[20]); sort_pair(p[22], p[24]); sort_pair(p[13], p[19]); sort_pair(p[17], p[23]); sort_pair(p[17], p[19]);
+        sort_pair(p[15], p[21]); sort_pair(p[15], p[17]); sort_pair(p[19], p[21]); sort_pair(p[13], p[14]); sort_pair(p[15], p[16]);
+        sort_pair(p[17], p[18]); sort_pair(p[19], p[20]); sort_pair(p[21], p[22]); sort_pair(p[23], p[24]); sort_pair(p[0], p[12]);
+        sort_pair(p[8], p[20]); sort_pair(p[8], p[12]); sort_pair(p[4], p[16]); sort_pair(p[16], p[24]); sort_pair(p[12], p[16]);
+        sort_pair(p[2], p[14]); sort_pair(p[10], p[22]); sort_pair(p[10], p[14]); sort_pair(p[6], p[18]); sort_pair(p[6], p[10]);
+        sort_pair(p[10], p[12]); sort_pair(p[1], p[13]); sort_pair(p[9], p[21]); sort_pair(p[9], p[13]); sort_pair(p[5], p[17]);
+        sort_pair(p[13], p[17]); sort_pair(p[3], p[15]); sort_pair(p[11], p[23]); sort_pair(p[11], p[15]); sort_pair(p[7], p[19]);
+        sort_pair(p[7], p[11]); sort_pair(p[11], p[13]); sort_pair(p[11], p[12]);
+        return p[12];
+    }
+
+    template <int K, typename V>
+    static inline V median_of(V *p)
+    {
+        if constexpr (K == 3)
+            return median9(p);
+        else
+            return median25(p);
+    }
+
+    /**
+     * @brief 把源图像第 y 行 (夹到有效范围, 即 BORDER_REPLICATE) 的第 [x0 - radius, x1 + radius) 个像素复制到 buf,
+     * 图像之外的列取边界像素。
+     */
+    static void load_stripe_row(const Image &src, int y, size_t x0, size_t x1, int radius, unsigned char *buf)
+    {
+        const int rows = static_cast<int>(src.get_rows());
+        const std::ptrdiff_t cols = static_cast<std::ptrdiff_t>(src.get_cols());
+        const size_t cn = src.get_channels();
+        y = std::max(0, std::min(rows - 1, y));
+        const unsigned char *p = src.data() + static_cast<std::ptrdiff_t>(y) * src.get_step();
+        const std::ptrdiff_t begin = static_cast<std::ptrdiff_t>(x0) - radius;
+        const std::ptrdiff_t end = static_cast<std::ptrdiff_t>(x1) + radius;
+        const std::ptrdiff_t in_begin = std::max<std::ptrdiff_t>(begin, 0);
+        const std::ptrdiff_t in_end = std::min(end, cols);
+        for (std::ptrdiff_t x = begin; x < in_begin; ++x)
+            std::memcpy(buf + (x - begin) * cn, p, cn);
+        std::memcpy(buf + (in_begin - begin) * cn, p + in_begin * cn, (in_end - in_begin) * cn);
+        for (std::ptrdiff_t x = in_end; x < end; ++x)
+            std::memcpy(buf + (x - begin) * cn, p + (cols - 1) * cn, cn);
+    }
+
+    /** @brief 列条数: 每条 MEDIAN_STRIPE 个元素 (至少一个像素)。 */
+    static size_t stripe_pixels(size_t cn)
+    {
+        return std::max<size_t>(1, MEDIAN_STRIPE / cn);
+    }
+
+    /**
+     * @brief 3x3 / 5x5 中值: 排序网络。
+     * 每个线程处理若干列条, 一条内用 K 行的环形缓冲区保存带边界的行; SSE2 时每次对 16 个元素
+     * (交错的各个通道) 同时执行网络, 每次比较交换只是一条 min 和一条 max 指令。
+     */
+    template <int K>
+    static void median_sortnet(const Image &src, Image &dst)
+    {
+        const int radius = K / 2;
+        const size_t rows = src.get_rows();
+        const size_t cols = src.get_cols();
+        const size_t cn = src.get_channels();
+        const size_t stripe = stripe_pixels(cn);
+        const size_t stripes = (cols + stripe - 1) / stripe;
+        parallel_for_rows(stripes, rows * stripe * cn * 2, [&](size_t begin, size_t end)
+                          {
+            const size_t ring_width = (stripe + 2 * radius) * cn;
+            std::vector<unsigned char> ring(K * ring_width);
+            const unsigned char *window[K];
+            for (size_t st = begin; st < end; ++st)
+            {
+                const size_t x0 = st * stripe;
+                const size_t x1 = std::min(cols, x0 + stripe);
+                const size_t n = (x1 - x0) * cn;
+                int next = -radius; // 下一个要载入的行
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    const int first = static_cast<int>(r) - radius;
+                    for (; next < first + K; ++next)
+                        load_stripe_row(src, next, x0, x1, radius, ring.data() + ((next % K + K) % K) * ring_width);
+                    for (int k = 0; k < K; ++k)
+                        window[k] = ring.data() + (((first + k) % K + K) % K) * ring_width;
+                    unsigned char *out = dst.data() + static_cast<std::ptrdiff_t>(r) * dst.get_step() + x0 * cn;
+                    size_t i = 0;
+#if defined(__SSE2__)
+                    for (; i + 16 <= n; i += 16)
+                    {
+                        __m128i p[K * K];
+                        for (int dy = 0; dy < K; ++dy)
+                        {
+                            for (int dx = 0; dx < K; ++dx)
+                                p[dy * K + dx] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(window[dy] + i + dx * cn));
+                        }
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), median_of<K>(p));
+                    }
+#endif
+                    for (; i < n; ++i)
+                    {
+                        unsigned char p[K * K];
+                        for (int dy = 0; dy < K; ++dy)
+                        {
+                            for (int dx = 0; dx < K; ++dx)
+                                p[dy * K + dx] = window[dy][i + dx * cn];
+                        }
+                        out[i] = median_of<K>(p);
+                    }
+                }
+            } });
+    }
+
+    /** @brief h += add - sub, 三者都是 16 个 16 位计数 (粗直方图或细直方图的一个粗区间)。 */
+    static inline void hist16_slide(std::uint16_t *h, const std::uint16_t *add, const std::uint16_t *sub)
+    {
+#if defined(__SSE2__)
+        for (int i = 0; i < 16; i += 8)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(add + i));
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sub + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(h + i), _mm_sub_epi16(_mm_add_epi16(v, a), s));
+        }
+#else
+        for (int i = 0; i < 16; ++i)
+            h[i] = static_cast<std::uint16_t>(h[i] + add[i] - sub[i]);
+#endif
+    }
+
+    /** @brief h += add, 16 个 16 位计数。 */
+    static inline void hist16_add(std::uint16_t *h, const std::uint16_t *add)
+    {
+#if defined(__SSE2__)
+        for (int i = 0; i < 16; i += 8)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + i));
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(add + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(h + i), _mm_add_epi16(v, a));
+        }
+#else
+        for (int i = 0; i < 16; ++i)
+            h[i] = static_cast<std::uint16_t>(h[i] + add[i]);
+#endif
+    }
+
+    /**
+     * @brief 在 16 个区间的直方图 h 中找中值所在的区间: 返回第一个使 sum + h[0..i] 的累积和超过 half 的 i,
+     * 并把它之前的区间的计数加到 sum 上。
+     * 累积和单调不减, 所以不超过 half 的前缀个数就是所求下标: SSE2 时在寄存器内求前缀和再一次比较,
+     * 没有依赖数据的分支 (中值所在位置随像素随机变化, 分支预测不准)。
+     */
+    static inline int find_rank_bin(const std::uint16_t *h, int &sum, int half)
+    {
+        std::uint16_t prefix[16];
+#if defined(__SSE2__)
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(h + 8));
+        lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+        hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+        lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+        hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+        lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+        hi = _mm_add_epi16(hi, _mm_set1_epi16(static_cast<short>(_mm_extract_epi16(lo, 7))));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(prefix), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(prefix + 8), hi);
+        // 计数最多为 255 * 255, 超出 int16 的范围, 异或符号位后用有符号比较实现无符号比较
+        const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+        const __m128i limit = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(half - sum)), bias);
+        const __m128i gt_lo = _mm_cmpgt_epi16(_mm_xor_si128(lo, bias), limit);
+        const __m128i gt_hi = _mm_cmpgt_epi16(_mm_xor_si128(hi, bias), limit);
+        const int mask = _mm_movemask_epi8(_mm_packs_epi16(gt_lo, gt_hi));
+        const int index = 16 - static_cast<int>(std::bitset<16>(static_cast<unsigned>(mask)).count());
+#else
+        int index = 0;
+        int acc = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            acc += h[i];
+            prefix[i] = static_cast<std::uint16_t>(acc);
+            index += sum + acc <= half;
+        }
+#endif
+        sum += index > 0 ? prefix[index - 1] : 0;
+        return index;
+    }
+
+    /**
+     * @brief 任意尺寸的中值: Perreault & Hébert 的常数时间直方图算法, 按列分条并行。
+     * 条内每一列 (每个通道) 保存窗口高度内的直方图, 分为 16 个粗区间和 256 个细区间; 每个输出行先把每列的
+     * 直方图下移一行 (减去离开的像素、加上进入的像素), 再从左到右滑动窗口直方图: 粗直方图每步加一列减一列,
+     * 细直方图只在中值落入某个粗区间时才把该区间补算到当前位置。每个像素的计算量与半径无关。
+     */
+    static void median_histogram(const Image &src, Image &dst, int ksize)
+    {
+        const int radius = ksize / 2;
+        const size_t rows = src.get_rows();
+        const size_t cols = src.get_cols();
+        const size_t cn = src.get_channels();
+        const size_t stripe = stripe_pixels(cn);
+        const size_t stripes = (cols + stripe - 1) / stripe;
+        const int half = ksize * ksize / 2; // 中值之前的元素个数
+        parallel_for_rows(stripes, rows * stripe * cn * 2 * ksize, [&](size_t begin, size_t end)
+                          {
+            const size_t max_cols = stripe + 2 * radius;
+            std::vector<std::uint16_t> col_fine(max_cols * cn * 256);
+            std::vector<std::uint16_t> col_coarse(max_cols * cn * 16);
+            std::vector<unsigned char> row_out(max_cols * cn);
+            std::vector<unsigned char> row_in(max_cols * cn);
+            for (size_t st = begin; st < end; ++st)
+            {
+                const size_t x0 = st * stripe;
+                const size_t x1 = std::min(cols, x0 + stripe);
+                const size_t width = x1 - x0;
+                const size_t hist_cols = width + 2 * radius;
+                std::fill_n(col_fine.begin(), hist_cols * cn * 256, std::uint16_t(0));
+                std::fill_n(col_coarse.begin(), hist_cols * cn * 16, std::uint16_t(0));
+                const size_t elems = hist_cols * cn;
+                std::uint16_t *cf = col_fine.data();
+                std::uint16_t *cc = col_coarse.data();
+                for (int y = -radius; y <= radius; ++y)
+                {
+                    load_stripe_row(src, y, x0, x1, radius, row_in.data());
+                    for (size_t e = 0; e < elems; ++e)
+                    {
+                        ++cf[e * 256 + row_in[e]];
+                        ++cc[e * 16 + (row_in[e] >> 4)];
+                    }
+                }
+                for (size_t r = 0; r < rows; ++r)
+                {
+                    if (r > 0)
+                    {
+                        // 列直方图下移一行; 离开和进入的像素相同时 (平坦区域很常见) 不需要修改
+                        load_stripe_row(src, static_cast<int>(r) - radius - 1, x0, x1, radius, row_out.data());
+                        load_stripe_row(src, static_cast<int>(r) + radius, x0, x1, radius, row_in.data());
+                        for (size_t e = 0; e < elems; ++e)
+                        {
+                            const unsigned char o = row_out[e];
+                            const unsigned char i = row_in[e];
+                            if (o == i)
+                                continue;
+                            --cf[e * 256 + o];
+                            ++cf[e * 256 + i];
+                            --cc[e * 16 + (o >> 4)];
+                            ++cc[e * 16 + (i >> 4)];
+                        }
+                    }
+                    unsigned char *out = dst.data() + static_cast<std::ptrdiff_t>(r) * dst.get_step() + x0 * cn;
+                    for (size_t c = 0; c < cn; ++c)
+                    {
+                        // 第 j 列 (条内, 含左边界) 的直方图
+                        auto fine = [&](size_t j) { return col_fine.data() + (j * cn + c) * 256; };
+                        auto coarse = [&](size_t j) { return col_coarse.data() + (j * cn + c) * 16; };
+                        std::uint16_t hc[16] = {};
+                        std::uint16_t hf[256];
+                        std::ptrdiff_t last[16]; // 细直方图的每个粗区间最后一次对应的窗口位置, -1 表示无效
+                        std::fill_n(last, 16, std::ptrdiff_t(-1));
+                        for (int j = 0; j < ksize; ++j)
+                            hist16_add(hc, coarse(j));
+                        for (size_t x = 0; x < width; ++x)
+                        {
+                            if (x > 0)
+                                hist16_slide(hc, coarse(x + ksize - 1), coarse(x - 1));
+                            int sum = 0;
+                            const int b = find_rank_bin(hc, sum, half);
+                            std::uint16_t *f = hf + b * 16;
+                            const std::ptrdiff_t xi = static_cast<std::ptrdiff_t>(x);
+                            if (last[b] < 0 || xi - last[b] >= ksize)
+                            {
+                                std::fill_n(f, 16, std::uint16_t(0));
+                                for (int j = 0; j < ksize; ++j)
+                                    hist16_add(f, fine(x + j) + b * 16);
+                            }
+                            else
+                            {
+                                for (std::ptrdiff_t xx = last[b] + 1; xx <= xi; ++xx)
+                                    hist16_slide(f, fine(xx + ksize - 1) + b * 16, fine(xx - 1) + b * 16);
+                            }
+                            last[b] = xi;
+                            const int v = find_rank_bin(f, sum, half);
+                            out[x * cn + c] = static_cast<unsigned char>(b * 16 + v);
+                        }
+                    }
+                }
+            } });
+    }
+
+    /**
+     * @brief 中值滤波, 图像之外的像素按 BORDER_REPLICATE 取值。
+     * 3x3 和 5x5 使用 SIMD 排序网络, 更大的窗口使用常数时间的直方图算法, 两者都按列分条并行。
+     * @param src IMG_8U 图像, 1/3/4 通道, 支持 ROI 等视图。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param ksize 窗口尺寸, 1 到 255 之间的奇数 (1 时为复制)。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入深度不是 IMG_8U 或 ksize 无效。
+     */
+    void median_blur(const Image &src, Image &dst, int ksize)
+    {
+        const std::string F_NAME = "median_blur";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (src.get_depth() != IMG_8U)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 IMG_8U 图像, 收到 " + depth_to_string(src.get_depth()));
+        }
+        if (ksize <= 0 || ksize % 2 == 0 || ksize > 255)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "ksize 必须是 1 到 255 之间的奇数, 收到 " + std::to_string(ksize));
+        }
+        const Image s = pixel_contiguous(src);
+        Image out(s.get_rows(), s.get_cols(), s.get_type());
+        if (ksize == 1)
+            s.copy_to(out);
+        else if (ksize == 3)
+            median_sortnet<3>(s, out);
+        else if (ksize <= MEDIAN_SORTNET_MAX_KSIZE)
+            median_sortnet<5>(s, out);
+        else
+            median_histogram(s, out, ksize);
+        dst = out;
+    }
+}
@@ -0,0 +1,403 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace img
+{
+    // 金字塔的中间类型: 16 位及以下的整数用 int (1 4 6 4 1 核的二维系数之和为 256, 不会溢出), 其它同 FilterWork
+    template <typename T>
+    using PyrWork = typename std::conditional<std::is_integral<T>::value && sizeof(T) <= 2, int, FilterWork<T>>::type;
+
+    /**
+     * @brief 把二维系数之和为 2^shift 的累加结果写为 T 类型。
+     * 核的系数都为正, 结果不会超出输入的取值范围, 整数只需要舍入 (加一半后算术右移) 而不需要饱和。
+     */
+    template <typename T, typename W>
+    static void store_pyr_row(W *acc, T *q, size_t n, int shift)
+    {
+        if constexpr (std::is_same<W, int>::value)
+        {
+            const int delta = 1 << (shift - 1);
+            for (size_t i = 0; i < n; ++i)
+                q[i] = static_cast<T>((acc[i] + delta) >> shift);
+        }
+        else
+        {
+            const W scale = W(1) / static_cast<W>(1 << shift);
+            for (size_t i = 0; i < n; ++i)
+                acc[i] *= scale;
+            store_row(acc, q, n);
+        }
+    }
+
+    /**
+     * @brief pyr_down 的水平一步: 对一行做 1 4 6 4 1 平滑并隔列抽取, out 为 dcols 个像素。
+     * 五个抽头都在行内的输出列直接计算, 只有两端的少数列经过 border_interpolate。
+     */
+    template <typename T, int CN, typename W>
+    static void pyr_down_row(const T *p, size_t scols, W *out, size_t dcols, BorderType border)
+    {
+        const int sc = static_cast<int>(scols);
+        auto edge = [&](size_t dx)
+        {
+            static const int weights[5] = {1, 4, 6, 4, 1};
+            for (int c = 0; c < CN; ++c)
+            {
+                W sum = 0;
+                for (int k = 0; k < 5; ++k)
+                {
+                    const int sx = border_interpolate(static_cast<int>(2 * dx) + k - 2, sc, border);
+                    if (sx >= 0)
+                        sum += static_cast<W>(weights[k]) * static_cast<W>(p[static_cast<size_t>(sx) * CN + c]);
+                }
+                out[dx * CN + c] = sum;
+            }
+        };
+        // 输出列 dx 的抽头为 2dx - 2 .. 2dx + 2, 都在行内时 1 <= dx <= (scols - 3) / 2
+        const size_t x_begin = std::min<size_t>(1, dcols);
+        const size_t x_end = scols >= 3 ? std::max(x_begin, std::min(dcols, (scols - 3) / 2 + 1)) : x_begin;
+        for (size_t dx = 0; dx < x_begin; ++dx)
+            edge(dx);
+        for (size_t dx = x_begin; dx < x_end; ++dx)
+        {
+            const T *s = p + (2 * dx - 2) * CN;
+            for (int c = 0; c < CN; ++c)
+            {
+                out[dx * CN + c] = static_cast<W>(s[c]) + static_cast<W>(s[4 * CN + c]) +
+                                   W(4) * (static_cast<W>(s[CN + c]) + static_cast<W>(s[3 * CN + c])) +
+                                   W(6) * static_cast<W>(s[2 * CN + c]);
+            }
+        }
+        for (size_t dx = x_end; dx < dcols; ++dx)
+            edge(dx);
+    }
+
+    /**
+     * @brief pyr_down 内核, 按输出行并行, dst 已经分配好 (可以是金字塔内存块上的视图)。
+     * 平滑和抽取融合在一起: 只对用到的源行做水平滤波, 且只计算保留的列; 每个线程用 5 行的环形缓冲区
+     * 保存水平结果, 每个输出行只需要两个新行, 垂直的 1 4 6 4 1 与舍入、写出在同一个循环中完成。
+     */
+    template <typename T, int CN>
+    static void pyr_down_kernel(const Image &src, Image &dst, BorderType border)
+    {
+        using W = PyrWork<T>;
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const int srows = static_cast<int>(s.rows());
+        const size_t scols = s.cols();
+        const size_t dcols = d.cols();
+        const size_t width = dcols * CN;
+        parallel_for_rows(d.rows(), width * sizeof(T) * 4, [&](size_t begin, size_t end)
+                          {
+            std::vector<W> ring(5 * width);
+            std::vector<W> acc(width);
+            int next = 2 * static_cast<int>(begin) - 2; // 下一个要做水平滤波的源行 (可能在图像之外)
+            for (size_t dy = begin; dy < end; ++dy)
+            {
+                const int first = 2 * static_cast<int>(dy) - 2;
+                for (; next <= first + 4; ++next)
+                {
+                    W *row = ring.data() + static_cast<size_t>(positive_mod(next, 5)) * width;
+                    const int sy = border_interpolate(next, srows, border);
+                    if (sy < 0)
+                        std::fill_n(row, width, W(0));
+                    else
+                        pyr_down_row<T, CN, W>(s.ptr(static_cast<size_t>(sy)), scols, row, dcols, border);
+                }
+                const W *r0 = ring.data() + static_cast<size_t>(positive_mod(first, 5)) * width;
+                const W *r1 = ring.data() + static_cast<size_t>(positive_mod(first + 1, 5)) * width;
+                const W *r2 = ring.data() + static_cast<size_t>(positive_mod(first + 2, 5)) * width;
+                const W *r3 = ring.data() + static_cast<size_t>(positive_mod(first + 3, 5)) * width;
+                const W *r4 = ring.data() + static_cast<size_t>(positive_mod(first + 4, 5)) * width;
+                for (size_t i = 0; i < width; ++i)
+                    acc[i] = r0[i] + r4[i] + W(4) * (r1[i] + r3[i]) + W(6) * r2[i];
+                store_pyr_row(acc.data(), d.ptr(dy), width, 8);
+            } });
+    }
+
+    /**
+     * @brief pyr_up 的水平一步: 偶数列为 p[i - 1] + 6p[i] + p[i + 1], 奇数列为 4(p[i] + p[i + 1]),
+     * 即插零后的 1 4 6 4 1 平滑; out 为 dcols 个像素。
+     */
+    template <typename T, int CN, typename W>
+    static void pyr_up_row(const T *p, size_t scols, W *out, size_t dcols, BorderType border)
+    {
+        const int sc = static_cast<int>(scols);
+        auto px = [&](int x, int c) -> W
+        {
+            const int sx = border_interpolate(x, sc, border);
+            return sx < 0 ? W(0) : static_cast<W>(p[static_cast<size_t>(sx) * CN + c]);
+        };
+        auto edge = [&](size_t dx)
+        {
+            const int i = static_cast<int>(dx / 2);
+            for (int c = 0; c < CN; ++c)
+            {
+                out[dx * CN + c] = dx % 2 == 0 ? px(i - 1, c) + W(6) * px(i, c) + px(i + 1, c)
+                                               : W(4) * (px(i, c) + px(i + 1, c));
+            }
+        };
+        // 源列 i 的三个抽头 i - 1, i, i + 1 都在行内时 1 <= i <= scols - 2, 一次写出输出的第 2i 和 2i + 1 列
+        const size_t i_end = std::min(scols >= 2 ? scols - 1 : 1, dcols / 2);
+        for (size_t dx = 0; dx < std::min<size_t>(2, dcols); ++dx)
+            edge(dx);
+        for (size_t i = 1; i < i_end; ++i)
+        {
+            const T *q = p + i * CN;
+            W *o = out + 2 * i * CN;
+            for (int c = 0; c < CN; ++c)
+            {
+                const W left = static_cast<W>(q[c - CN]);
+                const W mid = static_cast<W>(q[c]);
+                const W right = static_cast<W>(q[c + CN]);
+                o[c] = left + W(6) * mid + right;
+                o[CN + c] = W(4) * (mid + right);
+            }
+        }
+        for (size_t dx = std::max<size_t>(2, 2 * i_end); dx < dcols; ++dx)
+            edge(dx);
+    }
+
+    /**
+     * @brief pyr_up 内核, 按源行并行: 源行 j 生成输出的第 2j 和 2j + 1 行。
+     * 每个线程用 3 行的环形缓冲区保存水平放大后的源行 j - 1, j, j + 1。
+     */
+    template <typename T, int CN>
+    static void pyr_up_kernel(const Image &src, Image &dst, BorderType border)
+    {
+        using W = PyrWork<T>;
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const int srows = static_cast<int>(s.rows());
+        const size_t scols = s.cols();
+        const size_t drows = d.rows();
+        const size_t dcols = d.cols();
+        const size_t width = dcols * CN;
+        parallel_for_rows((drows + 1) / 2, width * sizeof(T) * 2, [&](size_t begin, size_t end)
+                          {
+            std::vector<W> ring(3 * width);
+            std::vector<W> acc(width);
+            int next = static_cast<int>(begin) - 1;
+            for (size_t j = begin; j < end; ++j)
+            {
+                const int first = static_cast<int>(j) - 1;
+                for (; next <= first + 2; ++next)
+                {
+                    W *row = ring.data() + static_cast<size_t>(positive_mod(next, 3)) * width;
+                    const int sy = border_interpolate(next, srows, border);
+                    if (sy < 0)
+                        std::fill_n(row, width, W(0));
+                    else
+                        pyr_up_row<T, CN, W>(s.ptr(static_cast<size_t>(sy)), scols, row, dcols, border);
+                }
+                const W *r0 = ring.data() + static_cast<size_t>(positive_mod(first, 3)) * width;
+                const W *r1 = ring.data() + static_cast<size_t>(positive_mod(first + 1, 3)) * width;
+                const W *r2 = ring.data() + static_cast<size_t>(positive_mod(first + 2, 3)) * width;
+                for (size_t i = 0; i < width; ++i)
+                    acc[i] = r0[i] + W(6) * r1[i] + r2[i];
+                store_pyr_row(acc.data(), d.ptr(2 * j), width, 6);
+                if (2 * j + 1 < drows)
+                {
+                    for (size_t i = 0; i < width; ++i)
+                        acc[i] = W(4) * (r1[i] + r2[i]);
+                    store_pyr_row(acc.data(), d.ptr(2 * j + 1), width, 6);
+                }
+            } });
+    }
+
+    /** @brief 对已经分配好的 dst 执行 pyr_down (src 行内像素紧密排列)。 */
+    static void pyr_down_into(const Image &src, Image &dst, BorderType border)
+    {
+        dispatch_type(src.get_type(), [&](auto tag)
+                      { pyr_down_kernel<typename decltype(tag)::type, decltype(tag)::channels>(src, dst, border); });
+    }
+
+    /** @brief pyr_down / pyr_up 共同的参数检查。 */
+    static void check_pyr_args(const Image &src, BorderType border, const std::string &F_NAME)
+    {
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        check_border_type(border, F_NAME);
+    }
+
+    /**
+     * @brief 高斯金字塔下采样一层。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param dsize 输出尺寸, 为空时为 ((cols + 1) / 2, (rows + 1) / 2)。
+     * @param border 图像之外像素的取法。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 dsize 与输入尺寸不匹配或 border 无效。
+     */
+    void pyr_down(const Image &src, Image &dst, Size dsize, BorderType border)
+    {
+        const std::string F_NAME = "pyr_down";
+        check_pyr_args(src, border, F_NAME);
+        const int rows = static_cast<int>(src.get_rows());
+        const int cols = static_cast<int>(src.get_cols());
+        if (dsize.width == 0 && dsize.height == 0)
+            dsize = Size{(cols + 1) / 2, (rows + 1) / 2};
+        if (dsize.width <= 0 || dsize.height <= 0 || std::abs(dsize.width * 2 - cols) > 2 || std::abs(dsize.height * 2 - rows) > 2)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输出尺寸 " + std::to_string(dsize.width) + " x " +
+                                        std::to_string(dsize.height) + " 与输入尺寸不匹配。");
+        }
+        const Image s = pixel_contiguous(src);
+        Image out(static_cast<size_t>(dsize.height), static_cast<size_t>(dsize.width), s.get_type());
+        pyr_down_into(s, out, border);
+        dst = out;
+    }
+
+    /**
+     * @brief 高斯金字塔上采样一层。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param dsize 输出尺寸, 为空时为 (cols * 2, rows * 2), 宽高也可以比两倍少 1。
+     * @param border 图像之外像素的取法。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 dsize 与输入尺寸不匹配或 border 无效。
+     */
+    void pyr_up(const Image &src, Image &dst, Size dsize, BorderType border)
+    {
+        const std::string F_NAME = "pyr_up";
+        check_pyr_args(src, border, F_NAME);
+        const int rows = static_cast<int>(src.get_rows());
+        const int cols = static_cast<int>(src.get_cols());
+        if (dsize.width == 0 && dsize.height == 0)
+            dsize = Size{cols * 2, rows * 2};
+        if (!(dsize.width == cols * 2 || dsize.width == cols * 2 - 1) || !(dsize.height == rows * 2 || dsize.height == rows * 2 - 1))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输出尺寸 " + std::to_string(dsize.width) + " x " +
+                                        std::to_string(dsize.height) + " 与输入尺寸不匹配。");
+        }
+        const Image s = pixel_contiguous(src);
+        Image out(static_cast<size_t>(dsize.height), static_cast<size_t>(dsize.width), s.get_type());
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { pyr_up_kernel<typename decltype(tag)::type, decltype(tag)::channels>(s, out, border); });
+        dst = out;
+    }
+
+    /**
+     * @brief 建立金字塔, 只分配内存, 各层在第一次访问时计算。
+     * @param base 第 0 层, 支持所有深度和 ROI 等视图 (行内像素不紧密排列时复制一份)。
+     * @param levels 最多的层数 (包括第 0 层), 至少为 1。
+     * @param border 下采样时图像之外像素的取法。
+     * @throw std::logic_error 如果 base 为空。
+     * @throw std::invalid_argument 如果 levels 或 border 无效。
+     */
+    Pyramid::Pyramid(const Image &base, int levels, BorderType border)
+    {
+        const std::string F_NAME = "Pyramid";
+        if (levels < 1)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "层数必须至少为 1, 收到 " + std::to_string(levels));
+        }
+        check_border_type(border, F_NAME);
+        m_max_levels = levels;
+        m_border = border;
+        reset(base);
+    }
+
+    /**
+     * @brief 换入新的第 0 层, 之后各层重新按需计算。
+     * 尺寸和类型与当前第 0 层相同, 且内存块只被本金字塔自己的各层视图引用时, 复用第 1 层及以上的内存块
+     * (每帧建立金字塔时不再分配内存); 调用者还持有以前的某一层 (或金字塔被复制过) 时分配新的内存块,
+     * 已经交出去的图像不会被新一帧的数据覆盖。
+     * @throw std::logic_error 如果 base 为空或金字塔未初始化。
+     */
+    void Pyramid::reset(const Image &base)
+    {
+        const std::string F_NAME = "Pyramid::reset";
+        if (base.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (m_max_levels < 1)
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "金字塔未初始化。");
+        }
+        const Image b = pixel_contiguous(base);
+        const bool same = !m_levels.empty() && m_levels[0].get_rows() == b.get_rows() &&
+                          m_levels[0].get_cols() == b.get_cols() && m_levels[0].get_type() == b.get_type();
+        // 引用计数包括 m_storage 本身和第 1 层及以上的视图, 即 m_levels.size()
+        const bool exclusive = m_storage.empty() || m_storage.get_refcount() == static_cast<int>(m_levels.size());
+        m_built = 1;
+        if (same && exclusive)
+        {
+            m_levels[0] = b;
+            return;
+        }
+
+        // 各层尺寸: 每层为上一层的 ((cols + 1) / 2, (rows + 1) / 2), 缩小到 1x1 为止
+        std::vector<Size> sizes{Size{static_cast<int>(b.get_cols()), static_cast<int>(b.get_rows())}};
+        while (static_cast<int>(sizes.size()) < m_max_levels && (sizes.back().width > 1 || sizes.back().height > 1))
+            sizes.push_back(Size{(sizes.back().width + 1) / 2, (sizes.back().height + 1) / 2});
+
+        m_levels.assign(1, b);
+        m_storage.release();
+        if (sizes.size() > 1)
+        {
+            // 第 1 层放在左侧, 第 2 层及以上在第 1 层右侧一列中依次向下排列:
+            // 总面积约为第 1 层的 1.5 倍, 而所有层上下堆叠需要约 2 倍
+            const size_t width1 = static_cast<size_t>(sizes[1].width);
+            const size_t right = sizes.size() > 2 ? static_cast<size_t>(sizes[2].width) : 0;
+            size_t column_rows = 0;
+            for (size_t i = 2; i < sizes.size(); ++i)
+                column_rows += static_cast<size_t>(sizes[i].height);
+            m_storage = Image(std::max(static_cast<size_t>(sizes[1].height), column_rows), width1 + right, b.get_type());
+            m_levels.push_back(m_storage.roi(0, 0, width1, static_cast<size_t>(sizes[1].height)));
+            size_t y = 0;
+            for (size_t i = 2; i < sizes.size(); ++i)
+            {
+                m_levels.push_back(m_storage.roi(width1, y, static_cast<size_t>(sizes[i].width), static_cast<size_t>(sizes[i].height)));
+                y += static_cast<size_t>(sizes[i].height);
+            }
+        }
+    }
+
+    /**
+     * @brief 返回第 i 层, 尚未计算时从已经计算好的最后一层逐层下采样得到。
+     * @throw std::out_of_range 如果 i 不在 [0, levels()) 内。
+     */
+    const Image &Pyramid::level(int i)
+    {
+        const std::string F_NAME = "Pyramid::level";
+        if (i < 0 || i >= levels())
+        {
+            throw std::out_of_range(IMG_ERROR_PREFIX(F_NAME) + "层号 " + std::to_string(i) + " 超出范围 [0, " +
+                                    std::to_string(levels()) + ")");
+        }
+        for (; m_built <= i; ++m_built)
+            pyr_down_into(m_levels[static_cast<size_t>(m_built - 1)], m_levels[static_cast<size_t>(m_built)], m_border);
+        return m_levels[static_cast<size_t>(i)];
+    }
+
+    /**
+     * @brief 计算拉普拉斯金字塔的第 i 层: level(i) - pyr_up(level(i + 1)), 最后一层为 level(i) 本身。
+     * laplacian(i) + pyr_up(level(i + 1)) 重建 level(i), 误差在浮点舍入以内 (浮点层上并不逐位相等)。
+     * @param dst 输出, 尺寸同 level(i), 深度为 IMG_32F (第 0 层为 IMG_64F 时为 IMG_64F)。
+     * @throw std::out_of_range 如果 i 不在 [0, levels()) 内。
+     */
+    void Pyramid::laplacian(int i, Image &dst)
+    {
+        const Image &g = level(i);
+        const int depth = g.get_depth() == IMG_64F ? IMG_64F : IMG_32F;
+        const int type = IMG_MAKETYPE(depth, g.get_channels());
+        Image out = g.convert_to(type);
+        if (i + 1 < levels())
+        {
+            // 在浮点上放大, 不经过整数舍入, 重建误差只来自浮点舍入
+            Image up;
+            pyr_up(level(i + 1).convert_to(type), up, Size{static_cast<int>(g.get_cols()), static_cast<int>(g.get_rows())}, m_border);
+            out -= up;
+        }
+        dst = out;
+    }
+}
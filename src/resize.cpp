@@ -0,0 +1,467 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace img
+{
+    // 8U 双线性/双三次插值的定点系数位数: 每个方向的系数之和为 2^11, 两个方向相乘为 2^22,
+    // 双三次的累加结果 (最大约 255 * 2^22 * 1.25^2) 仍在 int 范围内
+    static const int RESIZE_COEF_BITS = 11;
+    // 双三次插值的参数 a (与 OpenCV 相同)
+    static const double RESIZE_CUBIC_A = -0.75;
+
+    /**
+     * @brief 一个方向上的插值表: 第 i 个输出位置由 ksize 个源位置 index[i * ksize + k] 按 weight[i * ksize + k] 加权得到。
+     * 源位置已经夹到 [0, size) 内 (BORDER_REPLICATE), 抽头不足 ksize 个的位置用权重为 0 的抽头补齐。
+     */
+    struct ResizeAxis
+    {
+        int ksize = 0;
+        std::vector<int> index;
+        std::vector<double> weight;
+    };
+
+    /** @brief 计算 ssize -> dsize 的插值表, interp 不为 INTER_NEAREST。 */
+    static ResizeAxis resize_axis(int ssize, int dsize, InterpolationType interp)
+    {
+        const double scale = static_cast<double>(ssize) / dsize;
+        ResizeAxis ax;
+        auto clamp = [ssize](int p)
+        { return std::max(0, std::min(ssize - 1, p)); };
+        auto push = [&](int p, double w)
+        {
+            ax.index.push_back(clamp(p));
+            ax.weight.push_back(w);
+        };
+
+        if (interp == INTER_AREA && scale > 1.0)
+        {
+            // 输出像素 d 覆盖源坐标 [d * scale, (d + 1) * scale), 每个源像素的权重为重叠长度 / scale
+            std::vector<std::vector<std::pair<int, double>>> taps(static_cast<size_t>(dsize));
+            size_t ksize = 0;
+            for (int d = 0; d < dsize; ++d)
+            {
+                const double x0 = d * scale;
+                const double x1 = std::min(static_cast<double>(ssize), x0 + scale);
+                for (int j = static_cast<int>(std::floor(x0)); j < x1; ++j)
+                {
+                    const double overlap = std::min(x1, j + 1.0) - std::max(x0, static_cast<double>(j));
+                    if (overlap > 1e-9)
+                        taps[d].emplace_back(j, overlap / scale);
+                }
+                ksize = std::max(ksize, taps[d].size());
+            }
+            ax.ksize = static_cast<int>(ksize);
+            for (const auto &t : taps)
+            {
+                for (size_t k = 0; k < ksize; ++k)
+                {
+                    if (k < t.size())
+                        push(t[k].first, t[k].second);
+                    else
+                        push(t.back().first, 0.0);
+                }
+            }
+            return ax;
+        }
+
+        ax.ksize = interp == INTER_CUBIC ? 4 : 2;
+        for (int d = 0; d < dsize; ++d)
+        {
+            if (interp == INTER_AREA)
+            {
+                // 放大时的面积插值 (与 OpenCV 相同): 输出像素完全落在一个源像素内时直接取该像素, 否则按跨过的比例混合
+                const int sx = static_cast<int>(std::floor(d * scale));
+                double f = (d + 1) - (sx + 1) / scale;
+                f = f <= 0 ? 0.0 : f - std::floor(f);
+                push(sx, 1.0 - f);
+                push(sx + 1, f);
+                continue;
+            }
+            const double sx = (d + 0.5) * scale - 0.5;
+            const int x0 = static_cast<int>(std::floor(sx));
+            const double f = sx - x0;
+            if (interp == INTER_LINEAR)
+            {
+                push(x0, 1.0 - f);
+                push(x0 + 1, f);
+            }
+            else
+            {
+                const double A = RESIZE_CUBIC_A;
+                const double c0 = ((A * (f + 1) - 5 * A) * (f + 1) + 8 * A) * (f + 1) - 4 * A;
+                const double c1 = ((A + 2) * f - (A + 3)) * f * f + 1;
+                const double c2 = ((A + 2) * (1 - f) - (A + 3)) * (1 - f) * (1 - f) + 1;
+                push(x0 - 1, c0);
+                push(x0, c1);
+                push(x0 + 1, c2);
+                push(x0 + 2, 1.0 - c0 - c1 - c2);
+            }
+        }
+        return ax;
+    }
+
+    /**
+     * @brief 把插值表的权重转换为 W 类型。W 为 int 时转换为 RESIZE_COEF_BITS 位定点数,
+     * 舍入误差加到每组中绝对值最大的系数上, 保证每组之和恰好为 2^RESIZE_COEF_BITS (平坦区域结果不变)。
+     */
+    template <typename W>
+    static std::vector<W> resize_coeffs(const ResizeAxis &ax)
+    {
+        std::vector<W> out(ax.weight.size());
+        if constexpr (std::is_same<W, int>::value)
+        {
+            const int one = 1 << RESIZE_COEF_BITS;
+            for (size_t i = 0; i < out.size(); i += static_cast<size_t>(ax.ksize))
+            {
+                int sum = 0;
+                size_t largest = i;
+                for (size_t k = i; k < i + static_cast<size_t>(ax.ksize); ++k)
+                {
+                    out[k] = static_cast<int>(std::lround(ax.weight[k] * one));
+                    sum += out[k];
+                    if (std::abs(out[k]) > std::abs(out[largest]))
+                        largest = k;
+                }
+                out[largest] += one - sum;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < out.size(); ++i)
+                out[i] = static_cast<W>(ax.weight[i]);
+        }
+        return out;
+    }
+
+    /**
+     * @brief 水平插值一行: out[dx * CN + c] = sum_k alpha[dx * ksize + k] * p[xofs[dx * ksize + k] + c]。
+     * xofs 为源元素偏移 (源列号 * CN)。K 为编译期的抽头数 (0 表示运行时的 ksize), 双线性和双三次的内层循环完全展开。
+     */
+    template <int K, typename T, int CN, typename W>
+    static void resize_row_h(const T *p, W *out, size_t dcols, int ksize, const int *xofs, const W *alpha)
+    {
+        const int k_taps = K > 0 ? K : ksize;
+        for (size_t dx = 0; dx < dcols; ++dx)
+        {
+            const int *xo = xofs + dx * k_taps;
+            const W *a = alpha + dx * k_taps;
+            for (int c = 0; c < CN; ++c)
+            {
+                W sum = 0;
+                for (int k = 0; k < k_taps; ++k)
+                    sum += a[k] * static_cast<W>(p[xo[k] + c]);
+                out[dx * CN + c] = sum;
+            }
+        }
+    }
+
+#if defined(__SSE2__)
+    /**
+     * @brief 8U 定点水平插值的 SSE2 表: 按输出元素 (dx * CN + c) 展开的源偏移和 16 位系数。
+     * 每个元素的 K 个系数相邻存放, 连续的 8 个正好是 pmaddwd 的一个操作数。
+     */
+    struct ResizeTab16
+    {
+        std::vector<int> ofs;
+        std::vector<short> alpha;
+    };
+
+    static ResizeTab16 resize_tab16(const std::vector<int> &xofs, const std::vector<int> &alpha, size_t dcols, int cn, int ksize)
+    {
+        ResizeTab16 tab;
+        tab.ofs.reserve(dcols * cn * ksize);
+        tab.alpha.reserve(dcols * cn * ksize);
+        for (size_t dx = 0; dx < dcols; ++dx)
+        {
+            for (int c = 0; c < cn; ++c)
+            {
+                for (int k = 0; k < ksize; ++k)
+                {
+                    tab.ofs.push_back(xofs[dx * ksize + k] + c);
+                    tab.alpha.push_back(static_cast<short>(alpha[dx * ksize + k]));
+                }
+            }
+        }
+        return tab;
+    }
+
+    /**
+     * @brief 8U 水平插值的 SSE2 版本, K 为 2 (双线性) 或 4 (双三次), 结果与 resize_row_h 逐位相同。
+     * 每次计算 4 个输出元素: 按 tab 取出 4 * K 个源像素扩展为 16 位, 与相邻存放的系数做 pmaddwd;
+     * K 为 4 时每个元素得到两个部分和, 再把奇偶位置相加。剩余的元素逐个计算。
+     */
+    template <int K>
+    static void resize_row_h_u8(const unsigned char *p, int *out, size_t n, const int *ofs, const short *alpha)
+    {
+        static_assert(K == 2 || K == 4, "resize_row_h_u8 只支持 2 或 4 个抽头");
+        size_t e = 0;
+        for (; e + 4 <= n; e += 4)
+        {
+            const int *o = ofs + e * K;
+            const short *a = alpha + e * K;
+            const __m128i p0 = _mm_setr_epi16(p[o[0]], p[o[1]], p[o[2]], p[o[3]], p[o[4]], p[o[5]], p[o[6]], p[o[7]]);
+            const __m128i m0 = _mm_madd_epi16(p0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a)));
+            if constexpr (K == 2)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + e), m0);
+            }
+            else
+            {
+                const __m128i p1 = _mm_setr_epi16(p[o[8]], p[o[9]], p[o[10]], p[o[11]], p[o[12]], p[o[13]], p[o[14]], p[o[15]]);
+                const __m128 m1 = _mm_castsi128_ps(_mm_madd_epi16(p1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + 8))));
+                const __m128 m0f = _mm_castsi128_ps(m0);
+                const __m128i even = _mm_castps_si128(_mm_shuffle_ps(m0f, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+                const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(m0f, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + e), _mm_add_epi32(even, odd));
+            }
+        }
+        for (; e < n; ++e)
+        {
+            int sum = 0;
+            for (int k = 0; k < K; ++k)
+                sum += alpha[e * K + k] * static_cast<int>(p[ofs[e * K + k]]);
+            out[e] = sum;
+        }
+    }
+#endif
+
+    /** @brief 垂直插值: acc[i] = sum_k beta[k] * rows[k][i], K 的含义同 resize_row_h。 */
+    template <int K, typename W>
+    static void resize_row_v(const W *const *rows, const W *beta, int ksize, W *acc, size_t n)
+    {
+        const int k_taps = K > 0 ? K : ksize;
+        if (K == 2)
+        {
+            const W *r0 = rows[0];
+            const W *r1 = rows[1];
+            const W b0 = beta[0];
+            const W b1 = beta[1];
+            for (size_t i = 0; i < n; ++i)
+                acc[i] = b0 * r0[i] + b1 * r1[i];
+            return;
+        }
+        std::fill_n(acc, n, W(0));
+        for (int k = 0; k < k_taps; ++k)
+        {
+            const W *r = rows[k];
+            const W b = beta[k];
+            for (size_t i = 0; i < n; ++i)
+                acc[i] += b * r[i];
+        }
+    }
+
+    /** @brief 以编译期的抽头数 (2、4 或 0 表示其它) 调用 f(std::integral_constant<int, K>)。 */
+    template <typename F>
+    static void with_taps(int ksize, F &&f)
+    {
+        if (ksize == 2)
+            f(std::integral_constant<int, 2>{});
+        else if (ksize == 4)
+            f(std::integral_constant<int, 4>{});
+        else
+            f(std::integral_constant<int, 0>{});
+    }
+
+    /** @brief 把 8U 定点的垂直结果 (缩放了 2^(2 * RESIZE_COEF_BITS)) 舍入并饱和为 8 位。 */
+    static void store_fixed_row(const int *acc, unsigned char *q, size_t n)
+    {
+        const int shift = 2 * RESIZE_COEF_BITS;
+        const int delta = 1 << (shift - 1);
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128i d = _mm_set1_epi32(delta);
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i a = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i)), d), shift);
+            const __m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i + 4)), d), shift);
+            const __m128i c = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i + 8)), d), shift);
+            const __m128i e = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + i + 12)), d), shift);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(q + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, e)));
+        }
+#endif
+        for (; i < n; ++i)
+            q[i] = static_cast<unsigned char>(std::max(0, std::min(255, (acc[i] + delta) >> shift)));
+    }
+
+    /**
+     * @brief 可分离的缩放 (双线性、双三次、面积), 按输出行并行。
+     * 插值表在调用开始时计算一次。每个线程用 ay.ksize 行的缓冲区保存水平插值后的源行,
+     * 记录每个槽对应的源行号: 相邻输出行需要的源行大多已经在缓冲区中, 每个源行只做一次水平插值。
+     * W 为 int 时 (只用于 8U) 使用定点系数, 否则为浮点。
+     */
+    template <typename T, int CN, typename W>
+    static void resize_separable(const Image &src, Image &dst, const ResizeAxis &ax, const ResizeAxis &ay)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const size_t dcols = d.cols();
+        const size_t width = dcols * CN;
+        const int kx = ax.ksize;
+        const int ky = ay.ksize;
+        std::vector<int> xofs(ax.index.size());
+        for (size_t i = 0; i < xofs.size(); ++i)
+            xofs[i] = ax.index[i] * CN;
+        const std::vector<W> alpha = resize_coeffs<W>(ax);
+        const std::vector<W> beta = resize_coeffs<W>(ay);
+#if defined(__SSE2__)
+        // 8U 的双线性/双三次水平插值走 resize_row_h_u8
+        ResizeTab16 tab16;
+        if constexpr (std::is_same<W, int>::value)
+        {
+            if (kx == 2 || kx == 4)
+                tab16 = resize_tab16(xofs, alpha, dcols, CN, kx);
+        }
+#endif
+
+        parallel_for_rows(d.rows(), width * sizeof(W) * static_cast<size_t>(kx + ky), [&](size_t begin, size_t end)
+                          {
+            std::vector<W> ring(static_cast<size_t>(ky) * width);
+            std::vector<int> slot_row(ky, -1); // 每个槽中的源行号, -1 表示空
+            std::vector<const W *> rows(ky);
+            std::vector<W> acc(width);
+            for (size_t dy = begin; dy < end; ++dy)
+            {
+                const int *sy = ay.index.data() + dy * ky;
+                for (int k = 0; k < ky; ++k)
+                {
+                    rows[k] = nullptr;
+                    for (int j = 0; j < ky; ++j)
+                    {
+                        if (slot_row[j] == sy[k])
+                            rows[k] = ring.data() + static_cast<size_t>(j) * width;
+                    }
+                }
+                for (int k = 0; k < ky; ++k)
+                {
+                    if (rows[k])
+                        continue;
+                    // 选一个当前输出行不需要的槽; 需要的源行最多 ky 个, 所以一定存在
+                    int slot = 0;
+                    while (std::find(sy, sy + ky, slot_row[slot]) != sy + ky)
+                        ++slot;
+                    W *row = ring.data() + static_cast<size_t>(slot) * width;
+                    with_taps(kx, [&](auto taps)
+                              {
+                        constexpr int K = decltype(taps)::value;
+                        const T *p = s.ptr(static_cast<size_t>(sy[k]));
+#if defined(__SSE2__)
+                        if constexpr (std::is_same<W, int>::value && K > 0)
+                        {
+                            resize_row_h_u8<K>(p, row, width, tab16.ofs.data(), tab16.alpha.data());
+                            return;
+                        }
+#endif
+                        resize_row_h<K, T, CN, W>(p, row, dcols, kx, xofs.data(), alpha.data()); });
+                    slot_row[slot] = sy[k];
+                    for (int j = k; j < ky; ++j)
+                    {
+                        if (sy[j] == sy[k])
+                            rows[j] = row;
+                    }
+                }
+                with_taps(ky, [&](auto taps)
+                          { resize_row_v<decltype(taps)::value, W>(rows.data(), beta.data() + dy * ky, ky, acc.data(), width); });
+                if constexpr (std::is_same<W, int>::value)
+                    store_fixed_row(acc.data(), d.ptr(dy), width);
+                else
+                    store_row(acc.data(), d.ptr(dy), width);
+            } });
+    }
+
+    /** @brief 最近邻缩放: 每个输出像素取其中心对应的源像素, 行列的对应关系预先算好。 */
+    template <typename T, int CN>
+    static void resize_nearest(const Image &src, Image &dst)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        auto nearest = [](size_t ssize, size_t dsize)
+        {
+            const double scale = static_cast<double>(ssize) / dsize;
+            std::vector<size_t> map(dsize);
+            for (size_t i = 0; i < dsize; ++i)
+                map[i] = std::min(ssize - 1, static_cast<size_t>((i + 0.5) * scale));
+            return map;
+        };
+        std::vector<size_t> xofs = nearest(s.cols(), d.cols());
+        for (auto &x : xofs)
+            x *= CN;
+        const std::vector<size_t> ymap = nearest(s.rows(), d.rows());
+        const size_t dcols = d.cols();
+        parallel_for_rows(d.rows(), dcols * CN * sizeof(T), [&](size_t begin, size_t end)
+                          {
+            for (size_t dy = begin; dy < end; ++dy)
+            {
+                const T *p = s.ptr(ymap[dy]);
+                T *q = d.ptr(dy);
+                for (size_t dx = 0; dx < dcols; ++dx)
+                {
+                    for (int c = 0; c < CN; ++c)
+                        q[dx * CN + c] = p[xofs[dx] + c];
+                }
+            } });
+    }
+
+    /**
+     * @brief 缩放图像。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 尺寸为 dsize, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param dsize 输出尺寸, 宽高都至少为 1。
+     * @param interp 插值方式。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 dsize 或 interp 无效。
+     */
+    void resize(const Image &src, Image &dst, Size dsize, InterpolationType interp)
+    {
+        const std::string F_NAME = "resize";
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (dsize.width <= 0 || dsize.height <= 0)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输出尺寸无效: " + std::to_string(dsize.width) + " x " +
+                                        std::to_string(dsize.height));
+        }
+        if (interp < INTER_NEAREST || interp > INTER_AREA)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的插值方式: " + std::to_string(interp));
+        }
+
+        const Image s = pixel_contiguous(src);
+        Image out(static_cast<size_t>(dsize.height), static_cast<size_t>(dsize.width), s.get_type());
+        if (out.get_rows() == s.get_rows() && out.get_cols() == s.get_cols())
+        {
+            s.copy_to(out);
+        }
+        else if (interp == INTER_NEAREST)
+        {
+            dispatch_type(s.get_type(), [&](auto tag)
+                          { resize_nearest<typename decltype(tag)::type, decltype(tag)::channels>(s, out); });
+        }
+        else
+        {
+            const ResizeAxis ax = resize_axis(static_cast<int>(s.get_cols()), dsize.width, interp);
+            const ResizeAxis ay = resize_axis(static_cast<int>(s.get_rows()), dsize.height, interp);
+            if (s.get_depth() == IMG_8U && interp != INTER_AREA)
+            {
+                dispatch_channels<unsigned char>(s.get_channels(), [&](auto tag)
+                                                 { resize_separable<unsigned char, decltype(tag)::channels, int>(s, out, ax, ay); });
+            }
+            else
+            {
+                dispatch_type(s.get_type(), [&](auto tag)
+                              {
+                    using T = typename decltype(tag)::type;
+                    resize_separable<T, decltype(tag)::channels, FilterWork<T>>(s, out, ax, ay); });
+            }
+        }
+        dst = out;
+    }
+}
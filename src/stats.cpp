@@ -0,0 +1,604 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace img
+{
+    // 部分结果按固定大小的行块保存, 再按块的顺序合并: 浮点数的求和顺序与线程数无关, 结果可以复现
+    static const size_t REDUCE_BLOCK_ROWS = 16;
+    // 窄累加器 (int) 每累加这么多个像素就并入宽累加器, 8/16 位输入的和与 8 位输入的平方和都不会溢出
+    static const size_t REDUCE_SEGMENT = static_cast<size_t>(1) << 15;
+    // 内层循环展开的像素数, 每个位置使用独立的累加器: 打断依赖链, 也便于编译器向量化 (浮点累加不能重排)
+    static const int REDUCE_UNROLL = 4;
+
+    // 元素参与比较和计算时的类型: float16 先转换为 float, 其它类型不变
+    template <typename T>
+    using CalcType = typename std::conditional<std::is_same<T, float16>::value, float, T>::type;
+
+    /**
+     * @brief 和与平方和的累加器类型。
+     * 宽累加器 (wide_*) 用于整幅图像, 整数输入的和是精确的; 窄累加器用于一个像素段,
+     * 8/16 位整数在段内用 int 累加, 使向量化时每个通道元素只需要拓宽一次。
+     */
+    template <typename T>
+    struct ReduceTypes
+    {
+        static constexpr bool small_int = std::is_integral<T>::value && sizeof(T) <= 2;
+        using wide_sum = typename std::conditional<std::is_integral<T>::value, std::int64_t, double>::type;
+        using sum = typename std::conditional<small_int, int, wide_sum>::type;
+        // 16 位的平方需要 64 位累加, 32S 的平方和可能超出 int64 的范围, 使用 double
+        using wide_sq = typename std::conditional<small_int, std::int64_t, double>::type;
+        using sq = typename std::conditional<small_int && sizeof(T) == 1, int, wide_sq>::type;
+    };
+
+    template <typename T>
+    struct Moments
+    {
+        typename ReduceTypes<T>::wide_sum sum[4] = {};
+        typename ReduceTypes<T>::wide_sq sq[4] = {};
+        size_t count = 0;
+        // 累加的是 v - shift[k]; 只有 mean_std_dev 使用非零的偏移量
+        typename ReduceTypes<T>::sum shift[4] = {};
+    };
+
+    static inline const unsigned char *mask_row(const Image &mask, size_t r)
+    {
+        return mask.data() + static_cast<std::ptrdiff_t>(r) * mask.get_step();
+    }
+
+    /**
+     * @brief 把一行的和 (ABS 时为绝对值之和) 与平方和累加到 acc, 每个元素先减去 acc.shift。
+     * MASKED 时 mask 为零的像素按 0 累加 (按元素选择, 无分支), 并统计参与的像素数。
+     */
+    template <typename T, int CN, bool ABS, bool SQ, bool MASKED>
+    static void moments_row(const T *p, const unsigned char *m, size_t cols, Moments<T> &acc)
+    {
+        using S = typename ReduceTypes<T>::sum;
+        using Q = typename ReduceTypes<T>::sq;
+        constexpr int U = REDUCE_UNROLL;
+        S shift[CN];
+        for (int k = 0; k < CN; ++k)
+            shift[k] = acc.shift[k];
+        for (size_t c0 = 0; c0 < cols; c0 += REDUCE_SEGMENT)
+        {
+            const size_t c1 = std::min(cols, c0 + REDUCE_SEGMENT);
+            S s[U][CN] = {};
+            Q q[U][CN] = {};
+            size_t n = 0;
+            auto accumulate = [&](int u, size_t x)
+            {
+                const bool on = !MASKED || m[x] != 0;
+                n += on;
+                for (int k = 0; k < CN; ++k)
+                {
+                    S v = on ? static_cast<S>(static_cast<CalcType<T>>(p[x * CN + k])) - shift[k] : S(0);
+                    if (ABS)
+                        v = v < 0 ? -v : v;
+                    s[u][k] += v;
+                    if (SQ)
+                        q[u][k] += static_cast<Q>(v) * static_cast<Q>(v);
+                }
+            };
+            size_t c = c0;
+            for (; c + U <= c1; c += U)
+            {
+                for (int u = 0; u < U; ++u)
+                    accumulate(u, c + u);
+            }
+            for (; c < c1; ++c)
+                accumulate(0, c);
+            for (int u = 0; u < U; ++u)
+            {
+                for (int k = 0; k < CN; ++k)
+                {
+                    acc.sum[k] += s[u][k];
+                    acc.sq[k] += q[u][k];
+                }
+            }
+            acc.count += n;
+        }
+    }
+
+    /**
+     * @brief 按行块并行计算每个块的和与平方和。
+     * CENTERED 时每个块围绕块中第一个参与统计的像素累加 (见 mean_m2_kernel)。
+     */
+    template <typename T, int CN, bool ABS, bool SQ, bool CENTERED>
+    static std::vector<Moments<T>> moments_blocks(const Image &src, const Image &mask)
+    {
+        Image_<const T, CN> s(src);
+        const bool masked = !mask.empty();
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        const size_t blocks = (rows + REDUCE_BLOCK_ROWS - 1) / REDUCE_BLOCK_ROWS;
+        std::vector<Moments<T>> partial(blocks);
+        parallel_for_rows(blocks, REDUCE_BLOCK_ROWS * cols * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            for (size_t b = begin; b < end; ++b)
+            {
+                const size_t r1 = std::min(rows, (b + 1) * REDUCE_BLOCK_ROWS);
+                if constexpr (CENTERED)
+                {
+                    bool found = false;
+                    for (size_t r = b * REDUCE_BLOCK_ROWS; r < r1 && !found; ++r)
+                    {
+                        const T *p = s.ptr(r);
+                        for (size_t c = 0; c < cols && !found; ++c)
+                        {
+                            if (masked && mask_row(mask, r)[c] == 0)
+                                continue;
+                            for (int k = 0; k < CN; ++k)
+                                partial[b].shift[k] = static_cast<typename ReduceTypes<T>::sum>(static_cast<CalcType<T>>(p[c * CN + k]));
+                            found = true;
+                        }
+                    }
+                }
+                for (size_t r = b * REDUCE_BLOCK_ROWS; r < r1; ++r)
+                {
+                    if (masked)
+                        moments_row<T, CN, ABS, SQ, true>(s.ptr(r), mask_row(mask, r), cols, partial[b]);
+                    else
+                        moments_row<T, CN, ABS, SQ, false>(s.ptr(r), nullptr, cols, partial[b]);
+                }
+            } });
+        return partial;
+    }
+
+    /** @brief 整幅图像的和与平方和, 块的部分结果按顺序合并。 */
+    template <typename T, int CN, bool ABS, bool SQ>
+    static Moments<T> moments_kernel(const Image &src, const Image &mask)
+    {
+        const std::vector<Moments<T>> partial = moments_blocks<T, CN, ABS, SQ, false>(src, mask);
+        Moments<T> total;
+        for (const Moments<T> &m : partial)
+        {
+            for (int k = 0; k < CN; ++k)
+            {
+                total.sum[k] += m.sum[k];
+                total.sq[k] += m.sq[k];
+            }
+            total.count += m.count;
+        }
+        return total;
+    }
+
+    struct MomentsResult
+    {
+        Scalar sum;
+        Scalar sq;
+        size_t count;
+    };
+
+    template <bool ABS, bool SQ>
+    static MomentsResult compute_moments(const Image &src, const Image &mask)
+    {
+        const Image s = pixel_contiguous(src);
+        const Image m = mask.empty() ? Image() : pixel_contiguous(mask);
+        MomentsResult result{Scalar(0), Scalar(0), 0};
+        dispatch_type(s.get_type(), [&](auto tag)
+                      {
+            using T = typename decltype(tag)::type;
+            constexpr int CN = decltype(tag)::channels;
+            const Moments<T> total = moments_kernel<T, CN, ABS, SQ>(s, m);
+            for (int k = 0; k < CN; ++k)
+            {
+                result.sum[k] = static_cast<double>(total.sum[k]);
+                result.sq[k] = static_cast<double>(total.sq[k]);
+            }
+            result.count = total.count; });
+        return result;
+    }
+
+    struct MeanM2Result
+    {
+        Scalar mean;
+        Scalar m2; // 离差平方和 sum (v - mean)^2
+        size_t count;
+    };
+
+    /**
+     * @brief 一遍计算每个通道的均值和离差平方和。
+     * 直接用 sq / n - mean^2 时, 数据的偏移远大于离散程度会大数相消; 这里每个块围绕块中第一个参与统计的像素累加,
+     * 块内的 (count, mean, M2) 再按块的顺序用 Chan 的公式合并。
+     */
+    template <typename T, int CN>
+    static MeanM2Result mean_m2_kernel(const Image &src, const Image &mask)
+    {
+        const std::vector<Moments<T>> partial = moments_blocks<T, CN, false, true, true>(src, mask);
+        MeanM2Result result{Scalar(0), Scalar(0), 0};
+        for (const Moments<T> &m : partial)
+        {
+            if (m.count == 0)
+                continue;
+            const double nb = static_cast<double>(m.count);
+            const double na = static_cast<double>(result.count);
+            const double n = na + nb;
+            for (int k = 0; k < CN; ++k)
+            {
+                const double s1 = static_cast<double>(m.sum[k]);
+                const double mean_b = static_cast<double>(m.shift[k]) + s1 / nb;
+                const double m2_b = std::max(0.0, static_cast<double>(m.sq[k]) - s1 * s1 / nb);
+                const double delta = mean_b - result.mean[k];
+                result.mean[k] += delta * nb / n;
+                result.m2[k] += m2_b + delta * delta * na * nb / n;
+            }
+            result.count += m.count;
+        }
+        return result;
+    }
+
+    template <typename T>
+    struct MinMaxAcc
+    {
+        CalcType<T> min_val[4];
+        CalcType<T> max_val[4];
+        Point min_loc[4];
+        Point max_loc[4];
+        bool found = false;
+    };
+
+    /**
+     * @brief 求 [r0, r1) 行中每个通道的最小值/最大值及其第一次出现的位置。
+     * 第一遍只逐行求值 (展开的比较, 不记录下标), 同时记下最值所在的行;
+     * 第二遍只在记下的那一行中查找最值第一次出现的列。
+     */
+    template <typename T, int CN, bool MASKED>
+    static void min_max_block(const Image_<const T, CN> &s, const Image &mask, size_t r0, size_t r1, MinMaxAcc<T> &acc)
+    {
+        using C = CalcType<T>;
+        using Limits = std::numeric_limits<C>;
+        constexpr int U = REDUCE_UNROLL;
+        const C hi = Limits::has_infinity ? Limits::infinity() : Limits::max();
+        const C lo = Limits::has_infinity ? -Limits::infinity() : Limits::lowest();
+        const size_t cols = s.cols();
+        size_t min_row[CN] = {};
+        size_t max_row[CN] = {};
+
+        for (size_t r = r0; r < r1; ++r)
+        {
+            const T *p = s.ptr(r);
+            const unsigned char *m = MASKED ? mask_row(mask, r) : nullptr;
+            C mn[U][CN];
+            C mx[U][CN];
+            for (int u = 0; u < U; ++u)
+            {
+                for (int k = 0; k < CN; ++k)
+                {
+                    mn[u][k] = hi;
+                    mx[u][k] = lo;
+                }
+            }
+            size_t n = 0;
+            auto update = [&](int u, size_t x)
+            {
+                const bool on = !MASKED || m[x] != 0;
+                n += on;
+                for (int k = 0; k < CN; ++k)
+                {
+                    // 被 mask 排除的元素换成不影响结果的值, 比较本身没有分支 (对应 min/max 指令)
+                    const C v = static_cast<C>(p[x * CN + k]);
+                    const C v_min = on ? v : hi;
+                    const C v_max = on ? v : lo;
+                    mn[u][k] = v_min < mn[u][k] ? v_min : mn[u][k];
+                    mx[u][k] = v_max > mx[u][k] ? v_max : mx[u][k];
+                }
+            };
+            size_t c = 0;
+            for (; c + U <= cols; c += U)
+            {
+                for (int u = 0; u < U; ++u)
+                    update(u, c + u);
+            }
+            for (; c < cols; ++c)
+                update(0, c);
+            if (n == 0)
+                continue;
+            for (int k = 0; k < CN; ++k)
+            {
+                C row_min = mn[0][k];
+                C row_max = mx[0][k];
+                for (int u = 1; u < U; ++u)
+                {
+                    row_min = mn[u][k] < row_min ? mn[u][k] : row_min;
+                    row_max = mx[u][k] > row_max ? mx[u][k] : row_max;
+                }
+                // 严格比较: 相等时保留先出现的行
+                if (!acc.found || row_min < acc.min_val[k])
+                {
+                    acc.min_val[k] = row_min;
+                    min_row[k] = r;
+                }
+                if (!acc.found || row_max > acc.max_val[k])
+                {
+                    acc.max_val[k] = row_max;
+                    max_row[k] = r;
+                }
+            }
+            acc.found = true;
+        }
+        if (!acc.found)
+            return;
+
+        auto locate = [&](size_t r, int k, C value, Point &loc)
+        {
+            const T *p = s.ptr(r);
+            const unsigned char *m = MASKED ? mask_row(mask, r) : nullptr;
+            for (size_t x = 0; x < cols; ++x)
+            {
+                if ((!MASKED || m[x] != 0) && static_cast<C>(p[x * CN + k]) == value)
+                {
+                    loc.x = static_cast<int>(x);
+                    loc.y = static_cast<int>(r);
+                    return;
+                }
+            }
+        };
+        for (int k = 0; k < CN; ++k)
+        {
+            locate(min_row[k], k, acc.min_val[k], acc.min_loc[k]);
+            locate(max_row[k], k, acc.max_val[k], acc.max_loc[k]);
+        }
+    }
+
+    template <typename T, int CN>
+    static MinMaxAcc<T> min_max_kernel(const Image &src, const Image &mask)
+    {
+        Image_<const T, CN> s(src);
+        const bool masked = !mask.empty();
+        const size_t rows = s.rows();
+        const size_t blocks = (rows + REDUCE_BLOCK_ROWS - 1) / REDUCE_BLOCK_ROWS;
+        std::vector<MinMaxAcc<T>> partial(blocks);
+        parallel_for_rows(blocks, REDUCE_BLOCK_ROWS * s.cols() * sizeof(T) * CN, [&](size_t begin, size_t end)
+                          {
+            for (size_t b = begin; b < end; ++b)
+            {
+                const size_t r0 = b * REDUCE_BLOCK_ROWS;
+                const size_t r1 = std::min(rows, r0 + REDUCE_BLOCK_ROWS);
+                if (masked)
+                    min_max_block<T, CN, true>(s, mask, r0, r1, partial[b]);
+                else
+                    min_max_block<T, CN, false>(s, mask, r0, r1, partial[b]);
+            } });
+        // 按块的顺序合并, 严格比较保证相等时取行优先顺序中第一次出现的位置
+        MinMaxAcc<T> total;
+        for (const MinMaxAcc<T> &part : partial)
+        {
+            if (!part.found)
+                continue;
+            for (int k = 0; k < CN; ++k)
+            {
+                if (!total.found || part.min_val[k] < total.min_val[k])
+                {
+                    total.min_val[k] = part.min_val[k];
+                    total.min_loc[k] = part.min_loc[k];
+                }
+                if (!total.found || part.max_val[k] > total.max_val[k])
+                {
+                    total.max_val[k] = part.max_val[k];
+                    total.max_loc[k] = part.max_loc[k];
+                }
+            }
+            total.found = true;
+        }
+        return total;
+    }
+
+    template <typename T>
+    static size_t count_non_zero_kernel(const Image &src, const Image &mask)
+    {
+        Image_<const T, 1> s(src);
+        const bool masked = !mask.empty();
+        const size_t rows = s.rows();
+        const size_t cols = s.cols();
+        const size_t blocks = (rows + REDUCE_BLOCK_ROWS - 1) / REDUCE_BLOCK_ROWS;
+        std::vector<size_t> partial(blocks, 0);
+        parallel_for_rows(blocks, REDUCE_BLOCK_ROWS * cols * sizeof(T), [&](size_t begin, size_t end)
+                          {
+            for (size_t b = begin; b < end; ++b)
+            {
+                size_t n = 0;
+                const size_t r1 = std::min(rows, (b + 1) * REDUCE_BLOCK_ROWS);
+                for (size_t r = b * REDUCE_BLOCK_ROWS; r < r1; ++r)
+                {
+                    const T *p = s.ptr(r);
+                    if (masked)
+                    {
+                        const unsigned char *m = mask_row(mask, r);
+                        for (size_t c = 0; c < cols; ++c)
+                            n += (static_cast<CalcType<T>>(p[c]) != 0) & (m[c] != 0);
+                    }
+                    else
+                    {
+                        for (size_t c = 0; c < cols; ++c)
+                            n += static_cast<CalcType<T>>(p[c]) != 0;
+                    }
+                }
+                partial[b] = n;
+            } });
+        size_t total = 0;
+        for (size_t n : partial)
+            total += n;
+        return total;
+    }
+
+    /**
+     * @brief 统计函数共用的输入检查。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 mask 非空但类型或尺寸不符合要求。
+     */
+    static void check_stats_input(const Image &src, const Image &mask, const std::string &F_NAME)
+    {
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (!mask.empty())
+        {
+            Image::check_mask(src, mask, F_NAME);
+        }
+    }
+
+    /**
+     * @brief 计算每个通道的元素之和。整数图像的和是精确的 (64 位整数累加)。
+     * @param src 输入图像, 支持所有深度和通道数 (包括 ROI 等视图)。
+     * @param mask 可选的掩码, 为空图像时统计所有像素。
+     * @return 第 k 个元素为第 k 个通道的和, 多余的元素为 0。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 mask 不符合要求。
+     */
+    Scalar sum(const Image &src, const Image &mask)
+    {
+        check_stats_input(src, mask, "sum");
+        return compute_moments<false, false>(src, mask).sum;
+    }
+
+    /**
+     * @brief 计算每个通道的均值。mask 没有选中任何像素时返回 0。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 mask 不符合要求。
+     */
+    Scalar mean(const Image &src, const Image &mask)
+    {
+        check_stats_input(src, mask, "mean");
+        const MomentsResult m = compute_moments<false, false>(src, mask);
+        Scalar result(0);
+        if (m.count == 0)
+            return result;
+        for (int k = 0; k < src.get_channels(); ++k)
+            result[k] = m.sum[k] / static_cast<double>(m.count);
+        return result;
+    }
+
+    /**
+     * @brief 在一遍中计算每个通道的均值和 (总体) 标准差。mask 没有选中任何像素时两者都为 0。
+     * 数值上与两遍算法相当: 数据的偏移远大于离散程度 (例如 1e6 附近的 32F 图像) 时标准差仍然准确。
+     * @param src 输入图像。
+     * @param mean 输出每个通道的均值。
+     * @param stddev 输出每个通道的标准差。
+     * @param mask 可选的掩码。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 mask 不符合要求。
+     */
+    void mean_std_dev(const Image &src, Scalar &mean, Scalar &stddev, const Image &mask)
+    {
+        check_stats_input(src, mask, "mean_std_dev");
+        const Image s = pixel_contiguous(src);
+        const Image m = mask.empty() ? Image() : pixel_contiguous(mask);
+        MeanM2Result r{Scalar(0), Scalar(0), 0};
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { r = mean_m2_kernel<typename decltype(tag)::type, decltype(tag)::channels>(s, m); });
+        mean = Scalar(0);
+        stddev = Scalar(0);
+        if (r.count == 0)
+            return;
+        const double n = static_cast<double>(r.count);
+        for (int k = 0; k < src.get_channels(); ++k)
+        {
+            mean[k] = r.mean[k];
+            stddev[k] = std::sqrt(r.m2[k] / n);
+        }
+    }
+
+    /**
+     * @brief 求每个通道的最小值、最大值以及它们第一次出现的位置 (按行优先顺序)。
+     * 浮点图像中的 NaN 被忽略。mask 没有选中任何像素时值为 0, 位置为 (-1, -1)。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 mask 不符合要求。
+     */
+    MinMaxLoc min_max_loc(const Image &src, const Image &mask)
+    {
+        const std::string F_NAME = "min_max_loc";
+        check_stats_input(src, mask, F_NAME);
+        const Image s = pixel_contiguous(src);
+        const Image m = mask.empty() ? Image() : pixel_contiguous(mask);
+        MinMaxLoc result;
+        result.min_val = Scalar(0);
+        result.max_val = Scalar(0);
+        dispatch_type(s.get_type(), [&](auto tag)
+                      {
+            using T = typename decltype(tag)::type;
+            constexpr int CN = decltype(tag)::channels;
+            const MinMaxAcc<T> total = min_max_kernel<T, CN>(s, m);
+            if (!total.found)
+                return;
+            for (int k = 0; k < CN; ++k)
+            {
+                result.min_val[k] = static_cast<double>(total.min_val[k]);
+                result.max_val[k] = static_cast<double>(total.max_val[k]);
+                result.min_loc[k] = total.min_loc[k];
+                result.max_loc[k] = total.max_loc[k];
+            } });
+        return result;
+    }
+
+    /**
+     * @brief 计算图像的范数, 所有通道的元素合在一起计算。
+     * @param src 输入图像。
+     * @param norm_type NORM_INF (最大绝对值), NORM_L1 (绝对值之和) 或 NORM_L2 (平方和的平方根)。
+     * @param mask 可选的掩码。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 norm_type 无效或 mask 不符合要求。
+     */
+    double norm(const Image &src, NormType norm_type, const Image &mask)
+    {
+        const std::string F_NAME = "norm";
+        check_stats_input(src, mask, F_NAME);
+        const int cn = src.get_channels();
+        double result = 0.0;
+        switch (norm_type)
+        {
+        case NORM_INF:
+        {
+            const MinMaxLoc mm = min_max_loc(src, mask);
+            for (int k = 0; k < cn; ++k)
+                result = std::max(result, std::max(std::abs(mm.min_val[k]), std::abs(mm.max_val[k])));
+            break;
+        }
+        case NORM_L1:
+        {
+            const MomentsResult m = compute_moments<true, false>(src, mask);
+            for (int k = 0; k < cn; ++k)
+                result += m.sum[k];
+            break;
+        }
+        case NORM_L2:
+        {
+            const MomentsResult m = compute_moments<false, true>(src, mask);
+            for (int k = 0; k < cn; ++k)
+                result += m.sq[k];
+            result = std::sqrt(result);
+            break;
+        }
+        default:
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的范数类型: " + std::to_string(norm_type));
+        }
+        return result;
+    }
+
+    /**
+     * @brief 统计非零元素的个数。
+     * @param src 单通道输入图像, 支持所有深度。
+     * @param mask 可选的掩码。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果输入不是单通道图像或 mask 不符合要求。
+     */
+    size_t count_non_zero(const Image &src, const Image &mask)
+    {
+        const std::string F_NAME = "count_non_zero";
+        check_stats_input(src, mask, F_NAME);
+        if (src.get_channels() != 1)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持单通道图像, 收到 " + std::to_string(src.get_channels()) + " 通道。");
+        }
+        const Image s = pixel_contiguous(src);
+        const Image m = mask.empty() ? Image() : pixel_contiguous(mask);
+        return dispatch_depth(s.get_depth(), [&](auto tag)
+                              { return count_non_zero_kernel<typename decltype(tag)::type>(s, m); });
+    }
+}
@@ -0,0 +1,594 @@
+#include "../include/imglib.h"
+#include "image_internal.h"
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace img
+{
+    // 采样坐标的小数部分量化为 INTER_BITS 位: 每个方向 32 个位置, 双线性的权重从 32x32 项的表中查出
+    static const int INTER_BITS = 5;
+    static const int INTER_TAB_SIZE = 1 << INTER_BITS;
+    // 8U 双线性权重的定点位数, 四个权重之和为 2^15, 累加结果 (最大 255 * 2^15) 在 int 范围内
+    static const int INTER_REMAP_COEF_BITS = 15;
+    // 仿射变换中每列坐标增量的定点位数, 每行的起点只需要加上该列的增量
+    static const int WARP_AB_BITS = 10;
+    // 输出按 WARP_TILE x WARP_TILE 的块处理, 一块对应的源区域能留在 L1/L2 中 (旋转时尤其重要)
+    static const size_t WARP_TILE = 64;
+
+    /**
+     * @brief 把 double 夹到 [-2^29, 2^29] 后舍入为整数 (取最近偶数)。两个这样的值再加上舍入偏移 (< 2^10)
+     * 也在 [-2^30 - 2^10, 2^30 + 2^10] 内, 不会溢出 int; 2^29 个 1/1024 像素仍远大于源图像尺寸的上限 32767。
+     * 透视变换对每个像素调用两次, SSE2 时用一条 cvtsd2si 代替 lrint 的库函数调用。
+     */
+    static inline int clamp_round(double v)
+    {
+        const double limit = static_cast<double>(1 << 29);
+        v = std::max(-limit, std::min(limit, v));
+#if defined(__SSE2__)
+        return _mm_cvtsd_si32(_mm_set_sd(v));
+#else
+        return static_cast<int>(std::lrint(v));
+#endif
+    }
+
+    static inline short saturate_short(int v)
+    {
+        return static_cast<short>(std::max<int>(std::numeric_limits<short>::min(), std::min<int>(std::numeric_limits<short>::max(), v)));
+    }
+
+    /**
+     * @brief 双线性权重表: 第 (fy * INTER_TAB_SIZE + fx) 组为 (1-fx)(1-fy), fx(1-fy), (1-fx)fy, fx fy。
+     * W 为 int 时为 INTER_REMAP_COEF_BITS 位定点数, 误差加到最大的权重上, 保证每组之和恰好为 2^15。
+     * 每种 W 只在第一次使用时计算一次。
+     */
+    template <typename W>
+    static const W *bilinear_table()
+    {
+        static const std::vector<W> table = []
+        {
+            std::vector<W> tab(INTER_TAB_SIZE * INTER_TAB_SIZE * 4);
+            for (int fy = 0; fy < INTER_TAB_SIZE; ++fy)
+            {
+                for (int fx = 0; fx < INTER_TAB_SIZE; ++fx)
+                {
+                    const double ax = static_cast<double>(fx) / INTER_TAB_SIZE;
+                    const double ay = static_cast<double>(fy) / INTER_TAB_SIZE;
+                    const double w[4] = {(1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay};
+                    W *t = tab.data() + (fy * INTER_TAB_SIZE + fx) * 4;
+                    if constexpr (std::is_same<W, int>::value)
+                    {
+                        const int one = 1 << INTER_REMAP_COEF_BITS;
+                        int sum = 0;
+                        int largest = 0;
+                        for (int k = 0; k < 4; ++k)
+                        {
+                            t[k] = static_cast<int>(std::lround(w[k] * one));
+                            sum += t[k];
+                            if (t[k] > t[largest])
+                                largest = k;
+                        }
+                        t[largest] += one - sum;
+                    }
+                    else
+                    {
+                        for (int k = 0; k < 4; ++k)
+                            t[k] = static_cast<W>(w[k]);
+                    }
+                }
+            }
+            return tab;
+        }();
+        return table.data();
+    }
+
+    /** @brief 插值结果转换为 T: 定点 (W 为 int) 时舍入后右移, 整数四舍五入, 浮点直接转换。权重为凸组合, 不需要饱和。 */
+    template <typename T, typename W>
+    static inline T interp_cast(W v)
+    {
+        if constexpr (std::is_same<W, int>::value)
+            return static_cast<T>((v + (1 << (INTER_REMAP_COEF_BITS - 1))) >> INTER_REMAP_COEF_BITS);
+        else if constexpr (is_float_type<T>::value)
+            return static_cast<T>(v);
+        else
+            return static_cast<T>(std::lrint(v));
+    }
+
+    /**
+     * @brief 最近邻采样一行: 第 i 个输出像素取源像素 (xy[2i], xy[2i + 1])。
+     * 图像内的坐标直接读取, 之外的坐标经过 border_interpolate, BORDER_CONSTANT 时取 bval。
+     */
+    template <typename T, int CN>
+    static void sample_nearest_row(const Image_<const T, CN> &s, const short *xy, T *q, size_t n, BorderType border, const Vec<T, CN> &bval)
+    {
+        const int cols = static_cast<int>(s.cols());
+        const int rows = static_cast<int>(s.rows());
+        for (size_t i = 0; i < n; ++i, q += CN)
+        {
+            int x = xy[2 * i];
+            int y = xy[2 * i + 1];
+            if (static_cast<unsigned>(x) >= static_cast<unsigned>(cols) || static_cast<unsigned>(y) >= static_cast<unsigned>(rows))
+            {
+                x = border_interpolate(x, cols, border);
+                y = border_interpolate(y, rows, border);
+            }
+            const T *p = x < 0 || y < 0 ? bval.val : s.ptr(static_cast<size_t>(y)) + static_cast<size_t>(x) * CN;
+            for (int c = 0; c < CN; ++c)
+                q[c] = p[c];
+        }
+    }
+
+    /**
+     * @brief 双线性采样一行: 第 i 个输出像素由以 (xy[2i], xy[2i + 1]) 为左上角的 2x2 邻域按 tab[fxy[i] * 4 ..] 加权得到。
+     * 四个点都在图像内时直接读取; 否则每个点分别经过 border_interpolate, BORDER_CONSTANT 时图像之外的点取 bval。
+     * fxy 只取低 2 * INTER_BITS 位, 外部构造的 FixedPointMap 中越界的索引也不会读到表外, 不需要预先检查整张表。
+     */
+    template <typename T, int CN, typename W>
+    static void sample_linear_row(const Image_<const T, CN> &s, const short *xy, const unsigned short *fxy, T *q, size_t n,
+                                  BorderType border, const Vec<T, CN> &bval, const W *tab)
+    {
+        const int cols = static_cast<int>(s.cols());
+        const int rows = static_cast<int>(s.rows());
+        for (size_t i = 0; i < n; ++i, q += CN)
+        {
+            const int x = xy[2 * i];
+            const int y = xy[2 * i + 1];
+            const W *w = tab + static_cast<size_t>(fxy[i] & (INTER_TAB_SIZE * INTER_TAB_SIZE - 1)) * 4;
+            const T *p00;
+            const T *p01;
+            const T *p10;
+            const T *p11;
+            if (static_cast<unsigned>(x) < static_cast<unsigned>(cols - 1) && static_cast<unsigned>(y) < static_cast<unsigned>(rows - 1))
+            {
+                p00 = s.ptr(static_cast<size_t>(y)) + static_cast<size_t>(x) * CN;
+                p01 = p00 + CN;
+                p10 = s.ptr(static_cast<size_t>(y) + 1) + static_cast<size_t>(x) * CN;
+                p11 = p10 + CN;
+            }
+            else
+            {
+                if (border == BORDER_CONSTANT && (x >= cols || x + 1 < 0 || y >= rows || y + 1 < 0))
+                {
+                    for (int c = 0; c < CN; ++c)
+                        q[c] = bval[c];
+                    continue;
+                }
+                const int x0 = border_interpolate(x, cols, border);
+                const int x1 = border_interpolate(x + 1, cols, border);
+                const int y0 = border_interpolate(y, rows, border);
+                const int y1 = border_interpolate(y + 1, rows, border);
+                auto tap = [&](int yy, int xx)
+                { return yy < 0 || xx < 0 ? bval.val : s.ptr(static_cast<size_t>(yy)) + static_cast<size_t>(xx) * CN; };
+                p00 = tap(y0, x0);
+                p01 = tap(y0, x1);
+                p10 = tap(y1, x0);
+                p11 = tap(y1, x1);
+            }
+            for (int c = 0; c < CN; ++c)
+            {
+                const W v = w[0] * static_cast<W>(p00[c]) + w[1] * static_cast<W>(p01[c]) +
+                            w[2] * static_cast<W>(p10[c]) + w[3] * static_cast<W>(p11[c]);
+                q[c] = interp_cast<T, W>(v);
+            }
+        }
+    }
+
+    /**
+     * @brief 按定点坐标 (整数部分 xy 和小数部分的表索引 fxy) 采样一行, 是 warp 各函数共用的内层。
+     * 8U 的双线性使用定点权重, 其它深度使用 FilterWork<T> 的浮点权重。
+     */
+    template <typename T, int CN>
+    static void sample_row(const Image_<const T, CN> &s, const short *xy, const unsigned short *fxy, T *q, size_t n,
+                           InterpolationType interp, BorderType border, const Vec<T, CN> &bval)
+    {
+        if (interp == INTER_NEAREST)
+            sample_nearest_row<T, CN>(s, xy, q, n, border, bval);
+        else if constexpr (std::is_same<T, unsigned char>::value)
+            sample_linear_row<T, CN, int>(s, xy, fxy, q, n, border, bval, bilinear_table<int>());
+        else
+            sample_linear_row<T, CN, FilterWork<T>>(s, xy, fxy, q, n, border, bval, bilinear_table<FilterWork<T>>());
+    }
+
+    /**
+     * @brief 把以 1/INTER_TAB_SIZE 像素为单位的定点坐标 (X, Y) 拆成整数部分和表索引。
+     */
+    static inline void split_fixed(int X, int Y, short *xy, unsigned short *fxy)
+    {
+        xy[0] = saturate_short(X >> INTER_BITS);
+        xy[1] = saturate_short(Y >> INTER_BITS);
+        *fxy = static_cast<unsigned short>((Y & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (X & (INTER_TAB_SIZE - 1)));
+    }
+
+    /**
+     * @brief warp / remap 的分块框架: 输出按 WARP_TILE 行的水平带并行, 带内从左到右逐块处理。
+     * coords(y, x0, n, xy, fxy) 生成输出第 y 行 [x0, x0 + n) 列的定点源坐标 (最近邻时 xy 已是取整后的坐标, 不使用 fxy),
+     * 随后立即在同一块内采样, 坐标只在栈上的小缓冲区中停留。
+     */
+    template <typename T, int CN, typename Coords>
+    static void warp_tiles(const Image &src, Image &dst, InterpolationType interp, BorderType border, const Scalar &border_value, Coords &&coords)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const Vec<T, CN> bval = scalar_to_pixel<T, CN>(border_value);
+        const size_t rows = d.rows();
+        const size_t cols = d.cols();
+        const size_t bands = (rows + WARP_TILE - 1) / WARP_TILE;
+        parallel_for_rows(bands, WARP_TILE * cols * CN * sizeof(T) * 4, [&](size_t begin, size_t end)
+                          {
+            short xy[2 * WARP_TILE];
+            unsigned short fxy[WARP_TILE];
+            for (size_t band = begin; band < end; ++band)
+            {
+                const size_t y0 = band * WARP_TILE;
+                const size_t y1 = std::min(rows, y0 + WARP_TILE);
+                for (size_t x0 = 0; x0 < cols; x0 += WARP_TILE)
+                {
+                    const size_t n = std::min(WARP_TILE, cols - x0);
+                    for (size_t y = y0; y < y1; ++y)
+                    {
+                        coords(y, x0, n, xy, fxy);
+                        sample_row<T, CN>(s, xy, fxy, d.ptr(y) + x0 * CN, n, interp, border, bval);
+                    }
+                }
+            } });
+    }
+
+    /**
+     * @brief 读取 rows x 3 的变换矩阵 (IMG_32FC1 / IMG_64FC1) 到 m (按行存放)。
+     * @throw std::invalid_argument 如果 M 的尺寸或类型不对。
+     */
+    static void read_matrix(const Image &M, size_t rows, double *m, const std::string &F_NAME)
+    {
+        if (M.empty() || M.get_rows() != rows || M.get_cols() != 3 || (M.get_type() != IMG_32FC1 && M.get_type() != IMG_64FC1))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "变换矩阵必须是 " + std::to_string(rows) +
+                                        "x3 的 IMG_32FC1 / IMG_64FC1 图像。");
+        }
+        for (size_t i = 0; i < rows; ++i)
+        {
+            const unsigned char *p = M.data() + static_cast<std::ptrdiff_t>(i) * M.get_step();
+            for (size_t j = 0; j < 3; ++j)
+            {
+                m[i * 3 + j] = M.get_type() == IMG_32FC1 ? reinterpret_cast<const float *>(p)[j]
+                                                         : reinterpret_cast<const double *>(p)[j];
+            }
+        }
+    }
+
+    /** @brief warp_affine / warp_perspective 共同的参数检查。 */
+    static void check_warp_args(const Image &src, Size dsize, InterpolationType interp, BorderType border, const std::string &F_NAME)
+    {
+        if (src.empty())
+        {
+            throw std::logic_error(IMG_ERROR_PREFIX(F_NAME) + "输入图像为空。");
+        }
+        if (src.get_rows() > static_cast<size_t>(std::numeric_limits<short>::max()) ||
+            src.get_cols() > static_cast<size_t>(std::numeric_limits<short>::max()))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "源图像的宽高不能超过 32767。");
+        }
+        if (dsize.width <= 0 || dsize.height <= 0)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "输出尺寸无效: " + std::to_string(dsize.width) + " x " +
+                                        std::to_string(dsize.height));
+        }
+        if (interp != INTER_NEAREST && interp != INTER_LINEAR)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 INTER_NEAREST / INTER_LINEAR, 收到 " + std::to_string(interp));
+        }
+        check_border_type(border, F_NAME);
+    }
+
+    /**
+     * @brief 仿射变换。
+     * 输出像素 (x, y) 的源坐标为 (a x + b y + c, d x + e y + f) (M 的逆), 其中与 x 有关的部分对每列预先算成定点数,
+     * 每行只需计算一次起点, 每个像素只做两次整数加法和移位。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 尺寸为 dsize, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param M 2x3 的变换矩阵 (源坐标 -> 输出坐标), IMG_32FC1 / IMG_64FC1。
+     * @param dsize 输出尺寸。
+     * @param interp INTER_NEAREST 或 INTER_LINEAR。
+     * @param border 图像之外像素的取法。
+     * @param border_value BORDER_CONSTANT 时图像之外像素的值。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果 M、dsize、interp 或 border 无效, 或源图像过大。
+     */
+    void warp_affine(const Image &src, Image &dst, const Image &M, Size dsize, InterpolationType interp,
+                     BorderType border, const Scalar &border_value)
+    {
+        const std::string F_NAME = "warp_affine";
+        check_warp_args(src, dsize, interp, border, F_NAME);
+        double m[6];
+        read_matrix(M, 2, m, F_NAME);
+        // 求逆: 输出坐标 -> 源坐标; 矩阵奇异时所有像素都取源图像的 (0, 0) 处
+        double inv[6] = {0, 0, 0, 0, 0, 0};
+        const double det = m[0] * m[4] - m[1] * m[3];
+        if (det != 0)
+        {
+            inv[0] = m[4] / det;
+            inv[1] = -m[1] / det;
+            inv[3] = -m[3] / det;
+            inv[4] = m[0] / det;
+            inv[2] = -inv[0] * m[2] - inv[1] * m[5];
+            inv[5] = -inv[3] * m[2] - inv[4] * m[5];
+        }
+
+        const int ab_scale = 1 << WARP_AB_BITS;
+        // 最近邻时直接舍入到整数像素, 双线性时舍入到 1/INTER_TAB_SIZE 像素
+        const int shift = interp == INTER_NEAREST ? WARP_AB_BITS : WARP_AB_BITS - INTER_BITS;
+        const int round_delta = 1 << (shift - 1);
+        std::vector<int> adelta(static_cast<size_t>(dsize.width));
+        std::vector<int> bdelta(static_cast<size_t>(dsize.width));
+        for (int x = 0; x < dsize.width; ++x)
+        {
+            adelta[x] = clamp_round(inv[0] * x * ab_scale);
+            bdelta[x] = clamp_round(inv[3] * x * ab_scale);
+        }
+
+        const Image s = pixel_contiguous(src);
+        Image out(static_cast<size_t>(dsize.height), static_cast<size_t>(dsize.width), s.get_type());
+        auto coords = [&](size_t y, size_t x0, size_t n, short *xy, unsigned short *fxy)
+        {
+            const int X0 = clamp_round((inv[1] * static_cast<double>(y) + inv[2]) * ab_scale) + round_delta;
+            const int Y0 = clamp_round((inv[4] * static_cast<double>(y) + inv[5]) * ab_scale) + round_delta;
+            const int *a = adelta.data() + x0;
+            const int *b = bdelta.data() + x0;
+            if (interp == INTER_NEAREST)
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    xy[2 * i] = saturate_short((X0 + a[i]) >> shift);
+                    xy[2 * i + 1] = saturate_short((Y0 + b[i]) >> shift);
+                }
+                return;
+            }
+            for (size_t i = 0; i < n; ++i)
+                split_fixed((X0 + a[i]) >> shift, (Y0 + b[i]) >> shift, xy + 2 * i, fxy + i);
+        };
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { warp_tiles<typename decltype(tag)::type, decltype(tag)::channels>(s, out, interp, border, border_value, coords); });
+        dst = out;
+    }
+
+    /**
+     * @brief 透视变换。
+     * 输出像素 (x, y) 的源坐标为 (X / W, Y / W), X、Y、W 是 M 的逆与 (x, y, 1) 的乘积; 沿一行 X、Y、W 都是 x 的线性函数,
+     * 每个像素只做三次加法和一次除法, 然后转换为与仿射变换相同的定点坐标。
+     * @param M 3x3 的变换矩阵 (源坐标 -> 输出坐标), IMG_32FC1 / IMG_64FC1。
+     * 其它参数和异常同 warp_affine。
+     */
+    void warp_perspective(const Image &src, Image &dst, const Image &M, Size dsize, InterpolationType interp,
+                          BorderType border, const Scalar &border_value)
+    {
+        const std::string F_NAME = "warp_perspective";
+        check_warp_args(src, dsize, interp, border, F_NAME);
+        double m[9];
+        read_matrix(M, 3, m, F_NAME);
+        // 伴随矩阵求逆, 矩阵奇异时所有像素都取源图像的 (0, 0) 处
+        double inv[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+        const double adj[9] = {m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+                               m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+                               m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3]};
+        const double det = m[0] * adj[0] + m[1] * adj[3] + m[2] * adj[6];
+        if (det != 0)
+        {
+            for (int k = 0; k < 9; ++k)
+                inv[k] = adj[k] / det;
+        }
+
+        const Image s = pixel_contiguous(src);
+        Image out(static_cast<size_t>(dsize.height), static_cast<size_t>(dsize.width), s.get_type());
+        const double scale = interp == INTER_NEAREST ? 1.0 : static_cast<double>(INTER_TAB_SIZE);
+        auto coords = [&](size_t y, size_t x0, size_t n, short *xy, unsigned short *fxy)
+        {
+            const double fx0 = static_cast<double>(x0);
+            const double fy = static_cast<double>(y);
+            double X = inv[0] * fx0 + inv[1] * fy + inv[2];
+            double Y = inv[3] * fx0 + inv[4] * fy + inv[5];
+            double W = inv[6] * fx0 + inv[7] * fy + inv[8];
+            for (size_t i = 0; i < n; ++i, X += inv[0], Y += inv[3], W += inv[6])
+            {
+                const double w = W != 0 ? scale / W : 0.0;
+                const int ix = clamp_round(X * w);
+                const int iy = clamp_round(Y * w);
+                if (interp == INTER_NEAREST)
+                {
+                    xy[2 * i] = saturate_short(ix);
+                    xy[2 * i + 1] = saturate_short(iy);
+                }
+                else
+                {
+                    split_fixed(ix, iy, xy + 2 * i, fxy + i);
+                }
+            }
+        };
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { warp_tiles<typename decltype(tag)::type, decltype(tag)::channels>(s, out, interp, border, border_value, coords); });
+        dst = out;
+    }
+
+    /**
+     * @brief 把一行浮点坐标 (mx, my) 转换为定点坐标: 最近邻时 xy 为舍入后的整数坐标, 双线性时为整数部分和表索引。
+     * SSE2 时每次转换 4 个像素: 先把坐标夹到 [-2^25, 2^25] (乘 32 后仍在 int 范围内, 超出图像的坐标保持在同一侧),
+     * cvtps2dq 舍入, packs 把整数部分饱和到 16 位。
+     */
+    static void fixed_coords_row(const float *mx, const float *my, size_t n, InterpolationType interp, short *xy, unsigned short *fxy)
+    {
+        const float scale = interp == INTER_NEAREST ? 1.0f : static_cast<float>(INTER_TAB_SIZE);
+        size_t i = 0;
+#if defined(__SSE2__)
+        const __m128 limit = _mm_set1_ps(static_cast<float>(1 << 25));
+        const __m128 neg_limit = _mm_set1_ps(-static_cast<float>(1 << 25));
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128i mask = _mm_set1_epi32(INTER_TAB_SIZE - 1);
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128 x = _mm_max_ps(neg_limit, _mm_min_ps(limit, _mm_loadu_ps(mx + i)));
+            const __m128 y = _mm_max_ps(neg_limit, _mm_min_ps(limit, _mm_loadu_ps(my + i)));
+            __m128i ix = _mm_cvtps_epi32(_mm_mul_ps(x, vscale));
+            __m128i iy = _mm_cvtps_epi32(_mm_mul_ps(y, vscale));
+            if (interp != INTER_NEAREST)
+            {
+                const __m128i idx = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(iy, mask), INTER_BITS), _mm_and_si128(ix, mask));
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(fxy + i), _mm_packs_epi32(idx, idx));
+                ix = _mm_srai_epi32(ix, INTER_BITS);
+                iy = _mm_srai_epi32(iy, INTER_BITS);
+            }
+            const __m128i sx = _mm_packs_epi32(ix, ix);
+            const __m128i sy = _mm_packs_epi32(iy, iy);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(xy + 2 * i), _mm_unpacklo_epi16(sx, sy));
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            const int ix = clamp_round(static_cast<double>(mx[i]) * scale);
+            const int iy = clamp_round(static_cast<double>(my[i]) * scale);
+            if (interp == INTER_NEAREST)
+            {
+                xy[2 * i] = saturate_short(ix);
+                xy[2 * i + 1] = saturate_short(iy);
+            }
+            else
+            {
+                split_fixed(ix, iy, xy + 2 * i, fxy + i);
+            }
+        }
+    }
+
+    /**
+     * @brief 检查 map_x / map_y 为同尺寸的 IMG_32FC1 图像。
+     * @throw std::invalid_argument 如果不满足。
+     */
+    static void check_float_maps(const Image &map_x, const Image &map_y, const std::string &F_NAME)
+    {
+        if (map_x.empty() || map_y.empty() || map_x.get_type() != IMG_32FC1 || map_y.get_type() != IMG_32FC1 ||
+            map_x.get_rows() != map_y.get_rows() || map_x.get_cols() != map_y.get_cols())
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "map_x 和 map_y 必须是同尺寸的 IMG_32FC1 图像。");
+        }
+    }
+
+    /**
+     * @brief 用浮点坐标图重映射。
+     * 每块的坐标在采样前才转换为与 warp_affine 相同的定点形式, 分块并行的方式也相同。
+     * 同一个映射用于很多帧时, 先用 convert_maps 转换一次更快。
+     * @param src 输入图像, 支持所有深度和 ROI 等视图。
+     * @param dst 输出图像, 尺寸与 map_x 相同, 类型与 src 相同, 可以与 src 是同一个对象。
+     * @param map_x 每个输出像素的源 x 坐标, IMG_32FC1。
+     * @param map_y 每个输出像素的源 y 坐标, IMG_32FC1, 与 map_x 同尺寸。
+     * @param interp INTER_NEAREST 或 INTER_LINEAR。
+     * @param border 图像之外像素的取法。
+     * @param border_value BORDER_CONSTANT 时图像之外像素的值。
+     * @throw std::logic_error 如果输入图像为空。
+     * @throw std::invalid_argument 如果坐标图、interp 或 border 无效, 或源图像过大。
+     */
+    void remap(const Image &src, Image &dst, const Image &map_x, const Image &map_y, InterpolationType interp,
+               BorderType border, const Scalar &border_value)
+    {
+        const std::string F_NAME = "remap";
+        check_float_maps(map_x, map_y, F_NAME);
+        const Size dsize{static_cast<int>(map_x.get_cols()), static_cast<int>(map_x.get_rows())};
+        check_warp_args(src, dsize, interp, border, F_NAME);
+        const Image s = pixel_contiguous(src);
+        const Image mx = pixel_contiguous(map_x);
+        const Image my = pixel_contiguous(map_y);
+        Image out(map_x.get_rows(), map_x.get_cols(), s.get_type());
+        auto coords = [&](size_t y, size_t x0, size_t n, short *xy, unsigned short *fxy)
+        {
+            const float *px = reinterpret_cast<const float *>(mx.data() + static_cast<std::ptrdiff_t>(y) * mx.get_step()) + x0;
+            const float *py = reinterpret_cast<const float *>(my.data() + static_cast<std::ptrdiff_t>(y) * my.get_step()) + x0;
+            fixed_coords_row(px, py, n, interp, xy, fxy);
+        };
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { warp_tiles<typename decltype(tag)::type, decltype(tag)::channels>(s, out, interp, border, border_value, coords); });
+        dst = out;
+    }
+
+    /**
+     * @brief 把浮点坐标图一次转换为定点坐标表, 按行并行。
+     * @param map_x 源 x 坐标, IMG_32FC1。
+     * @param map_y 源 y 坐标, IMG_32FC1, 与 map_x 同尺寸。
+     * @param dst 输出的定点坐标表, 每个像素 6 字节 (最近邻时 4 字节), 而浮点坐标图为 8 字节。
+     * @param interp 之后 remap 使用的插值方式, INTER_NEAREST 或 INTER_LINEAR。
+     * @throw std::invalid_argument 如果坐标图或 interp 无效。
+     */
+    void convert_maps(const Image &map_x, const Image &map_y, FixedPointMap &dst, InterpolationType interp)
+    {
+        const std::string F_NAME = "convert_maps";
+        check_float_maps(map_x, map_y, F_NAME);
+        if (interp != INTER_NEAREST && interp != INTER_LINEAR)
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "只支持 INTER_NEAREST / INTER_LINEAR, 收到 " + std::to_string(interp));
+        }
+        const Image mx = pixel_contiguous(map_x);
+        const Image my = pixel_contiguous(map_y);
+        const size_t rows = mx.get_rows();
+        const size_t cols = mx.get_cols();
+        FixedPointMap out;
+        out.rows = rows;
+        out.cols = cols;
+        out.xy.resize(rows * cols * 2);
+        if (interp == INTER_LINEAR)
+            out.fxy.resize(rows * cols);
+        parallel_for_rows(rows, cols * (2 * sizeof(float) + 3 * sizeof(short)), [&](size_t begin, size_t end)
+                          {
+            for (size_t y = begin; y < end; ++y)
+            {
+                const float *px = reinterpret_cast<const float *>(mx.data() + static_cast<std::ptrdiff_t>(y) * mx.get_step());
+                const float *py = reinterpret_cast<const float *>(my.data() + static_cast<std::ptrdiff_t>(y) * my.get_step());
+                fixed_coords_row(px, py, cols, interp, out.xy.data() + y * cols * 2, out.fxy.empty() ? nullptr : out.fxy.data() + y * cols);
+            } });
+        dst = std::move(out);
+    }
+
+    /**
+     * @brief 按定点坐标表逐行采样。表中的坐标已是 sample_row 需要的形式, 直接传入表中的行指针, 不复制也不分块:
+     * 坐标表、输出都按行顺序读写, 硬件预取效果最好; 分块时每块纵向跨 WARP_TILE 行读取坐标表, 读取延迟反而盖过了源图像局部性的收益。
+     */
+    template <typename T, int CN>
+    static void remap_fixed_rows(const Image &src, Image &dst, const FixedPointMap &map, InterpolationType interp,
+                                 BorderType border, const Scalar &border_value)
+    {
+        Image_<const T, CN> s(src);
+        Image_<T, CN> d(dst);
+        const Vec<T, CN> bval = scalar_to_pixel<T, CN>(border_value);
+        parallel_for_rows(map.rows, map.cols * (CN * sizeof(T) * 4 + 3 * sizeof(short)), [&](size_t begin, size_t end)
+                          {
+            for (size_t y = begin; y < end; ++y)
+            {
+                const short *xy = map.xy.data() + y * map.cols * 2;
+                const unsigned short *fxy = interp == INTER_NEAREST ? nullptr : map.fxy.data() + y * map.cols;
+                sample_row<T, CN>(s, xy, fxy, d.ptr(y), map.cols, interp, border, bval);
+            } });
+    }
+
+    /**
+     * @brief 用 convert_maps 生成的定点坐标表重映射, 采样时没有任何坐标计算。
+     * @param map 定点坐标表, 决定输出尺寸和插值方式 (fxy 为空时为最近邻)。
+     * 其它参数和异常同浮点坐标图的 remap。
+     * fxy 中不小于 INTER_TAB_SIZE^2 的索引在采样时只取低位 (见 sample_linear_row), 每帧不再扫描整张表。
+     * @throw std::invalid_argument 如果 map 的尺寸不一致。
+     */
+    void remap(const Image &src, Image &dst, const FixedPointMap &map, BorderType border, const Scalar &border_value)
+    {
+        const std::string F_NAME = "remap";
+        const size_t total = map.rows * map.cols;
+        if (total == 0 || map.xy.size() != total * 2 || !(map.fxy.empty() || map.fxy.size() == total))
+        {
+            throw std::invalid_argument(IMG_ERROR_PREFIX(F_NAME) + "无效的定点坐标表, 请用 convert_maps 生成。");
+        }
+        const InterpolationType interp = map.fxy.empty() ? INTER_NEAREST : INTER_LINEAR;
+        const Size dsize{static_cast<int>(map.cols), static_cast<int>(map.rows)};
+        check_warp_args(src, dsize, interp, border, F_NAME);
+        const Image s = pixel_contiguous(src);
+        Image out(map.rows, map.cols, s.get_type());
+        dispatch_type(s.get_type(), [&](auto tag)
+                      { remap_fixed_rows<typename decltype(tag)::type, decltype(tag)::channels>(s, out, map, interp, border, border_value); });
+        dst = out;
+    }
+}